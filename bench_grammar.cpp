@@ -0,0 +1,136 @@
+#include "lang.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+/**
+ * Time building the lang grammar's tables a number of times with one construction.
+ */
+static double bench_construction(const std::string& name, parsing::TableConstruction construction, 
+                                 std::size_t repeats){
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 1; i < repeats; ++i){
+        parsing::Grammar(parsing::keys(lang::LANG_TOKENS), lang::LANG_RULES, lang::LANG_PRECEDENCE, construction);
+    }
+    parsing::Grammar grammar(parsing::keys(lang::LANG_TOKENS), lang::LANG_RULES, lang::LANG_PRECEDENCE, construction);
+    auto end = std::chrono::steady_clock::now();
+
+    double secs = std::chrono::duration<double>(end - start).count() / repeats;
+    std::cout << name << ": " << secs * 1e3 << " ms (" << grammar.parse_table().size() << " states, " 
+              << grammar.conflicts().size() << " conflicts, " << grammar.compressed_table().size() 
+              << " byte table)" << std::endl;
+    return secs;
+}
+
+/**
+ * Time loading the lang grammar from a cache file.
+ */
+static double bench_cache(std::size_t repeats){
+    const std::string cache_file = "bench_grammar_cache.bin";
+    std::remove(cache_file.c_str());
+    parsing::Grammar(cache_file, parsing::keys(lang::LANG_TOKENS), lang::LANG_RULES, lang::LANG_PRECEDENCE);
+
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 1; i < repeats; ++i){
+        parsing::Grammar(cache_file, parsing::keys(lang::LANG_TOKENS), lang::LANG_RULES, lang::LANG_PRECEDENCE);
+    }
+    parsing::Grammar grammar(cache_file, parsing::keys(lang::LANG_TOKENS), lang::LANG_RULES, lang::LANG_PRECEDENCE);
+    auto end = std::chrono::steady_clock::now();
+    std::remove(cache_file.c_str());
+
+    double secs = std::chrono::duration<double>(end - start).count() / repeats;
+    std::cout << "SLR(1) from cache: " << secs * 1e3 << " ms (" << (grammar.cached() ? "loaded" : "not loaded") 
+              << ")" << std::endl;
+    return secs;
+}
+
+/**
+ * Time making a lazy grammar for lang and parsing a small module with it, which only builds
+ * the states that module reaches.
+ */
+static double bench_lazy(std::size_t repeats){
+    const std::string code = "def func(a: num) -> num:\n    return -a * 2\n";
+    std::size_t num_states = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < repeats; ++i){
+        parsing::Grammar grammar(parsing::keys(lang::LANG_TOKENS), lang::LANG_RULES, lang::LANG_PRECEDENCE, 
+                                 parsing::LAZY_SLR_TABLE);
+        lang::LangLexer lexer(lang::LANG_TOKENS, lang::LANG_SCANNER);
+        parsing::Parser(lexer, grammar).parse(code);
+        num_states = grammar.num_lazy_states();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double secs = std::chrono::duration<double>(end - start).count() / repeats;
+    std::cout << "Lazy SLR(1) with a small parse: " << secs * 1e3 << " ms (" << num_states << " states built)" 
+              << std::endl;
+    return secs;
+}
+
+/**
+ * Make a grammar with a separate expression language for each of a number of statements.
+ */
+static std::vector<parsing::ParseRule> make_rules(std::size_t num_stmts){
+    std::vector<parsing::ParseRule> rules = {
+        {"module", {"stmts"}, nullptr},
+        {"stmts", {"stmts", "stmt"}, nullptr},
+        {"stmts", {"stmt"}, nullptr},
+    };
+    for (std::size_t i = 0; i < num_stmts; ++i){
+        const std::string n = std::to_string(i);
+        rules.push_back({"stmt", {"KW" + n, "expr" + n, "SEMI"}, nullptr});
+        rules.push_back({"expr" + n, {"expr" + n, "ADD" + n, "term" + n}, nullptr});
+        rules.push_back({"expr" + n, {"term" + n}, nullptr});
+        rules.push_back({"term" + n, {"term" + n, "MUL" + n, "factor" + n}, nullptr});
+        rules.push_back({"term" + n, {"factor" + n}, nullptr});
+        rules.push_back({"factor" + n, {"LPAR", "expr" + n, "RPAR"}, nullptr});
+        rules.push_back({"factor" + n, {"NAME"}, nullptr});
+    }
+    return parsing::prepend_prime_rule(rules);
+}
+
+/**
+ * Time finding the LR(0) states of a grammar on a number of threads.
+ */
+static double bench_kernels(const std::vector<parsing::ParseRule>& rules, std::size_t num_threads){
+    const parsing::InternedRules interned(rules);
+    parsing::Transitions transitions;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<parsing::LRItemIDSet> kernels = parsing::make_kernels(interned, transitions, num_threads);
+    auto end = std::chrono::steady_clock::now();
+
+    double secs = std::chrono::duration<double>(end - start).count();
+    std::cout << "LR(0) states on " << num_threads << " threads: " << secs * 1e3 << " ms (" 
+              << kernels.size() << " states)" << std::endl;
+    return secs;
+}
+
+int main(int argc, char** argv){
+    std::size_t repeats = argc > 1 ? std::atoi(argv[1]) : 10;
+    std::cout << "Building the lang grammar (" << lang::LANG_RULES.size() << " rules)" << std::endl;
+
+    double slr = bench_construction("SLR(1)", parsing::SLR_TABLE, repeats);
+    double lalr = bench_construction("LALR(1)", parsing::LALR_TABLE, repeats);
+    std::cout << "  vs SLR(1): " << lalr / slr << "x" << std::endl;
+    double lr1 = bench_construction("LR(1) with merging", parsing::LR1_TABLE, repeats);
+    std::cout << "  vs SLR(1): " << lr1 / slr << "x" << std::endl;
+    double cached = bench_cache(repeats);
+    std::cout << "  vs SLR(1): " << cached / slr << "x" << std::endl;
+    double lazy = bench_lazy(repeats);
+    std::cout << "  vs SLR(1): " << lazy / slr << "x" << std::endl;
+
+    const std::vector<parsing::ParseRule> rules = make_rules(2000);
+    std::cout << "Building a grammar with " << rules.size() << " rules on " 
+              << std::thread::hardware_concurrency() << " cores" << std::endl;
+    double one_thread = bench_kernels(rules, 1);
+    for (std::size_t num_threads : {2, 4, 8, 16}){
+        double threaded = bench_kernels(rules, num_threads);
+        std::cout << "  speedup: " << one_thread / threaded << "x" << std::endl;
+    }
+
+    return 0;
+}
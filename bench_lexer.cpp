@@ -0,0 +1,162 @@
+#include "lang.h"
+
+#include <chrono>
+#include <cstdlib>
+
+/**
+ * Create a lang module with the given number of functions.
+ */
+static std::string make_module(std::size_t num_funcs){
+    std::ostringstream code;
+    for (std::size_t i = 0; i < num_funcs; ++i){
+        code << "def func" << i << "(a: num, b: num) -> num:" << std::endl;
+        code << "    # Some comment about this function" << std::endl;
+        code << "    x = a * b - (a \\ 2)" << std::endl;
+        code << "    if x >= 10:" << std::endl;
+        code << "        print(\"x is large\", x)" << std::endl;
+        code << "    return -x + func" << i << "(b, a)" << std::endl;
+        code << std::endl;
+    }
+    return code.str();
+}
+
+/**
+ * Create a lang module that is mostly long comments and strings.
+ */
+static std::string make_commented_module(std::size_t num_funcs){
+    const std::string filler(120, 'z');
+    std::ostringstream code;
+    for (std::size_t i = 0; i < num_funcs; ++i){
+        code << "# " << filler << std::endl;
+        code << "# " << filler << std::endl;
+        code << "def func" << i << "():" << std::endl;
+        code << "    # " << filler << std::endl;
+        code << "    print(\"" << filler << "\\n\")        # " << filler << std::endl;
+        code << std::endl;
+    }
+    return code.str();
+}
+
+/**
+ * Time lexing all tokens in the code with an engine.
+ */
+static void bench_engine(const std::string& name, lexing::LexerEngine engine, 
+                         lexing::PositionTracking tracking, const std::string& code){
+    auto start = std::chrono::steady_clock::now();
+
+    lang::LangLexer lexer = engine == lexing::GENERATED_ENGINE ? 
+        lang::LangLexer(lang::LANG_TOKENS, lang::LANG_SCANNER, tracking) :
+        lang::LangLexer(lang::LANG_TOKENS, engine, tracking);
+    lexer.input(code);
+    std::size_t num_tokens = 0;
+    while (lexer.next_token().symbol != lexer.end_symbol()){
+        ++num_tokens;
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    double secs = std::chrono::duration<double>(end - start).count();
+    std::cout << name << ": " << num_tokens << " tokens in " << secs << " s ("
+              << code.size() / secs / 1e6 << " MB/s)" << std::endl;
+}
+
+/**
+ * Time lexing all tokens into a stream in one go.
+ */
+static void bench_tokenize(const std::string& code){
+    auto start = std::chrono::steady_clock::now();
+
+    lang::LangLexer lexer(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    lexer.input(code);
+    lexing::TokenStream stream = lexer.tokenize();
+
+    auto end = std::chrono::steady_clock::now();
+    double secs = std::chrono::duration<double>(end - start).count();
+    std::cout << "generated (tokenize): " << stream.size() << " tokens in " << secs << " s ("
+              << code.size() / secs / 1e6 << " MB/s)" << std::endl;
+}
+
+/**
+ * Time lexing all tokens into a stream on a number of threads.
+ */
+static void bench_tokenize_parallel(const std::string& code, std::size_t num_threads){
+    auto start = std::chrono::steady_clock::now();
+
+    lang::LangLexer lexer(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    lexer.input(code);
+    lexing::TokenStream stream = lexer.tokenize_parallel(num_threads);
+
+    auto end = std::chrono::steady_clock::now();
+    double secs = std::chrono::duration<double>(end - start).count();
+    std::cout << "generated (tokenize on " << num_threads << " threads): " << stream.size() << " tokens in " 
+              << secs << " s (" << code.size() / secs / 1e6 << " MB/s)" << std::endl;
+}
+
+/**
+ * Time relexing single line edits spread through the code, compared to lexing all of it again.
+ */
+static void bench_relex(const std::string& code, std::size_t num_edits){
+    lang::LangLexer lexer(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    lexer.input(code);
+    lexing::TokenStream stream = lexer.tokenize();
+
+    // Rename variables by adding a letter to them, which moves everything after them along
+    std::vector<std::size_t> offsets;
+    for (std::size_t i = 0; i < num_edits; ++i){
+        offsets.push_back(code.find("x = a", code.size() / num_edits * i));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < num_edits; ++i){
+        lexer.relex(stream, {offsets[i] + i, 0, "z"});
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double secs = std::chrono::duration<double>(end - start).count();
+    std::cout << "generated (relex): " << secs / num_edits * 1e3 << " ms per single line edit" << std::endl;
+}
+
+/**
+ * Time the DFA engine with each instruction set the CPU supports for scanning.
+ */
+static void bench_scans(const std::string& code){
+    const lexing::scan::InstructionSet best = lexing::scan::best_instruction_set();
+    const std::vector<std::pair<std::string, lexing::scan::InstructionSet>> instruction_sets = {
+        {"scalar", lexing::scan::SCALAR},
+        {"sse2", lexing::scan::SSE2},
+        {"avx2", lexing::scan::AVX2},
+    };
+    for (const auto& instruction_set : instruction_sets){
+        if (instruction_set.second <= best){
+            lexing::scan::set_instruction_set(instruction_set.second);
+            bench_engine("dfa (" + instruction_set.first + " scans)", lexing::DFA_ENGINE, lexing::TRACK_OFFSETS, code);
+        }
+    }
+    lexing::scan::set_instruction_set(best);
+}
+
+int main(int argc, char** argv){
+    std::size_t num_funcs = argc > 1 ? std::atoi(argv[1]) : 500;
+    const std::string code = make_module(num_funcs);
+    std::cout << "Lexing " << code.size() << " bytes" << std::endl;
+
+    bench_engine("regex", lexing::REGEX_ENGINE, lexing::TRACK_OFFSETS, code);
+    bench_engine("dfa (tracking lines)", lexing::DFA_ENGINE, lexing::TRACK_LINES, code);
+    bench_scans(code);
+    bench_engine("generated", lexing::GENERATED_ENGINE, lexing::TRACK_OFFSETS, code);
+    bench_tokenize(code);
+    for (std::size_t num_threads : {2, 4, 8}){
+        bench_tokenize_parallel(code, num_threads);
+    }
+
+    const std::string commented = make_commented_module(num_funcs);
+    std::cout << "Lexing " << commented.size() << " bytes of mostly comments and strings" << std::endl;
+    bench_scans(commented);
+    bench_engine("generated", lexing::GENERATED_ENGINE, lexing::TRACK_OFFSETS, commented);
+
+    // About 100k lines
+    const std::string large = make_module(num_funcs * 30);
+    std::cout << "Relexing " << std::count(large.begin(), large.end(), '\n') << " lines" << std::endl;
+    bench_relex(large, 100);
+
+    return 0;
+}
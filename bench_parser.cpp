@@ -0,0 +1,112 @@
+#include "lang.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+/**
+ * Create a lang module with the given number of functions.
+ */
+static std::string make_module(std::size_t num_funcs){
+    std::ostringstream code;
+    for (std::size_t i = 0; i < num_funcs; ++i){
+        code << "def func" << i << "():" << std::endl;
+        code << "    # Some comment about this function" << std::endl;
+        code << "    friends = {\"john\", \"pat\"}" << std::endl;
+        code << "    for i, name in enumerate(friends):" << std::endl;
+        code << "        print(\"iteration {} is {}\".format(i, name))" << std::endl;
+        code << "    x + -y" << std::endl;
+        code << std::endl;
+    }
+    return code.str();
+}
+
+/**
+ * Time parsing the code with the lexer on the parser's thread, or on its own thread when 
+ * the pipeline size is not 0.
+ */
+static double bench_parse(const std::string& name, const parsing::Grammar& grammar, const std::string& code, 
+                          std::size_t pipeline_size){
+    lang::LangLexer lexer(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    parsing::Parser parser(lexer, grammar);
+    parser.set_pipeline_size(pipeline_size);
+
+    auto start = std::chrono::steady_clock::now();
+    parser.parse(code);
+    auto end = std::chrono::steady_clock::now();
+
+    double secs = std::chrono::duration<double>(end - start).count();
+    const parsing::ParseStats& stats = parser.stats();
+    std::cout << name << ": " << secs << " s (" << code.size() / secs / 1e6 << " MB/s, " 
+              << static_cast<double>(stats.num_reductions) / stats.num_shifts << " reductions per token)" << std::endl;
+    return secs;
+}
+
+/**
+ * Time pushing already lexed tokens to a parser one at a time.
+ */
+static double bench_push(const std::string& code){
+    lang::LangLexer lexer(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    parsing::Parser parser(lexer, lang::lang_grammar());
+    lexing::TokenStream stream = parser.tokenize(std::make_shared<lexing::SourceBuffer>(code));
+
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i + 1 < stream.size(); ++i){
+        parser.feed(stream.token(i));
+    }
+    parser.finish();
+    auto end = std::chrono::steady_clock::now();
+
+    double secs = std::chrono::duration<double>(end - start).count();
+    std::cout << "pushing lexed tokens: " << secs << " s (" << code.size() / secs / 1e6 << " MB/s, " 
+              << (parser.push_result() ? "accepted" : "not accepted") << ")" << std::endl;
+    return secs;
+}
+
+/**
+ * Time making a parser a number of times.
+ */
+template <typename MakeParser>
+static void bench_make_parser(const std::string& name, std::size_t repeats, MakeParser make_parser){
+    lang::LangLexer lexer(lang::LANG_TOKENS, lang::LANG_SCANNER);
+
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < repeats; ++i){
+        make_parser(lexer);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double secs = std::chrono::duration<double>(end - start).count() / repeats;
+    std::cout << name << ": " << secs * 1e6 << " us" << std::endl;
+}
+
+int main(int argc, char** argv){
+    std::size_t num_funcs = argc > 1 ? std::atoi(argv[1]) : 5000;
+    const std::string code = make_module(num_funcs);
+    std::cout << "Parsing " << code.size() << " bytes on " << std::thread::hardware_concurrency() 
+              << " cores" << std::endl;
+
+    double lockstep = bench_parse("lexing in lockstep", lang::lang_grammar(), code, 0);
+    for (std::size_t pipeline_size : {64, 1024, 16384}){
+        double pipelined = bench_parse("lexing on another thread (" + std::to_string(pipeline_size) + " tokens buffered)", 
+                                       lang::lang_grammar(), code, pipeline_size);
+        std::cout << "  speedup: " << lockstep / pipelined << "x" << std::endl;
+    }
+    bench_push(code);
+    const parsing::Grammar with_unit_rules(parsing::keys(lang::LANG_TOKENS), lang::LANG_RULES, lang::LANG_PRECEDENCE);
+    double unit_rules = bench_parse("keeping unit rules", with_unit_rules, code, 0);
+    std::cout << "  speedup from leaving them out: " << unit_rules / lockstep << "x" << std::endl;
+
+    std::cout << "Making a parser" << std::endl;
+    bench_make_parser("from the rules", 10, [](lexing::Lexer& lexer){
+        parsing::Parser(lexer, lang::LANG_RULES, lang::LANG_PRECEDENCE);
+    });
+    bench_make_parser("from lang_grammar()", 100, [](lexing::Lexer& lexer){
+        parsing::Parser(lexer, lang::lang_grammar());
+    });
+    bench_make_parser("from LANG_PARSE_TABLE", 100, [](lexing::Lexer& lexer){
+        parsing::Parser(lexer, lang::LANG_PARSE_TABLE, lang::LANG_RULES);
+    });
+
+    return 0;
+}
@@ -46,8 +46,8 @@ void lang::Compiler::import_builtin_lib(const LibData& lib){
 }
 
 lang::Compiler::Compiler(): 
-    lexer_(lang::LangLexer(lang::LANG_TOKENS)),
-    parser_(parsing::Parser(lexer_, lang::LANG_GRAMMAR))
+    lexer_(lang::LangLexer(lang::LANG_TOKENS, lang::LANG_SCANNER)),
+    parser_(parsing::Parser(lexer_, lang::LANG_PARSE_TABLE, lang::LANG_RULES))
 {
     Scope global_scope;
     scope_stack_.push_back(global_scope);
@@ -56,8 +56,12 @@ lang::Compiler::Compiler():
     import_builtin_lib(create_io_lib());
 }
 
-std::shared_ptr<cppnodes::Module> lang::Compiler::compile(std::string code){
-    std::shared_ptr<Module> module_node = std::static_pointer_cast<Module>(parser_.parse(code));
+std::shared_ptr<cppnodes::Module> lang::Compiler::compile(const std::string& code){
+    return compile(std::make_shared<lexing::SourceBuffer>(code));
+}
+
+std::shared_ptr<cppnodes::Module> lang::Compiler::compile(const std::shared_ptr<const lexing::SourceBuffer>& source){
+    std::shared_ptr<Module> module_node = std::static_pointer_cast<Module>(parser_.parse(source));
     assert(lexer_.empty());
 
     std::shared_ptr<void> result = std::static_pointer_cast<void>(module_node->accept(*this));
@@ -402,14 +406,18 @@ std::shared_ptr<lang::LangType> lang::Compiler::infer(String& str_expr){
 
 /************ Cmd line interface **************/
 
-std::string compile_lang_str(const std::string& code){
+static std::string compile_lang_source(const std::shared_ptr<const lexing::SourceBuffer>& source){
     lang::Compiler compiler;
-    std::shared_ptr<cppnodes::Module> module = compiler.compile(code);
+    std::shared_ptr<cppnodes::Module> module = compiler.compile(source);
     std::string cpp_code = module->str();
 
     return cpp_code;
 }
 
+std::string compile_lang_str(const std::string& code){
+    return compile_lang_source(std::make_shared<lexing::SourceBuffer>(code));
+}
+
 /**
  * Compile a single .cpp source
  */
@@ -455,8 +463,8 @@ void lang::write_file(const std::string& filename, const std::string& contents){
 }
 
 std::string lang::compile_lang_file(const std::string& src){
-    std::string code = read_file(src);
-    std::string cpp_code = compile_lang_str(code);
+    // Lex the file straight out of the page cache
+    std::string cpp_code = compile_lang_source(lexing::SourceBuffer::from_file(src));
     std::string dest = src + ".cpp";
     write_file(dest, cpp_code);
     return compile_cpp_file(dest);
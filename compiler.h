@@ -154,7 +154,8 @@ namespace lang {
             using BaseInferer::infer;
 
             Compiler();
-            std::shared_ptr<cppnodes::Module> compile(std::string);
+            std::shared_ptr<cppnodes::Module> compile(const std::string&);
+            std::shared_ptr<cppnodes::Module> compile(const std::shared_ptr<const lexing::SourceBuffer>&);
 
             std::shared_ptr<void> visit(Module&);
 
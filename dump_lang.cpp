@@ -5,5 +5,13 @@ int main(){
     parsing::Grammar grammar(parsing::keys(lexer.tokens()), lang::LANG_RULES, lang::LANG_PRECEDENCE);
     grammar.dump(std::cout);
 
+    const parsing::DenseParseTable& dense = grammar.dense_table();
+    const parsing::CompressedParseTable& compressed = grammar.compressed_table();
+    std::cout << std::endl << "Parse table (" << dense.num_states() << " states, " 
+              << grammar.num_terminals() << " terminals in " << compressed.num_terminal_classes() << " classes, "
+              << dense.num_symbols() - grammar.num_terminals() << " nonterminals)" << std::endl << std::endl;
+    std::cout << "dense: " << dense.size() << " bytes" << std::endl;
+    std::cout << "compressed: " << compressed.size() << " bytes" << std::endl;
+
     return 0;
 }
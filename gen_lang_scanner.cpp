@@ -0,0 +1,25 @@
+#include "lang.h"
+
+#include <fstream>
+
+/**
+ * Write the scanner for LANG_TOKENS to the given file, or stdout if no file is given.
+ */
+int main(int argc, char** argv){
+    std::ostringstream code;
+    lexing::generate_scanner(code, lang::LANG_TOKENS, "lang", "LANG_SCANNER", "NAME", lang::RESERVED_NAMES);
+
+    if (argc < 2){
+        std::cout << code.str();
+        return 0;
+    }
+
+    std::ofstream out(argv[1]);
+    out << code.str();
+    if (!out){
+        std::cerr << "Unable to write to " << argv[1] << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
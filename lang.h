@@ -33,19 +33,42 @@ namespace lang {
 
     class LangLexer: public lexing::Lexer {
         private:
-            lexing::LexToken make_indent() const;
-            lexing::LexToken make_dedent() const;
+            lexing::Token make_indent(std::size_t) const;
+            lexing::Token make_dedent(std::size_t) const;
+            int line_at(std::size_t) const;
+            std::vector<int> indent_levels(const lexing::TokenStream&, std::size_t) const;
+
+            template <typename NextBaseToken, typename Stop>
+            void indent_tokens(lexing::TokenStream&, NextBaseToken, Stop);
 
             // Indentation tracking
             std::vector<int> levels_ = {STARTING_COL};
             bool found_indent_ = false, found_dedent_ = false;
             bool loaded_init_token_ = false;
-            lexing::LexToken next_tok_;
+            lexing::Token next_tok_;
+            const int newline_symbol_, indent_symbol_, dedent_symbol_;
+
+            // For lexing part of another's code on its own
+            LangLexer(const LangLexer&, std::size_t offset, int lineno, int colno);
+
+        protected:
+            bool starts_line(const lexing::TokenStream&, std::size_t) const override;
 
         public:
-            LangLexer(const lexing::TokensMap&);
+            // Columns are only needed for the token after a NEWLINE, so only offsets are tracked by default.
+            LangLexer(const lexing::TokensMap&, lexing::LexerEngine engine=lexing::DFA_ENGINE,
+                      lexing::PositionTracking tracking=lexing::TRACK_OFFSETS);
+            LangLexer(const lexing::TokensMap&, const lexing::Scanner&, 
+                      lexing::PositionTracking tracking=lexing::TRACK_OFFSETS);
+
+            lexing::Token next_token() override;
+            lexing::TokenStream tokenize() override;
+
+            // Same as tokenize(), but lexes chunks of at least min_chunk_size bytes on separate 
+            // threads. Uses a thread per core by default.
+            lexing::TokenStream tokenize_parallel(std::size_t num_threads=0, std::size_t min_chunk_size=1 << 16);
 
-            lexing::LexToken token() override;
+            void relex(lexing::TokenStream&, const lexing::Edit&) override;
     };
 
     // Custom exceptions 
@@ -62,8 +85,11 @@ namespace lang {
 
     extern const std::vector<parsing::ParseRule> LANG_RULES;
     extern const lexing::TokensMap LANG_TOKENS;
+    extern const lexing::Keywords RESERVED_NAMES;
+    extern const lexing::Scanner LANG_SCANNER;  // Generated from LANG_TOKENS by gen_lang_scanner
     extern const parsing::PrecedenceList LANG_PRECEDENCE;
-    extern const parsing::Grammar LANG_GRAMMAR;
+    const parsing::Grammar& lang_grammar();  // Built from the rules the first time it is called
+    extern const parsing::StaticParseTable LANG_PARSE_TABLE;  // Generated from lang_grammar() by gen_lang_parse_table
 }
 
 #endif
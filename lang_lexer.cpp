@@ -1,13 +1,440 @@
 #include "lang.h"
 
-lang::LangLexer::LangLexer(const lexing::TokensMap& tokens): lexing::Lexer(tokens){}
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <thread>
 
-lexing::LexToken lang::LangLexer::make_indent() const {
-    return {tokens::INDENT, "", pos(), lineno(), 1};
+lang::LangLexer::LangLexer(const lexing::TokensMap& tokens, lexing::LexerEngine engine,
+                           lexing::PositionTracking tracking): 
+    lexing::Lexer(tokens, engine, tracking),
+    newline_symbol_(add_symbol(tokens::NEWLINE)),
+    indent_symbol_(add_symbol(tokens::INDENT)),
+    dedent_symbol_(add_symbol(tokens::DEDENT)){}
+
+lang::LangLexer::LangLexer(const lexing::TokensMap& tokens, const lexing::Scanner& scanner,
+                           lexing::PositionTracking tracking): 
+    lexing::Lexer(tokens, scanner, tracking),
+    newline_symbol_(add_symbol(tokens::NEWLINE)),
+    indent_symbol_(add_symbol(tokens::INDENT)),
+    dedent_symbol_(add_symbol(tokens::DEDENT)){}
+
+lang::LangLexer::LangLexer(const LangLexer& other, std::size_t offset, int lineno, int colno):
+    lexing::Lexer(other, offset, lineno, colno),
+    newline_symbol_(other.newline_symbol_),
+    indent_symbol_(other.indent_symbol_),
+    dedent_symbol_(other.dedent_symbol_){}
+
+/**
+ * Indentation tokens are placed at the end of the token after the NEWLINE.
+ */
+lexing::Token lang::LangLexer::make_indent(std::size_t end) const {
+    return {indent_symbol_, static_cast<std::uint32_t>(end), 0, line_at(end), 1};
+}
+
+lexing::Token lang::LangLexer::make_dedent(std::size_t end) const {
+    return {dedent_symbol_, static_cast<std::uint32_t>(end), 0, line_at(end), 1};
+}
+
+int lang::LangLexer::line_at(std::size_t offset) const {
+    return lineno(lexing::Token{0, static_cast<std::uint32_t>(offset), 0, 0, 0});
+}
+
+/**
+ * Add the tokens from next_base to the stream with the same indentation rules as next_token(), 
+ * but without going through its state machine for every token. INDENTs and DEDENTs are added 
+ * right after the NEWLINE before a change in indentation.
+ *
+ * next_base returns the next token without indentation and sets the offset of the end of it. 
+ * Tokens are added until the END token, or until stop returns true for a token before it is added.
+ */
+template <typename NextBaseToken, typename Stop>
+void lang::LangLexer::indent_tokens(lexing::TokenStream& stream, NextBaseToken next_base, Stop stop){
+    // The depth after each token is kept so relexing does not need to count it again
+    stream.depths.reserve(stream.symbols.capacity());
+    auto push = [this, &stream](const lexing::Token& tok){
+        push_token(stream, tok);
+        stream.depths.push_back(static_cast<int>(levels_.size()) - 1);
+    };
+
+    std::size_t end;
+    lexing::Token tok = next_base(end);
+    while (tok.symbol != end_symbol()){
+        if (stop(tok)){
+            return;
+        }
+        std::size_t next_end;
+        lexing::Token next = next_base(next_end);
+        push(tok);
+
+        if (tok.symbol == newline_symbol_){
+            while (next.symbol == newline_symbol_){
+                next = next_base(next_end);
+            }
+
+            int next_col = colno(next);
+            if (next_col > levels_.back()){
+                levels_.push_back(next_col);
+                push(make_indent(next_end));
+            }
+            else if (next_col < levels_.back()){
+                levels_.pop_back();
+                if (!std::any_of(levels_.begin(), levels_.end(), [next_col](int lvl){ return lvl == next_col; })){
+                    throw lang::IndentationError(lineno(next));
+                }
+                push(make_dedent(next_end));
+            }
+        }
+
+        tok = next;
+        end = next_end;
+    }
+
+    // Dedent back to the start at the end
+    while (levels_.size() > 1){
+        levels_.pop_back();
+        push(make_dedent(end));
+    }
+    push(tok);
+}
+
+/**
+ * Lex everything left in one pass.
+ */
+lexing::TokenStream lang::LangLexer::tokenize(){
+    if (loaded_init_token_){
+        // Already partway through the tokens
+        return lexing::Lexer::tokenize();
+    }
+
+    lexing::TokenStream stream = start_stream();
+    indent_tokens(stream, [this](std::size_t& end){
+        lexing::Token tok = lexing::Lexer::next_token();
+        end = cursor();
+        return tok;
+    }, [](const lexing::Token&){ return false; });
+    finish_stream(stream);
+    return stream;
+}
+
+/**
+ * The first line at or after the offset that starts in column 1 with something other 
+ * than whitespace, or the size of the code if there is none.
+ */
+static std::size_t top_level_line(const char* code, std::size_t size, std::size_t from){
+    assert(from > 0);
+    while (from < size){
+        const void* newline = std::memchr(code + from - 1, '\n', size - from + 1);
+        if (!newline){
+            break;
+        }
+        std::size_t line = static_cast<const char*>(newline) - code + 1;
+        if (line < size && !std::isspace(static_cast<unsigned char>(code[line]))){
+            return line;
+        }
+        from = line + 1;
+    }
+    return size;
+}
+
+static std::size_t count_lines(const char* begin, const char* end){
+    std::size_t count = 0;
+    while ((begin = static_cast<const char*>(std::memchr(begin, '\n', end - begin)))){
+        ++count;
+        ++begin;
+    }
+    return count;
+}
+
+/**
+ * Tokens lexed from one chunk of the code, and the cursor after each one.
+ */
+struct LexedChunk {
+    lexing::TokenStream stream;
+    std::vector<std::uint32_t> ends;
+};
+
+/**
+ * Lex the rest of the source on multiple threads.
+ *
+ * The source is split into chunks at lines that start in column 1, and each chunk is lexed 
+ * on its own by a lexer that shares this one's tables until it reaches the next chunk. A 
+ * split may land inside of a token that spans lines, like a string, so the chunks are only 
+ * guesses at where tokens start, and a chunk that does not start at a token ends at the 
+ * LexError it runs into. They are stitched together in order: a chunk is used from the point 
+ * where the cursor after a token matches where the tokens before it left off. Since lexing 
+ * from an offset always finds the same tokens, the tokens after that point are the same 
+ * ones the sequential lexer would find. When there is no such point, tokens are lexed one at 
+ * a time until there is one, which is also where any real LexError is thrown.
+ *
+ * Indentation is added to the stitched tokens in the same way as tokenize(), so the 
+ * output is the same.
+ */
+lexing::TokenStream lang::LangLexer::tokenize_parallel(std::size_t num_threads, std::size_t min_chunk_size){
+    if (!num_threads){
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    const char* code = source()->data();
+    const std::size_t code_size = source()->size();
+    const std::size_t start = cursor();
+    if (loaded_init_token_ || num_threads == 1 || start >= code_size){
+        return tokenize();
+    }
+
+    // Split the code into a few chunks per thread so threads that finish early can take more
+    std::size_t num_chunks = std::min(num_threads * 4, (code_size - start) / std::max<std::size_t>(min_chunk_size, 1));
+    std::vector<std::size_t> starts = {start};
+    for (std::size_t i = 1; i < num_chunks; ++i){
+        std::size_t target = start + (code_size - start) * i / num_chunks;
+        std::size_t split = top_level_line(code, code_size, std::max(target, starts.back() + 1));
+        if (split >= code_size){
+            break;
+        }
+        starts.push_back(split);
+    }
+    if (starts.size() == 1){
+        return tokenize();
+    }
+    num_chunks = starts.size();
+
+    // The line each chunk starts on
+    std::vector<std::size_t> chunk_lines(num_chunks);
+    run_parallel(num_chunks, num_threads, [&](std::size_t i, std::size_t){
+        std::size_t end = i + 1 < num_chunks ? starts[i + 1] : code_size;
+        chunk_lines[i] = count_lines(code + starts[i], code + end);
+    });
+    const int start_line = line_at(start);
+    const int start_col = colno(lexing::Token{0, static_cast<std::uint32_t>(start), 0, 0, 0});
+    std::vector<int> start_lines = {start_line};
+    for (std::size_t i = 1; i < num_chunks; ++i){
+        start_lines.push_back(start_lines.back() + static_cast<int>(chunk_lines[i - 1]));
+    }
+
+    // A symbol added by a callback in a chunk would get an ID that other chunks may also 
+    // give out, so the chunk ends before it
+    const std::size_t num_known_symbols = num_symbols();
+    std::vector<LexedChunk> chunks(num_chunks);
+    run_parallel(num_chunks, num_threads, [&](std::size_t i, std::size_t){
+        LangLexer lexer(*this, starts[i], start_lines[i], i ? 1 : start_col);
+        std::size_t limit = i + 1 < num_chunks ? starts[i + 1] : SIZE_MAX;
+
+        LexedChunk& chunk = chunks[i];
+        try {
+            while (1){
+                lexing::Token tok = lexer.lexing::Lexer::next_token();
+                if (static_cast<std::size_t>(tok.symbol) >= num_known_symbols){
+                    break;
+                }
+                lexer.push_token(chunk.stream, tok);
+                chunk.ends.push_back(static_cast<std::uint32_t>(lexer.cursor()));
+                if (tok.symbol == end_symbol() || lexer.cursor() >= limit){
+                    break;
+                }
+            }
+        }
+        catch (const lexing::LexError&){
+            // Either the chunk did not start at a token or the code has an error. The 
+            // chunk ends here and the stitching lexes past it one token at a time.
+        }
+        lexer.finish_stream(chunk.stream);
+    });
+
+    // Find a chunk with a token ending at the offset, or starting at it
+    auto find_sync = [&](std::size_t offset, std::size_t& chunk, std::size_t& index){
+        std::size_t last = std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin() - 1;
+        for (std::size_t i = last + 1; i-- > 0 && i + 2 > last; ){
+            if (offset == starts[i]){
+                chunk = i;
+                index = 0;
+                return true;
+            }
+            const std::vector<std::uint32_t>& ends = chunks[i].ends;
+            auto found = std::lower_bound(ends.begin(), ends.end(), offset);
+            if (found != ends.end() && *found == offset){
+                chunk = i;
+                index = found - ends.begin() + 1;
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // The chunks are stitched together as the indentation is added, so the first error in 
+    // the code is thrown, whether it is a LexError or an IndentationError
+    LangLexer sequential_lexer(*this, start, start_line, start_col);  // For tokens lexed one at a time
+    lexing::CallbackValues callback_values;  // For the tokens used from the chunks
+    const LexedChunk* lexed = nullptr;
+    std::size_t index = 0;
+    std::size_t offset = start;
+    auto next_base = [&](std::size_t& end){
+        if (!lexed || index == lexed->ends.size()){
+            std::size_t chunk;
+            lexed = find_sync(offset, chunk, index) && index < chunks[chunk].ends.size() ? &chunks[chunk] : nullptr;
+        }
+
+        lexing::Token tok;
+        if (lexed){
+            tok = lexed->stream.token(index);
+            end = lexed->ends[index++];
+            if (const std::string* value = lexed->stream.callback_value(tok.offset)){
+                callback_values.emplace_back(tok.offset, *value);
+            }
+        }
+        else {
+            if (sequential_lexer.cursor() != offset){
+                sequential_lexer.seek(offset, line_at(offset), colno(lexing::Token{0, static_cast<std::uint32_t>(offset), 0, 0, 0}));
+            }
+            tok = sequential_lexer.lexing::Lexer::next_token();
+            end = sequential_lexer.cursor();
+        }
+        offset = end;
+        return tok;
+    };
+
+    lexing::TokenStream stream = start_stream();
+    indent_tokens(stream, next_base, [](const lexing::Token&){ return false; });
+    finish_stream(stream);
+
+    // Both are in order of the tokens, which come after any this lexer already has
+    lexing::TokenStream sequential;
+    sequential_lexer.finish_stream(sequential);
+    std::merge(callback_values.begin(), callback_values.end(), 
+               sequential.callback_values.begin(), sequential.callback_values.end(), 
+               std::back_inserter(stream.callback_values), 
+               [](const std::pair<std::uint32_t, std::string>& a, const std::pair<std::uint32_t, std::string>& b){
+                   return a.first < b.first;
+               });
+
+    // Only the tokens lexed one at a time can have new symbols, which get the same IDs here
+    for (std::size_t i = num_known_symbols; i < sequential_lexer.num_symbols(); ++i){
+        add_symbol(sequential_lexer.symbol_name(static_cast<int>(i)));
+    }
+
+    seek(offset, line_at(offset), colno(lexing::Token{0, static_cast<std::uint32_t>(offset), 0, 0, 0}));
+    return stream;
+}
+
+bool lang::LangLexer::starts_line(const lexing::TokenStream& stream, std::size_t i) const {
+    if (!i){
+        return true;
+    }
+    int prev = stream.symbols[i - 1];
+    return prev == newline_symbol_ || prev == indent_symbol_ || prev == dedent_symbol_;
+}
+
+/**
+ * The indentation levels after the indentation before a token in a stream is added. The depth 
+ * kept for the token before it gives how many levels there are, and then only the tokens back 
+ * to the INDENT for the lowest one need to be looked at. A stream without depths has the 
+ * INDENTs and DEDENTs before the token counted instead.
+ */
+std::vector<int> lang::LangLexer::indent_levels(const lexing::TokenStream& stream, std::size_t index) const {
+    std::ptrdiff_t depth = 0;
+    if (stream.depths.size() == stream.size()){
+        depth = index ? stream.depths[index - 1] : 0;
+    }
+    else {
+        const int* symbols = stream.symbols.data();
+        const int indent = indent_symbol_, dedent = dedent_symbol_;
+        for (std::size_t i = 0; i < index; ++i){
+            depth += (symbols[i] == indent) - (symbols[i] == dedent);
+        }
+    }
+
+    std::vector<int> levels;
+    std::size_t dedents = 0;
+    for (std::size_t i = index; i-- > 0 && static_cast<std::ptrdiff_t>(levels.size()) < depth; ){
+        if (stream.symbols[i] == dedent_symbol_){
+            ++dedents;
+        }
+        else if (stream.symbols[i] == indent_symbol_){
+            if (dedents){
+                --dedents;
+            }
+            else {
+                // An INDENT is always followed by the token it indents to
+                levels.push_back(stream.columns[i + 1]);
+            }
+        }
+    }
+    levels.push_back(STARTING_COL);
+    std::reverse(levels.begin(), levels.end());
+    return levels;
 }
 
-lexing::LexToken lang::LangLexer::make_dedent() const {
-    return {tokens::DEDENT, "", pos(), lineno(), 1};
+/**
+ * Relex starting and ending on tokens at the start of a line. Lexing the rest of the code 
+ * would find the same INDENTs and DEDENTs as before once the tokens and the indentation levels 
+ * both line up with the old ones again.
+ */
+void lang::LangLexer::relex(lexing::TokenStream& stream, const lexing::Edit& edit){
+    Splice splice = start_relex(stream, edit);
+    const std::vector<int> restart_levels = indent_levels(stream, splice.restart);
+    found_indent_ = found_dedent_ = loaded_init_token_ = false;
+
+    // Indentation levels in the old stream, up to the token it may resync on
+    std::vector<int> old_levels;
+    std::size_t old_index;
+
+    lexing::TokenStream relexed;
+    bool resynced = false;
+    std::size_t restart_end;
+    auto lex = [&](){
+        levels_ = old_levels = restart_levels;
+        old_index = splice.restart;
+        relexed = lexing::TokenStream();
+        restart_end = 0;
+        indent_tokens(relexed, [this, &restart_end](std::size_t& end){
+            lexing::Token tok = lexing::Lexer::next_token();
+            end = cursor();
+            if (!restart_end){
+                restart_end = end;
+            }
+            return tok;
+        }, [&](const lexing::Token& tok){
+            if (!starts_line(relexed, relexed.size()) || !resyncs(stream, splice, tok) || 
+                    !starts_line(stream, splice.resync)){
+                return false;
+            }
+            for (; old_index < splice.resync; ++old_index){
+                if (stream.symbols[old_index] == indent_symbol_){
+                    old_levels.push_back(stream.columns[old_index + 1]);
+                }
+                else if (stream.symbols[old_index] == dedent_symbol_){
+                    old_levels.pop_back();
+                }
+            }
+            resynced = old_levels == levels_;
+            return resynced;
+        });
+    };
+    while (1){
+        try {
+            lex();
+        }
+        catch (...){
+            // Anything thrown in the window may be from a token cut short by its end
+            if (!widen_relex(splice)){
+                throw;
+            }
+            continue;
+        }
+        if (resynced || !widen_relex(splice)){
+            break;
+        }
+    }
+
+    // The INDENTs and DEDENTs before the first token lexed again are placed at its end
+    const int restart_line = line_at(restart_end);
+    for (std::size_t i = splice.restart; i-- > 0 && 
+            (stream.symbols[i] == indent_symbol_ || stream.symbols[i] == dedent_symbol_); ){
+        stream.offsets[i] = static_cast<std::uint32_t>(restart_end);
+        stream.lines[i] = restart_line;
+    }
+    finish_relex(stream, splice, relexed, resynced);
 }
 
 /**
@@ -21,34 +448,34 @@ lexing::LexToken lang::LangLexer::make_dedent() const {
  *
  * Otherwise, return the next token.
  */
-lexing::LexToken lang::LangLexer::token(){
+lexing::Token lang::LangLexer::next_token(){
     // Should not both be true at same time
     assert(!(found_dedent_ && found_indent_));
 
     if (!loaded_init_token_){
-        next_tok_ = lexing::Lexer::token();
+        next_tok_ = lexing::Lexer::next_token();
         loaded_init_token_ = true;
     }
 
     if (found_indent_){
         found_indent_ = false;
-        return make_indent();
+        return make_indent(cursor());
     }
     else if (found_dedent_){
         found_dedent_ = false;
-        return make_dedent();
+        return make_dedent(cursor());
     }
-    else if (next_tok_.symbol == lexing::tokens::END && levels_.size() > 1){
+    else if (next_tok_.symbol == end_symbol() && levels_.size() > 1){
         // If we are in a situation where we have reached the end of a file, but 
         // still have not fully dedent'd back to the start, keep returning dedents.
         levels_.pop_back();
-        return make_dedent();
+        return make_dedent(cursor());
     }
 
-    lexing::LexToken tok = next_tok_;
-    next_tok_ = lexing::Lexer::token();
+    lexing::Token tok = next_tok_;
+    next_tok_ = lexing::Lexer::next_token();
 
-    if (tok.symbol == lang::tokens::NEWLINE){
+    if (tok.symbol == newline_symbol_){
         // A NEWLINE token represents a series of lines separated by whitespace 
         // which includes at least 1 \n:
         // Example:
@@ -59,11 +486,11 @@ lexing::LexToken lang::LangLexer::token(){
         // Between x and y are newlines and spaces. The spaces are consumed as comments 
         // and the separate newlines are reprented as one NEWLINE by consuming all 
         // next_tokens that are also NEWLINEs.
-        while (next_tok_.symbol == lang::tokens::NEWLINE){
-            next_tok_ = lexing::Lexer::token();
+        while (next_tok_.symbol == newline_symbol_){
+            next_tok_ = lexing::Lexer::next_token();
         }
 
-        int next_col = next_tok_.colno;
+        int next_col = colno(next_tok_);
 
         // The next token to be returned may be an indent or dedent 
         int last_level = levels_.back();
@@ -80,7 +507,7 @@ lexing::LexToken lang::LangLexer::token(){
 
             // Make sure the indentations match any of the previous ones 
             if (!std::any_of(levels_.begin(), levels_.end(), [next_col](int lvl){ return lvl == next_col; })){
-                throw lang::IndentationError(next_tok_.lineno);
+                throw lang::IndentationError(lineno(next_tok_));
             }
 
             found_dedent_ = true;
@@ -1,10 +1,12 @@
 #include "lang.h"
 
+#include <cstdlib>
+
 #define DEFAULT_FUNC_RETURN_TYPE std::make_shared<lang::NameTypeDecl>("int")
 
 /****************** Lexer tokens *****************/
 
-std::unordered_map<std::string, std::string> RESERVED_NAMES = {
+const lexing::Keywords lang::RESERVED_NAMES = {
     {"def", "DEF"},
     {"return", "RETURN"},
     {"if", "IF"},
@@ -13,8 +15,9 @@ std::unordered_map<std::string, std::string> RESERVED_NAMES = {
 };
 
 void reserved_name(lexing::LexToken& tok){
-    if (RESERVED_NAMES.find(tok.value) != RESERVED_NAMES.end()){
-        tok.symbol = RESERVED_NAMES[tok.value];
+    auto found = lang::RESERVED_NAMES.find(tok.value);
+    if (found != lang::RESERVED_NAMES.end()){
+        tok.symbol = found->second;
     }
 }
 
@@ -24,7 +27,9 @@ void comment(lexing::LexToken& tok){
 
 void trim_string_quotes(lexing::LexToken& tok){
     assert(tok.value.size() >= 2);
-    tok.value = tok.value.substr(1, tok.value.size()-2);
+    // Trim in place so the lexer can reuse the string
+    tok.value.pop_back();
+    tok.value.erase(0, 1);
 }
 
 // Tokens are stored in an unordered map and have no iterative order
@@ -85,13 +90,13 @@ const lexing::TokensMap lang::LANG_TOKENS = {
 /********** Parser rules ***************/  
 
 // module : module_stmt_list
-std::shared_ptr<void> parse_module(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_module(parsing::NodeSpan args){
     auto module_stmt_list = std::static_pointer_cast<std::vector<std::shared_ptr<lang::ModuleStmt>>>(args[0]);
     return std::make_shared<lang::Module>(*module_stmt_list);
 }
 
 // module_stmt_list : func_def
-std::shared_ptr<void> parse_module_stmt_list(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_module_stmt_list(parsing::NodeSpan args){
     auto func_def = std::static_pointer_cast<lang::FuncDef>(args[0]);
     std::shared_ptr<std::vector<std::shared_ptr<parsing::Node>>> module_stmt_list(new std::vector<std::shared_ptr<parsing::Node>>);
     module_stmt_list->push_back(func_def);
@@ -100,17 +105,17 @@ std::shared_ptr<void> parse_module_stmt_list(std::vector<std::shared_ptr<void>>&
 }
 
 // module_stmt_list : NEWLINE
-std::shared_ptr<void> parse_module_stmt_list2(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_module_stmt_list2(parsing::NodeSpan args){
     return std::make_shared<std::vector<std::shared_ptr<parsing::Node>>>();
 }
 
 // module_stmt_list : module_stmt_list NEWLINE
-std::shared_ptr<void> parse_module_stmt_list3(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_module_stmt_list3(parsing::NodeSpan args){
     return args[0];
 }
 
 // module_stmt_list : module_stmt_list func_def
-std::shared_ptr<void> parse_module_stmt_list4(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_module_stmt_list4(parsing::NodeSpan args){
     auto module_stmt_list = std::static_pointer_cast<std::vector<std::shared_ptr<parsing::Node>>>(args[0]);
     auto func_def = std::static_pointer_cast<lang::FuncDef>(args[1]);
 
@@ -120,7 +125,7 @@ std::shared_ptr<void> parse_module_stmt_list4(std::vector<std::shared_ptr<void>>
 }
 
 // var_decl_list : var_decl 
-std::shared_ptr<void> parse_var_decl_list_one_arg(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_var_decl_list_one_arg(parsing::NodeSpan args){
     auto var_decl = std::static_pointer_cast<lang::VarDecl>(args[0]);
 
     std::shared_ptr<std::vector<std::shared_ptr<lang::VarDecl>>> var_decl_list(new std::vector<std::shared_ptr<lang::VarDecl>>);
@@ -130,7 +135,7 @@ std::shared_ptr<void> parse_var_decl_list_one_arg(std::vector<std::shared_ptr<vo
 }
 
 // var_decl_list : var_decl_list COMMA var_decl 
-std::shared_ptr<void> parse_var_decl_list(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_var_decl_list(parsing::NodeSpan args){
     auto var_decl_list = std::static_pointer_cast<std::vector<std::shared_ptr<lang::VarDecl>>>(args[0]);
     auto var_decl = std::static_pointer_cast<lang::VarDecl>(args[2]);
 
@@ -140,17 +145,17 @@ std::shared_ptr<void> parse_var_decl_list(std::vector<std::shared_ptr<void>>& ar
 }
 
 // var_decl : NAME COLON type_decl 
-std::shared_ptr<void> parse_var_decl(std::vector<std::shared_ptr<void>>& args){
-    auto name = std::static_pointer_cast<lexing::LexToken>(args[0]);
+std::shared_ptr<void> parse_var_decl(parsing::NodeSpan args){
+    lexing::LexToken name = args.token(0);
     auto type_decl = std::static_pointer_cast<lang::TypeDecl>(args[2]);
 
-    auto var_decl = std::make_shared<lang::VarDecl>(name->value, type_decl);
+    auto var_decl = std::make_shared<lang::VarDecl>(name.value, type_decl);
 
     return var_decl;
 }
 
 // var_assign_list : var_assign 
-std::shared_ptr<void> parse_var_assign_list_one_assign(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_var_assign_list_one_assign(parsing::NodeSpan args){
     auto var_assign = std::static_pointer_cast<lang::Assign>(args[0]);
     std::shared_ptr<std::vector<std::shared_ptr<lang::Assign>>> var_assign_list(new std::vector<std::shared_ptr<lang::Assign>>);
 
@@ -160,7 +165,7 @@ std::shared_ptr<void> parse_var_assign_list_one_assign(std::vector<std::shared_p
 }
 
 // var_assign_list : var_assign_list COMMA var_assign 
-std::shared_ptr<void> parse_var_assign_list(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_var_assign_list(parsing::NodeSpan args){
     auto var_assign_list = std::static_pointer_cast<std::vector<std::shared_ptr<lang::Assign>>>(args[0]);
     auto var_assign = std::static_pointer_cast<lang::Assign>(args[2]);
 
@@ -170,84 +175,84 @@ std::shared_ptr<void> parse_var_assign_list(std::vector<std::shared_ptr<void>>&
 }
 
 // var_assign : NAME ASSIGN expr
-std::shared_ptr<void> parse_var_assign(std::vector<std::shared_ptr<void>>& args){
-    auto name = std::static_pointer_cast<lexing::LexToken>(args[0]);
+std::shared_ptr<void> parse_var_assign(parsing::NodeSpan args){
+    lexing::LexToken name = args.token(0);
     auto expr = std::static_pointer_cast<lang::Expr>(args[2]);
 
-    return std::make_shared<lang::Assign>(name->value, expr);
+    return std::make_shared<lang::Assign>(name.value, expr);
 }
 
 // type_decl : NAME 
-std::shared_ptr<void> parse_type_decl_name(std::vector<std::shared_ptr<void>>& args){
-    auto name = std::static_pointer_cast<lexing::LexToken>(args[0]);
-    return std::make_shared<lang::NameTypeDecl>(name->value);
+std::shared_ptr<void> parse_type_decl_name(parsing::NodeSpan args){
+    lexing::LexToken name = args.token(0);
+    return std::make_shared<lang::NameTypeDecl>(name.value);
 }
 
 // func_def : DEF NAME LPAR RPAR COLON func_suite
-std::shared_ptr<void> parse_func_def(std::vector<std::shared_ptr<void>>& args){
-    auto name = std::static_pointer_cast<lexing::LexToken>(args[1]);
+std::shared_ptr<void> parse_func_def(parsing::NodeSpan args){
+    lexing::LexToken name = args.token(1);
     auto func_suite = std::static_pointer_cast<std::vector<std::shared_ptr<lang::FuncStmt>>>(args[5]);
 
     std::shared_ptr<lang::FuncArgs> func_args(new lang::FuncArgs);
     
     auto func_def = std::make_shared<lang::FuncDef>(
-            name->value, func_args, DEFAULT_FUNC_RETURN_TYPE, *func_suite);
+            name.value, func_args, DEFAULT_FUNC_RETURN_TYPE, *func_suite);
 
     return func_def;
 }
 
 // func_def : DEF NAME LPAR RPAR ARROW type_decl COLON func_suite
-std::shared_ptr<void> parse_func_def_with_return(std::vector<std::shared_ptr<void>>& args){
-    auto name = std::static_pointer_cast<lexing::LexToken>(args[1]);
+std::shared_ptr<void> parse_func_def_with_return(parsing::NodeSpan args){
+    lexing::LexToken name = args.token(1);
     auto type_decl = std::static_pointer_cast<lang::TypeDecl>(args[5]);
     auto func_suite = std::static_pointer_cast<std::vector<std::shared_ptr<lang::FuncStmt>>>(args[7]);
 
     std::shared_ptr<lang::FuncArgs> func_args(new lang::FuncArgs);
 
-    return std::make_shared<lang::FuncDef>(name->value, func_args, type_decl, *func_suite);
+    return std::make_shared<lang::FuncDef>(name.value, func_args, type_decl, *func_suite);
 }
 
 // func_def : DEF NAME LPAR func_args RPAR COLON func_suite 
-std::shared_ptr<void> parse_func_def_with_args(std::vector<std::shared_ptr<void>>& args){
-    auto name = std::static_pointer_cast<lexing::LexToken>(args[1]);
+std::shared_ptr<void> parse_func_def_with_args(parsing::NodeSpan args){
+    lexing::LexToken name = args.token(1);
     auto func_args = std::static_pointer_cast<lang::FuncArgs>(args[3]);
     auto func_suite = std::static_pointer_cast<std::vector<std::shared_ptr<lang::FuncStmt>>>(args[6]);
     
     return std::make_shared<lang::FuncDef>(
-            name->value, func_args, DEFAULT_FUNC_RETURN_TYPE, *func_suite);
+            name.value, func_args, DEFAULT_FUNC_RETURN_TYPE, *func_suite);
 }
 
 // func_def : DEF NAME LPAR func_args RPAR ARROW type_decl COLON func_suite  
-std::shared_ptr<void> parse_func_def_with_args_with_return(std::vector<std::shared_ptr<void>>& args){
-    auto name = std::static_pointer_cast<lexing::LexToken>(args[1]);
+std::shared_ptr<void> parse_func_def_with_args_with_return(parsing::NodeSpan args){
+    lexing::LexToken name = args.token(1);
     auto func_args = std::static_pointer_cast<lang::FuncArgs>(args[3]);
     auto type_decl = std::static_pointer_cast<lang::TypeDecl>(args[6]);
     auto func_suite = std::static_pointer_cast<std::vector<std::shared_ptr<lang::FuncStmt>>>(args[8]);
     
-    return std::make_shared<lang::FuncDef>(name->value, func_args, type_decl, *func_suite);
+    return std::make_shared<lang::FuncDef>(name.value, func_args, type_decl, *func_suite);
 }
 
 // func_args : var_decl_list 
-std::shared_ptr<void> parse_arg_list_only_var_decls(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_arg_list_only_var_decls(parsing::NodeSpan args){
     auto var_decl_list = std::static_pointer_cast<std::vector<std::shared_ptr<lang::VarDecl>>>(args[0]);
     std::vector<std::shared_ptr<lang::Assign>> kw_args;
     return std::make_shared<lang::FuncArgs>(*var_decl_list, kw_args, false);
 }
 
 // func_args : var_assign_list
-std::shared_ptr<void> parse_arg_list_only_kwarg_decls(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_arg_list_only_kwarg_decls(parsing::NodeSpan args){
     auto assign_list = std::static_pointer_cast<std::vector<std::shared_ptr<lang::Assign>>>(args[0]);
     std::vector<std::shared_ptr<lang::VarDecl>> pos_args;
     return std::make_shared<lang::FuncArgs>(pos_args, *assign_list, false);
 }
 
 // func_suite : NEWLINE INDENT func_stmts DEDENT
-std::shared_ptr<void> parse_func_suite(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_func_suite(parsing::NodeSpan args){
     return args[2];
 }
 
 // func_stmts : func_stmt 
-std::shared_ptr<void> parse_func_stmts(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_func_stmts(parsing::NodeSpan args){
     auto func_stmt = std::static_pointer_cast<parsing::Node>(args[0]);
     std::shared_ptr<std::vector<std::shared_ptr<parsing::Node>>> func_stmts(new std::vector<std::shared_ptr<parsing::Node>>);
     func_stmts->push_back(func_stmt);
@@ -256,7 +261,7 @@ std::shared_ptr<void> parse_func_stmts(std::vector<std::shared_ptr<void>>& args)
 }
 
 // func_stmts : func_stmts func_stmt 
-std::shared_ptr<void> parse_func_stmts2(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_func_stmts2(parsing::NodeSpan args){
     auto func_stmt = std::static_pointer_cast<parsing::Node>(args[1]);
     auto func_stmts = std::static_pointer_cast<std::vector<std::shared_ptr<parsing::Node>>>(args[0]);
     func_stmts->push_back(func_stmt);
@@ -265,7 +270,7 @@ std::shared_ptr<void> parse_func_stmts2(std::vector<std::shared_ptr<void>>& args
 }
 
 // func_stmts : func_stmts NEWLINE func_stmt 
-std::shared_ptr<void> parse_func_stmts3(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_func_stmts3(parsing::NodeSpan args){
     auto func_stmt = std::static_pointer_cast<parsing::Node>(args[2]);
     auto func_stmts = std::static_pointer_cast<std::vector<std::shared_ptr<parsing::Node>>>(args[0]);
     func_stmts->push_back(func_stmt);
@@ -274,42 +279,24 @@ std::shared_ptr<void> parse_func_stmts3(std::vector<std::shared_ptr<void>>& args
 }
 
 // func_stmt : simple_func_stmt NEWLINE
-std::shared_ptr<void> parse_func_stmt_simple(std::vector<std::shared_ptr<void>>& args){
-    return args[0];
-}
-
-// func_stmt : compound_func_stmt
-std::shared_ptr<void> parse_func_stmt_compound(std::vector<std::shared_ptr<void>>& args){
-    return args[0];
-}
-
-// simple_func_stmt : expr_stmt
-//                  | return_stmt
-//                  | var_assign
-std::shared_ptr<void> parse_simple_func_stmt(std::vector<std::shared_ptr<void>>& args){
-    return args[0];
-}
-
-// compound_func_stmt : if_stmt 
-//                    | for_loop
-std::shared_ptr<void> parse_compound_func_stmt(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_func_stmt_simple(parsing::NodeSpan args){
     return args[0];
 }
 
 // expr_stmt : expr 
-std::shared_ptr<void> parse_expr_stmt(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_expr_stmt(parsing::NodeSpan args){
     auto expr = std::static_pointer_cast<lang::Expr>(args[0]);
     return std::make_shared<lang::ExprStmt>(expr);
 }
 
 // return_stmt : RETURN expr  
-std::shared_ptr<void> parse_return_stmt(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_return_stmt(parsing::NodeSpan args){
     auto expr = std::static_pointer_cast<lang::Expr>(args[1]);
     return std::make_shared<lang::ReturnStmt>(expr);
 }
 
 // if_stmt : IF expr COLON func_suite 
-std::shared_ptr<void> parse_if_stmt(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_if_stmt(parsing::NodeSpan args){
     auto expr = std::static_pointer_cast<lang::Expr>(args[1]);
     auto func_suite = std::static_pointer_cast<std::vector<std::shared_ptr<lang::FuncStmt>>>(args[3]);
 
@@ -317,7 +304,7 @@ std::shared_ptr<void> parse_if_stmt(std::vector<std::shared_ptr<void>>& args){
 }
 
 // for_loop : FOR expr_list IN expr COLON func_suite 
-std::shared_ptr<void> parse_for_loop(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_for_loop(parsing::NodeSpan args){
     auto expr_list = std::static_pointer_cast<std::vector<std::shared_ptr<lang::Expr>>>(args[1]);
     auto expr = std::static_pointer_cast<lang::Expr>(args[3]);
     auto func_suite = std::static_pointer_cast<std::vector<std::shared_ptr<lang::FuncStmt>>>(args[5]);
@@ -326,37 +313,32 @@ std::shared_ptr<void> parse_for_loop(std::vector<std::shared_ptr<void>>& args){
 }
 
 // expr : expr DOT NAME
-std::shared_ptr<void> parse_member_access(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_member_access(parsing::NodeSpan args){
     auto expr = std::static_pointer_cast<lang::Expr>(args[0]);
-    auto name = std::static_pointer_cast<lexing::LexToken>(args[2]);
+    lexing::LexToken name = args.token(2);
 
-    return std::make_shared<lang::MemberAccess>(expr, name->value);
-}
-
-// expr : tuple 
-std::shared_ptr<void> parse_tuple_expr(std::vector<std::shared_ptr<void>>& args){
-    return args[0];
+    return std::make_shared<lang::MemberAccess>(expr, name.value);
 }
 
 // tuple : LBRACE RBRACE
-std::shared_ptr<void> parse_empty_tuple(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_empty_tuple(parsing::NodeSpan args){
     return std::make_shared<lang::Tuple>();
 }
 
 // tuple : LBRACE expr_list RBRACE
-std::shared_ptr<void> parse_tuple(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_tuple(parsing::NodeSpan args){
     auto expr_list = std::static_pointer_cast<std::vector<std::shared_ptr<lang::Expr>>>(args[1]);
     return std::make_shared<lang::Tuple>(*expr_list);
 }
 
 // expr : expr LPAR RPAR 
-std::shared_ptr<void> parse_empty_func_call(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_empty_func_call(parsing::NodeSpan args){
     auto expr = std::static_pointer_cast<lang::Expr>(args[0]);
     return std::make_shared<lang::Call>(expr);
 }
 
 // expr : expr LPAR expr_list RPAR
-std::shared_ptr<void> parse_func_call(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_func_call(parsing::NodeSpan args){
     auto expr = std::static_pointer_cast<lang::Expr>(args[0]);
     auto expr_list = std::static_pointer_cast<std::vector<std::shared_ptr<lang::Expr>>>(args[2]);
 
@@ -364,7 +346,7 @@ std::shared_ptr<void> parse_func_call(std::vector<std::shared_ptr<void>>& args){
 }
 
 // expr_list : expr  
-std::shared_ptr<void> parse_call_one_arg(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_call_one_arg(parsing::NodeSpan args){
     auto expr = std::static_pointer_cast<lang::Expr>(args[0]);
 
     std::shared_ptr<std::vector<std::shared_ptr<lang::Expr>>> expr_list(new std::vector<std::shared_ptr<lang::Expr>>);
@@ -374,7 +356,7 @@ std::shared_ptr<void> parse_call_one_arg(std::vector<std::shared_ptr<void>>& arg
 }
 
 // expr_list : expr_list COMMA expr
-std::shared_ptr<void> parse_expr_list(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_expr_list(parsing::NodeSpan args){
     auto expr_list = std::static_pointer_cast<std::vector<std::shared_ptr<lang::Expr>>>(args[0]);
     auto expr = std::static_pointer_cast<lang::Expr>(args[2]);
 
@@ -384,7 +366,7 @@ std::shared_ptr<void> parse_expr_list(std::vector<std::shared_ptr<void>>& args){
 }
 
 // expr : expr SUB expr 
-std::shared_ptr<void> parse_bin_sub_expr(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_bin_sub_expr(parsing::NodeSpan args){
     auto expr1 = std::static_pointer_cast<lang::Expr>(args[0]);
     auto expr2 = std::static_pointer_cast<lang::Expr>(args[2]);
 
@@ -392,7 +374,7 @@ std::shared_ptr<void> parse_bin_sub_expr(std::vector<std::shared_ptr<void>>& arg
 }
 
 // expr : expr ADD expr 
-std::shared_ptr<void> parse_bin_add_expr(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_bin_add_expr(parsing::NodeSpan args){
     auto expr1 = std::static_pointer_cast<lang::Expr>(args[0]);
     auto expr2 = std::static_pointer_cast<lang::Expr>(args[2]);
 
@@ -400,7 +382,7 @@ std::shared_ptr<void> parse_bin_add_expr(std::vector<std::shared_ptr<void>>& arg
 }
 
 // expr : expr MUL expr 
-std::shared_ptr<void> parse_bin_mul_expr(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_bin_mul_expr(parsing::NodeSpan args){
     auto expr1 = std::static_pointer_cast<lang::Expr>(args[0]);
     auto expr2 = std::static_pointer_cast<lang::Expr>(args[2]);
 
@@ -408,7 +390,7 @@ std::shared_ptr<void> parse_bin_mul_expr(std::vector<std::shared_ptr<void>>& arg
 }
 
 // expr : expr DIV expr 
-std::shared_ptr<void> parse_bin_div_expr(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_bin_div_expr(parsing::NodeSpan args){
     auto expr1 = std::static_pointer_cast<lang::Expr>(args[0]);
     auto expr2 = std::static_pointer_cast<lang::Expr>(args[2]);
 
@@ -416,7 +398,7 @@ std::shared_ptr<void> parse_bin_div_expr(std::vector<std::shared_ptr<void>>& arg
 }
 
 // expr : expr EQ expr 
-std::shared_ptr<void> parse_bin_eq_expr(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_bin_eq_expr(parsing::NodeSpan args){
     auto expr1 = std::static_pointer_cast<lang::Expr>(args[0]);
     auto expr2 = std::static_pointer_cast<lang::Expr>(args[2]);
 
@@ -424,7 +406,7 @@ std::shared_ptr<void> parse_bin_eq_expr(std::vector<std::shared_ptr<void>>& args
 }
 
 // expr : expr NE expr 
-std::shared_ptr<void> parse_bin_ne_expr(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_bin_ne_expr(parsing::NodeSpan args){
     auto expr1 = std::static_pointer_cast<lang::Expr>(args[0]);
     auto expr2 = std::static_pointer_cast<lang::Expr>(args[2]);
 
@@ -432,7 +414,7 @@ std::shared_ptr<void> parse_bin_ne_expr(std::vector<std::shared_ptr<void>>& args
 }
 
 // expr : expr LT expr 
-std::shared_ptr<void> parse_bin_lt_expr(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_bin_lt_expr(parsing::NodeSpan args){
     auto expr1 = std::static_pointer_cast<lang::Expr>(args[0]);
     auto expr2 = std::static_pointer_cast<lang::Expr>(args[2]);
 
@@ -440,7 +422,7 @@ std::shared_ptr<void> parse_bin_lt_expr(std::vector<std::shared_ptr<void>>& args
 }
 
 // expr : expr GT expr 
-std::shared_ptr<void> parse_bin_gt_expr(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_bin_gt_expr(parsing::NodeSpan args){
     auto expr1 = std::static_pointer_cast<lang::Expr>(args[0]);
     auto expr2 = std::static_pointer_cast<lang::Expr>(args[2]);
 
@@ -448,7 +430,7 @@ std::shared_ptr<void> parse_bin_gt_expr(std::vector<std::shared_ptr<void>>& args
 }
 
 // expr : expr LTE expr 
-std::shared_ptr<void> parse_bin_lte_expr(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_bin_lte_expr(parsing::NodeSpan args){
     auto expr1 = std::static_pointer_cast<lang::Expr>(args[0]);
     auto expr2 = std::static_pointer_cast<lang::Expr>(args[2]);
 
@@ -456,7 +438,7 @@ std::shared_ptr<void> parse_bin_lte_expr(std::vector<std::shared_ptr<void>>& arg
 }
 
 // expr : expr GTE expr 
-std::shared_ptr<void> parse_bin_gte_expr(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_bin_gte_expr(parsing::NodeSpan args){
     auto expr1 = std::static_pointer_cast<lang::Expr>(args[0]);
     auto expr2 = std::static_pointer_cast<lang::Expr>(args[2]);
 
@@ -464,31 +446,31 @@ std::shared_ptr<void> parse_bin_gte_expr(std::vector<std::shared_ptr<void>>& arg
 }
 
 // expr : SUB expr %UMINUS
-std::shared_ptr<void> parse_un_sub_expr(std::vector<std::shared_ptr<void>>& args){
+std::shared_ptr<void> parse_un_sub_expr(parsing::NodeSpan args){
     auto expr = std::static_pointer_cast<lang::Expr>(args[1]);
     return std::make_shared<lang::UnaryExpr>(expr, std::make_shared<lang::USub>());
 }
 
 // expr : NAME 
-std::shared_ptr<void> parse_name_expr(std::vector<std::shared_ptr<void>>& args){
-    auto name = std::static_pointer_cast<lexing::LexToken>(args[0]);
-    return std::make_shared<lang::NameExpr>(name->value);
+std::shared_ptr<void> parse_name_expr(parsing::NodeSpan args){
+    lexing::LexToken name = args.token(0);
+    return std::make_shared<lang::NameExpr>(name.value);
 }
 
 // expr : INT
-std::shared_ptr<void> parse_int_expr(std::vector<std::shared_ptr<void>>& args){
-    auto int_tok = std::static_pointer_cast<lexing::LexToken>(args[0]);
-    return std::make_shared<lang::Int>(int_tok->value);
+std::shared_ptr<void> parse_int_expr(parsing::NodeSpan args){
+    lexing::LexToken int_tok = args.token(0);
+    return std::make_shared<lang::Int>(int_tok.value);
 }
 
 // expr : STRING
 // with the quotes trimmed off
-std::shared_ptr<void> parse_string_expr(std::vector<std::shared_ptr<void>>& args){
-    auto str = std::static_pointer_cast<lexing::LexToken>(args[0]);
-    return std::make_shared<lang::String>(str->value);
+std::shared_ptr<void> parse_string_expr(parsing::NodeSpan args){
+    lexing::LexToken str = args.token(0);
+    return std::make_shared<lang::String>(str.value);
 }
 
-//std::shared_ptr<void> parse_module_stmt_list_1(std::vector<std::shared_ptr<void>>& args){
+//std::shared_ptr<void> parse_module_stmt_list_1(parsing::NodeSpan args){
 //    std::shared_ptr<std::vector<std::shared_ptr<parsing::Node>>> module_stmt_list;
 //
 //    parsing::Node* module_stmt = std::static_pointer_cast<parsing::Node*>(args[0]);
@@ -498,7 +480,7 @@ std::shared_ptr<void> parse_string_expr(std::vector<std::shared_ptr<void>>& args
 //    return module_stmt_list;
 //}
 //
-//std::shared_ptr<void> parse_module_stmt_list_2(std::vector<std::shared_ptr<void>>& args){
+//std::shared_ptr<void> parse_module_stmt_list_2(parsing::NodeSpan args){
 //    std::shared_ptr<std::vector<std::shared_ptr<parsing::Node>>> module_stmt_list = std::static_pointer_cast<std::vector<parsing::Node*>*>(args[0]);
 //    auto newline = std::static_pointer_cast<lexing::LexToken>(args[1]);
 //    parsing::Node* module_stmt = std::static_pointer_cast<parsing::Node*>(args[2]);
@@ -510,7 +492,7 @@ std::shared_ptr<void> parse_string_expr(std::vector<std::shared_ptr<void>>& args
 //    return module_stmt_list;
 //}
 //
-//std::shared_ptr<void> parse_func_def_module_stmt(std::vector<std::shared_ptr<void>>& args){
+//std::shared_ptr<void> parse_func_def_module_stmt(parsing::NodeSpan args){
 //    return args[0];
 //}
 
@@ -554,14 +536,14 @@ const std::vector<parsing::ParseRule> lang::LANG_RULES = {
     {"func_stmts", {"func_stmt"}, parse_func_stmts},
     {"func_stmts", {"func_stmts", "func_stmt"}, parse_func_stmts2},
     {"func_stmt", {"simple_func_stmt", lang::tokens::NEWLINE}, parse_func_stmt_simple},
-    {"func_stmt", {"compound_func_stmt"}, parse_func_stmt_compound},
+    {"func_stmt", {"compound_func_stmt"}, parsing::pass_through},
 
-    {"simple_func_stmt", {"expr_stmt"}, parse_simple_func_stmt},
-    {"simple_func_stmt", {"return_stmt"}, parse_simple_func_stmt},
-    {"simple_func_stmt", {"var_assign"}, parse_simple_func_stmt},
+    {"simple_func_stmt", {"expr_stmt"}, parsing::pass_through},
+    {"simple_func_stmt", {"return_stmt"}, parsing::pass_through},
+    {"simple_func_stmt", {"var_assign"}, parsing::pass_through},
 
-    {"compound_func_stmt", {"if_stmt"}, parse_compound_func_stmt},
-    {"compound_func_stmt", {"for_loop"}, parse_compound_func_stmt},
+    {"compound_func_stmt", {"if_stmt"}, parsing::pass_through},
+    {"compound_func_stmt", {"for_loop"}, parsing::pass_through},
 
     // Simple statements - one line 
     {"expr_stmt", {"expr"}, parse_expr_stmt},
@@ -577,7 +559,7 @@ const std::vector<parsing::ParseRule> lang::LANG_RULES = {
     //{"expr", {"expr", "ARROW", "expr"}, parse_pointer_member_access},
 
     // Tuple literal 
-    {"expr", {"tuple"}, parse_tuple_expr},
+    {"expr", {"tuple"}, parsing::pass_through},
     {"tuple", {"LBRACE", "RBRACE"}, parse_empty_tuple},
     {"tuple", {"LBRACE", "expr_list", "RBRACE"}, parse_tuple},
 
@@ -635,6 +617,27 @@ const parsing::PrecedenceList lang::LANG_PRECEDENCE = {
 
 /**************** Grammar ***************/ 
 
-const parsing::Grammar lang::LANG_GRAMMAR(parsing::keys(lang::LANG_TOKENS),
+/**
+ * The grammar is only cached when LANG_GRAMMAR_CACHE names a file, so only the first run 
+ * after the rules change builds the parse table. Rules that just pass their one node through
+ * are left out of the table.
+ */
+static std::string grammar_cache_file(){
+    const char* cache_file = std::getenv("LANG_GRAMMAR_CACHE");
+    return cache_file ? cache_file : "";
+}
+
+/**
+ * Built the first time it is asked for rather than before main, since everything that links 
+ * lang but only parses with LANG_PARSE_TABLE, like the compiler, never needs it.
+ */
+const parsing::Grammar& lang::lang_grammar(){
+    static const parsing::Grammar grammar(grammar_cache_file(),
+                                          parsing::keys(lang::LANG_TOKENS),
                                           lang::LANG_RULES,
-                                          lang::LANG_PRECEDENCE);
+                                          lang::LANG_PRECEDENCE,
+                                          parsing::SLR_TABLE,
+                                          1,
+                                          parsing::ELIMINATE_UNIT_RULES);
+    return grammar;
+}
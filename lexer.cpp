@@ -1,5 +1,9 @@
 #include "lexer.h"
 
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
 /********** LexToken *********/
 
 /**
@@ -40,7 +44,6 @@ lexing::TokensMapRegex lexing::to_regex_map(const TokensMap& token_map){
  * Advance the position, and column number or line number depending on the character.
  */
 void lexing::Lexer::advance_pos(char c){
-    pos_++;
     if (c == '\n'){
         lineno_++;
         colno_ = 1;
@@ -51,64 +54,162 @@ void lexing::Lexer::advance_pos(char c){
 }
 
 /**
- * Advance the position and trim the start of the saved code.
+ * Advance the position and move the cursor past the next len characters of the saved code.
  */
-void lexing::Lexer::advance_stream_and_pos(const std::string& s){
+void lexing::Lexer::advance_stream_and_pos(std::size_t len){
+    if (tracking_ == TRACK_OFFSETS){
+        cursor_ += len;
+        return;
+    }
+
     // Advance the position
-    for (const char c : s){
-        advance_pos(c);
+    for (std::size_t i = cursor_; i < cursor_ + len; ++i){
+        advance_pos(at(i));
+    }
+
+    cursor_ += len;
+}
+
+/**
+ * The character at an offset into the source followed by the tail.
+ */
+char lexing::Lexer::at(std::size_t i) const {
+    if (windowed_ && i >= window_offset_ && i - window_offset_ < window_.size()){
+        return window_[i - window_offset_];
     }
+    std::size_t source_size = source_->size();
+    return i < source_size ? source_->at(i) : tail_[i - source_size];
+}
 
-    // Remove this part of string
-    lexcode_.erase(0, s.size());
+/**
+ * The character at the cursor, or the null character at the end of the stream.
+ */
+char lexing::Lexer::peek() const {
+    return empty() ? '\0' : at(cursor_);
 }
 
 /**
- * Same as advance_stream_and_pos but for a single character.
+ * The size of the source and tail, or up to the end of the window while relexing.
  */
-void lexing::Lexer::advance_stream_and_pos(char c){
-    advance_pos(c);
-    lexcode_.erase(0, 1);
+std::size_t lexing::Lexer::size() const {
+    if (windowed_){
+        return window_offset_ + window_.size();
+    }
+    return source_->size() + tail_.size();
+}
+
+/**
+ * The rest of the code from the cursor as two ranges: the rest of the source followed by
+ * the tail.
+ */
+void lexing::Lexer::remaining(const char*& begin, const char*& end, 
+                              const char*& tail, const char*& tail_end) const {
+    if (windowed_){
+        begin = window_.data() + (cursor_ - window_offset_);
+        end = tail = tail_end = window_.data() + window_.size();
+        return;
+    }
+
+    std::size_t source_size = source_->size();
+    if (cursor_ < source_size){
+        begin = source_->data() + cursor_;
+        end = source_->data() + source_size;
+        tail = tail_.data();
+    }
+    else {
+        begin = end = tail = tail_.data() + (cursor_ - source_size);
+    }
+    tail_end = tail_.data() + tail_.size();
+}
+
+/**
+ * Move the cursor past any whitespace.
+ */
+void lexing::Lexer::skip_space(){
+    const char *begin, *end, *tail, *tail_end;
+    remaining(begin, end, tail, tail_end);
+
+    const char* space_end = scan::skip_space(begin, end);
+    if (space_end == end){
+        space_end = scan::skip_space(tail, tail_end);
+        advance_stream_and_pos((end - begin) + (space_end - tail));
+    }
+    else {
+        advance_stream_and_pos(space_end - begin);
+    }
 }
 
 /** 
- * Search the tokens map for a regex that matches the start of the stream.
+ * Find the next token at the cursor using whichever engine this lexer was created with.
  *
  * @param next_token The token that will contain the matched value for the regex found.
  *
- * @return true if any of the regexs provided match the start of the lexcode_.
+ * @return true if any of the regexs provided match the code at the cursor.
  */
-bool lexing::Lexer::find_match(LexToken& next_token){
-    next_token.pos = pos_;
-    next_token.lineno = lineno_;
-    next_token.colno = colno_;
+bool lexing::Lexer::find_match(Token& next_token){
+    next_token.offset = static_cast<std::uint32_t>(cursor_);
+    next_token.length = 0;
+    if (tracking_ == TRACK_LINES){
+        next_token.lineno = lineno_;
+        next_token.colno = colno_;
+    }
+    else {
+        next_token.lineno = next_token.colno = 0;
+    }
 
     // Nothing else
     if (empty()){
-        next_token.symbol = tokens::END;
-        next_token.value = "";
+        next_token.symbol = end_symbol_;
         return true;
     }
 
-    std::smatch matches;
-    for (auto it = tokens_.begin(); it != tokens_.end(); ++it){
+    if (engine_ == REGEX_ENGINE){
+        return find_regex_match(next_token);
+    }
+    return find_dfa_match(next_token);
+}
+
+/** 
+ * Search the tokens map for a regex that matches the start of the stream.
+ */
+bool lexing::Lexer::find_regex_match(Token& next_token){
+    // std::regex needs one contiguous range, so join the tail onto the source only for this engine
+    const char* start;
+    const char* end;
+    if (windowed_){
+        start = window_.data() + (cursor_ - window_offset_);
+        end = window_.data() + window_.size();
+    }
+    else if (tail_.empty()){
+        start = source_->data() + cursor_;
+        end = source_->data() + source_->size();
+    }
+    else {
+        if (regex_code_.size() != size()){
+            regex_code_ = source_->str() + tail_;
+        }
+        start = regex_code_.data() + cursor_;
+        end = regex_code_.data() + regex_code_.size();
+    }
+
+    std::cmatch matches;
+    for (auto it = tables_->tokens.begin(); it != tables_->tokens.end(); ++it){
         const std::string& symbol = it->first;
         const std::regex& re = it->second.first;
         const TokenCallback& callback = it->second.second;
 
-        if (std::regex_search(lexcode_, matches, re, std::regex_constants::match_continuous)){
+        if (std::regex_search(start, end, matches, re, std::regex_constants::match_continuous)){
             // Found 
-            const std::string& match = matches[0];
-            next_token.symbol = symbol;
-            next_token.value = match;
+            next_token.symbol = symbol_ids_.at(symbol);
+            next_token.length = static_cast<std::uint32_t>(matches.length(0));
 
             // Found, so advance the stream 
             // Count newlines that may be in the match'd string
-            advance_stream_and_pos(match);
+            advance_stream_and_pos(next_token.length);
 
             // Then run the callback after processing
             if (callback){
-                callback(next_token);
+                run_callback(callback, next_token);
             }
 
             return true;
@@ -117,44 +218,345 @@ bool lexing::Lexer::find_match(LexToken& next_token){
     return false;
 }
 
+/**
+ * Run the start of the stream through the combined DFA (or the scanner generated from it) 
+ * for the longest matching token.
+ */
+bool lexing::Lexer::find_dfa_match(Token& next_token){
+    const char *begin, *end, *tail, *tail_end;
+    remaining(begin, end, tail, tail_end);
+
+    std::size_t length;
+    int found = scanner_ ? scanner_->match(begin, end, length, tail, tail_end) : 
+                           tables_->dfa.match(begin, end, length, tail, tail_end);
+    if (found < 0){
+        return false;
+    }
+
+    next_token.symbol = tables_->dfa_symbols[found];
+    next_token.length = static_cast<std::uint32_t>(length);
+
+    advance_stream_and_pos(length);
+
+    TokenCallback callback = tables_->dfa_callbacks[found];
+    if (callback){
+        run_callback(callback, next_token);
+    }
+
+    return true;
+}
+
+/**
+ * Callbacks work on LexTokens, so one is filled in for the callback and any changes it makes 
+ * are copied back to the compact token. The same LexToken is reused for every callback so 
+ * its strings do not need to be reallocated.
+ *
+ * A changed value is stored separately, keyed by the token's offset. The token keeps the 
+ * span of the whole match, so its position is where the match starts.
+ */
+void lexing::Lexer::run_callback(TokenCallback callback, Token& token){
+    std::string& original = callback_value_;
+    original.resize(token.length);
+    for (std::size_t i = 0; i < token.length; ++i){
+        original[i] = at(token.offset + i);
+    }
+
+    LexToken& lex_tok = callback_token_;
+    lex_tok.symbol = symbols_[token.symbol];
+    lex_tok.value = original;
+    lex_tok.pos = token.offset + 1;
+    if (token.lineno){
+        lex_tok.lineno = token.lineno;
+        lex_tok.colno = token.colno;
+    }
+    else {
+        position(token.offset, lex_tok.lineno, lex_tok.colno);
+    }
+
+    callback(lex_tok);
+
+    // Keep the position of the whole match even if the value is narrowed below
+    token.lineno = lex_tok.lineno;
+    token.colno = lex_tok.colno;
+
+    if (lex_tok.symbol != symbols_[token.symbol]){
+        token.symbol = add_symbol(lex_tok.symbol);
+    }
+
+    if (lex_tok.value != original){
+        set_callback_value(token.offset, lex_tok.value);
+    }
+}
+
+/**
+ * The lexer usually moves forward, so values are almost always added at the end.
+ */
+void lexing::Lexer::set_callback_value(std::uint32_t offset, const std::string& value){
+    if (callback_values_.empty() || callback_values_.back().first < offset){
+        callback_values_.emplace_back(offset, value);
+        return;
+    }
+    auto found = std::lower_bound(callback_values_.begin(), callback_values_.end(), offset, 
+        [](const std::pair<std::uint32_t, std::string>& entry, std::uint32_t offset){ return entry.first < offset; });
+    if (found->first == offset){
+        found->second = value;
+    }
+    else {
+        callback_values_.emplace(found, offset, value);
+    }
+}
+
+/**
+ * The value a callback set for the token at an offset, or nullptr if it kept its value.
+ */
+static const std::string* find_callback_value(const lexing::CallbackValues& values, std::uint32_t offset){
+    auto found = std::lower_bound(values.begin(), values.end(), offset, 
+        [](const std::pair<std::uint32_t, std::string>& entry, std::uint32_t offset){ return entry.first < offset; });
+    return found != values.end() && found->first == offset ? &found->second : nullptr;
+}
+
+/**
+ * Add the start of every line before the offset to the line index.
+ */
+void lexing::Lexer::index_lines(std::size_t offset) const {
+    // The window starts at the line the lexer was seeked to, which is where the index starts
+    const char* source = windowed_ ? window_.data() : source_->data();
+    std::size_t source_begin = windowed_ ? window_offset_ : 0;
+    std::size_t source_size = windowed_ ? window_offset_ + window_.size() : source_->size();
+    std::size_t i = line_index_end_;
+    assert(i >= source_begin);
+
+    // A line starts after every newline, so the newlines up to, but not including, the 
+    // offset are needed
+    while (i < offset && i < source_size){
+        std::size_t end = std::min(offset, source_size);
+        const char* found = static_cast<const char*>(std::memchr(source + (i - source_begin), '\n', end - i));
+        if (!found){
+            i = end;
+            break;
+        }
+        i = found - source + source_begin + 1;
+        line_starts_.push_back(static_cast<std::uint32_t>(i));
+    }
+    for (; i < offset; ++i){
+        if (tail_[i - source_size] == '\n'){
+            line_starts_.push_back(static_cast<std::uint32_t>(i + 1));
+        }
+    }
+
+    line_index_end_ = std::max(line_index_end_, offset);
+}
+
+/**
+ * Find the line and column of an offset into the code from the line index. Lookups usually 
+ * move forward through the code, so the line found last and the one after it are checked before searching.
+ */
+void lexing::Lexer::position(std::size_t offset, int& lineno, int& colno) const {
+    if (offset > line_index_end_){
+        index_lines(offset);
+    }
+
+    auto on_line = [this, offset](std::size_t line){
+        return line < line_starts_.size() && line_starts_[line] <= offset && 
+               (line + 1 == line_starts_.size() || offset < line_starts_[line + 1]);
+    };
+
+    std::size_t line = last_line_;
+    if (!on_line(line)){
+        if (on_line(line + 1)){
+            ++line;
+        }
+        else {
+            line = std::upper_bound(line_starts_.begin(), line_starts_.end(), offset) - line_starts_.begin() - 1;
+        }
+        last_line_ = line;
+    }
+
+    lineno = line_base_ + static_cast<int>(line) + 1;
+    colno = static_cast<int>(offset - line_starts_[line]) + 1 + (line ? 0 : col_base_);
+}
+
+/**
+ * Get the ID for a symbol, adding it if it does not exist yet.
+ */
+int lexing::Lexer::add_symbol(const std::string& symbol){
+    auto found = symbol_ids_.find(symbol);
+    if (found != symbol_ids_.end()){
+        return found->second;
+    }
+
+    int id = static_cast<int>(symbols_.size());
+    symbols_.push_back(symbol);
+    symbol_ids_[symbol] = id;
+    return id;
+}
+
 /**
  * Constructors
  */ 
-lexing::Lexer::Lexer(const TokensMap& tokens): tokens_map_(tokens), tokens_(to_regex_map(tokens)){}
+lexing::Lexer::Lexer(const TokensMap& tokens, LexerEngine engine, PositionTracking tracking): 
+    source_(std::make_shared<SourceBuffer>()),
+    engine_(engine),
+    tracking_(tracking),
+    scanner_(nullptr)
+{
+    if (engine == GENERATED_ENGINE){
+        throw std::runtime_error("A lexer using a generated engine must be given the scanner.");
+    }
+
+    std::shared_ptr<Tables> tables = std::make_shared<Tables>();
+    tables->tokens_map = tokens;
+    if (engine == REGEX_ENGINE){
+        tables->tokens = to_regex_map(tokens);
+    }
+    else {
+        tables->dfa = TokensDFA(tokens);
+    }
+    tables_ = tables;
+
+    init_symbols();
+    for (std::size_t i = 0; i < tables->dfa.num_tokens(); ++i){
+        tables->dfa_symbols.push_back(symbol_ids_.at(tables->dfa.symbol(i)));
+        tables->dfa_callbacks.push_back(tables->dfa.callback(i));
+    }
+}
+
+lexing::Lexer::Lexer(const TokensMap& tokens, const Scanner& scanner, PositionTracking tracking): 
+    source_(std::make_shared<SourceBuffer>()),
+    engine_(GENERATED_ENGINE),
+    tracking_(tracking),
+    scanner_(&scanner)
+{
+    std::shared_ptr<Tables> tables = std::make_shared<Tables>();
+    tables->tokens_map = tokens;
+    tables_ = tables;
+
+    init_symbols();
+    for (std::size_t i = 0; i < scanner.num_tokens; ++i){
+        auto token = tokens.find(scanner.symbols[i]);
+        if (token == tokens.end()){
+            throw std::runtime_error("Symbol '" + std::string(scanner.symbols[i]) + 
+                                     "' in the scanner is not in the tokens map. The scanner may need to be regenerated.");
+        }
+        tables->dfa_symbols.push_back(symbol_ids_.at(token->first));
+
+        // The keyword lookup was generated into the scanner in place of this callback
+        tables->dfa_callbacks.push_back(static_cast<int>(i) == scanner.keyword_token ? nullptr : token->second.second);
+    }
+}
+
+/**
+ * Only the tables are shared. Everything else the other lexer has found about its code, 
+ * like callback values and the line index, is left behind.
+ */
+lexing::Lexer::Lexer(const Lexer& other, std::size_t offset, int lineno, int colno):
+    source_(other.source_),
+    tail_(other.tail_),
+    engine_(other.engine_),
+    tracking_(other.tracking_),
+    tables_(other.tables_),
+    scanner_(other.scanner_),
+    symbols_(other.symbols_),
+    symbol_ids_(other.symbol_ids_),
+    end_symbol_(other.end_symbol_),
+    comment_symbol_(other.comment_symbol_)
+{
+    seek(offset, lineno, colno);
+}
+
+/**
+ * Symbol IDs are given to the tokens in order of their names so they do not depend on the 
+ * order of the tokens map.
+ */
+void lexing::Lexer::init_symbols(){
+    std::vector<std::string> names;
+    for (auto it = tables_->tokens_map.begin(); it != tables_->tokens_map.end(); ++it){
+        names.push_back(it->first);
+    }
+    std::sort(names.begin(), names.end());
+    for (const std::string& name : names){
+        add_symbol(name);
+    }
+    end_symbol_ = add_symbol(tokens::END);
+    comment_symbol_ = add_symbol(tokens::COMMENT);
+}
 
 /**
  * Feed a string into the code stream.
  */
 void lexing::Lexer::input(const std::string& code){
-    lexcode_ += code;
+    input(std::make_shared<SourceBuffer>(code));
+}
+
+/**
+ * Feed a source into the code stream. A source given once everything before it was lexed 
+ * replaces the old code without copying it, and positions carry on from where the old 
+ * code ended. Otherwise it is joined onto what was already given, including the tail.
+ */
+void lexing::Lexer::input(const std::shared_ptr<const SourceBuffer>& source){
+    if (cursor_ >= size()){
+        int lineno = lineno_, colno = colno_;
+        if (tracking_ != TRACK_LINES){
+            position(size(), lineno, colno);
+        }
+
+        source_ = source;
+        tail_.clear();
+        regex_code_.clear();
+        callback_values_.clear();
+        cursor_ = 0;
+
+        // The line index starts over at the end of the old code
+        line_starts_.assign(1, 0);
+        line_index_end_ = 0;
+        line_base_ = lineno - 1;
+        col_base_ = colno - 1;
+        last_line_ = 0;
+        return;
+    }
+
+    if (size() + source->size() > UINT32_MAX){
+        throw std::runtime_error("Lexer input cannot be larger than 4GB.");
+    }
+
+    std::string code;
+    code.reserve(size() + source->size());
+    code.append(source_->data(), source_->size());
+    code += tail_;
+    code.append(source->data(), source->size());
+    source_ = std::make_shared<SourceBuffer>(std::move(code));
+    tail_.clear();
+}
+
+/**
+ * Lex the given string as though it came after all of the input, without copying the input.
+ */
+void lexing::Lexer::input_tail(const std::string& tail){
+    if (size() + tail.size() > UINT32_MAX){
+        throw std::runtime_error("Lexer input cannot be larger than 4GB.");
+    }
+    tail_ += tail;
 }
 
 /**
  * Return the next token and advance the stream.
  */ 
-lexing::LexToken lexing::Lexer::token(){
-    LexToken next_token;
+lexing::Token lexing::Lexer::next_token(){
+    Token next_token;
 
     do {
         bool found = find_match(next_token);
 
         while (!found){
             // No matches
-            if (isspace(lexcode_.front())){
+            if (isspace(peek())){
                 // Check if whitespace that was not caught as a token 
-                // Trim whitespace, advance position, then try to load again 
-                char c = lexcode_.front();
-                while (isspace(c)){
-                    advance_stream_and_pos(c);
-                    c = lexcode_.front();
-                }
+                // Skip whitespace, advance position, then try to load again 
+                skip_space();
             }
             else {
                 // None of the regex's matched
                 throw LexError(*this);
-                std::ostringstream err;
-                err << "Unexpected character '" << lexcode_.front() << "' did not match the start of any tokens.";
-                throw std::runtime_error(err.str());
             }
 
             // Try again
@@ -162,34 +564,482 @@ lexing::LexToken lexing::Lexer::token(){
         }
 
     // Ignore comments
-    } while (next_token.symbol == lexing::tokens::COMMENT);
+    } while (next_token.symbol == comment_symbol_);
 
     return next_token;
 }
 
+/**
+ * Same as next_token, but with the symbol and value copied into the token.
+ */
+lexing::LexToken lexing::Lexer::token(){
+    return lex_token(next_token());
+}
+
+/**
+ * Lex everything left in one go.
+ */
+lexing::TokenStream lexing::Lexer::tokenize(){
+    TokenStream stream = start_stream();
+    Token tok;
+    do {
+        tok = next_token();
+        push_token(stream, tok);
+    } while (tok.symbol != end_symbol_);
+    finish_stream(stream);
+    return stream;
+}
+
+/**
+ * The stream shares the source with the lexer. Only the tail, which is usually small, is copied.
+ */
+lexing::TokenStream lexing::Lexer::start_stream() const {
+    TokenStream stream;
+    stream.source = source_;
+    stream.tail = tail_;
+
+    // Guess about one token for every 4 bytes of code
+    std::size_t expected = (size() - cursor_) / 4 + 1;
+    stream.symbols.reserve(expected);
+    stream.offsets.reserve(expected);
+    stream.lengths.reserve(expected);
+    stream.lines.reserve(expected);
+    stream.columns.reserve(expected);
+    return stream;
+}
+
+void lexing::Lexer::push_token(TokenStream& stream, const Token& token) const {
+    int lineno = token.lineno, colno = token.colno;
+    if (!lineno){
+        position(token.offset, lineno, colno);
+    }
+    stream.symbols.push_back(token.symbol);
+    stream.offsets.push_back(token.offset);
+    stream.lengths.push_back(token.length);
+    stream.lines.push_back(lineno);
+    stream.columns.push_back(colno);
+}
+
+void lexing::Lexer::finish_stream(TokenStream& stream) const {
+    stream.callback_values = callback_values_;
+}
+
+/**
+ * The line index restarts from the line the offset is on, so seeking does not need to look 
+ * at any of the code before it.
+ */
+void lexing::Lexer::seek(std::size_t offset, int lineno, int colno){
+    assert(offset <= size() && colno >= 1 && static_cast<std::size_t>(colno - 1) <= offset);
+    cursor_ = offset;
+    lineno_ = lineno;
+    colno_ = colno;
+
+    line_starts_.assign(1, static_cast<std::uint32_t>(offset - (colno - 1)));
+    line_base_ = lineno - 1;
+    col_base_ = 0;
+    line_index_end_ = offset;
+    last_line_ = 0;
+}
+
+/**
+ * Replace the tokens from begin to end with some other tokens.
+ */
+template <typename T>
+static void replace_range(std::vector<T>& values, std::size_t begin, std::size_t end, const std::vector<T>& with){
+    std::size_t common = std::min(end - begin, with.size());
+    std::copy(with.begin(), with.begin() + common, values.begin() + begin);
+    if (with.size() > common){
+        values.insert(values.begin() + end, with.begin() + common, with.end());
+    }
+    else {
+        values.erase(values.begin() + begin + common, values.begin() + end);
+    }
+}
+
+/**
+ * Bytes past the end of an edit that are copied into the window at first. Most edits line up 
+ * with the old tokens again within a line or two.
+ */
+static const std::size_t RELEX_MARGIN = 4096;
+
+/**
+ * Lex the edited code starting from the line of the last token before the edit that is the 
+ * first on its line. The tokens before it ended on an earlier line, so lexing from there finds 
+ * the same tokens the old code had up to the edit.
+ *
+ * The edited code is made of pieces of the old code and the inserted text, and the tokens 
+ * are lexed from a window copied out of it around the edit. 
+ *
+ * The stream is not changed until finish_relex(), so it still matches the old code if 
+ * lexing the new code throws.
+ */
+lexing::Lexer::Splice lexing::Lexer::start_relex(const TokenStream& stream, const Edit& edit){
+    const std::size_t source_size = stream.source->size();
+    const std::size_t code_size = source_size + stream.tail.size();
+    if (edit.offset + edit.removed > code_size){
+        throw std::runtime_error("Edit is past the end of the code.");
+    }
+    if (code_size - edit.removed + edit.inserted.size() > UINT32_MAX){
+        throw std::runtime_error("Lexer input cannot be larger than 4GB.");
+    }
+
+    auto old_code = [&](std::size_t i){
+        return i < source_size ? stream.source->at(i) : stream.tail[i - source_size];
+    };
+
+    Splice splice;
+    splice.offset = edit.offset;
+    splice.old_end = edit.offset + edit.removed;
+    splice.new_end = edit.offset + edit.inserted.size();
+    splice.shift = static_cast<std::int64_t>(edit.inserted.size()) - static_cast<std::int64_t>(edit.removed);
+    splice.line_shift = static_cast<int>(std::count(edit.inserted.begin(), edit.inserted.end(), '\n'));
+    for (std::size_t i = edit.offset; i < splice.old_end; ++i){
+        splice.line_shift -= old_code(i) == '\n';
+    }
+
+    source_ = SourceBuffer::edited(stream.source, stream.tail, edit);
+    tail_.clear();
+
+    // Tokens are in order of their offsets, apart from ones a subclass adds that are not 
+    // in the code, so this only needs to be close.
+    std::size_t before_edit = std::partition_point(stream.offsets.begin(), stream.offsets.end(), 
+        [&edit](std::uint32_t offset){ return offset < edit.offset; }) - stream.offsets.begin();
+    bool found = false;
+    splice.restart = 0;
+    for (std::size_t i = std::min(before_edit + 1, stream.size()); i-- > 0; ){
+        // Tokens that are not in the code, like the END token, are empty
+        if (stream.offsets[i] < edit.offset && stream.lengths[i] && starts_line(stream, i)){
+            splice.restart = i;
+            found = true;
+            break;
+        }
+    }
+    splice.resync = splice.restart;
+
+    // The token may not be the first thing on its line, like after a line of whitespace
+    std::size_t restart_offset = found ? stream.offsets[splice.restart] : 0;
+    while (restart_offset > 0 && old_code(restart_offset - 1) != '\n'){
+        --restart_offset;
+    }
+    splice.restart_offset = restart_offset;
+    splice.restart_line = found ? stream.lines[splice.restart] : 1;
+
+    // Only the values for the relexed tokens are kept here until the stream is updated
+    callback_values_.clear();
+    fill_window(restart_offset, splice.new_end + RELEX_MARGIN);
+    seek(restart_offset, splice.restart_line, 1);
+    return splice;
+}
+
+/**
+ * Copy the edited code in [begin, end) into the window. A window reaching the end of the 
+ * code is not needed, and the source is lexed directly instead.
+ */
+void lexing::Lexer::fill_window(std::size_t begin, std::size_t end){
+    if (end >= source_->size()){
+        windowed_ = false;
+        window_.clear();
+        return;
+    }
+    windowed_ = true;
+    window_offset_ = begin;
+    window_.resize(end - begin);
+    source_->copy(begin, end - begin, &window_[0]);
+}
+
+/**
+ * The window is doubled each time, so an edit that changes the tokens up to the end of the 
+ * code is lexed at most a few times over.
+ */
+bool lexing::Lexer::widen_relex(Splice& splice){
+    if (!windowed_){
+        return false;
+    }
+    std::size_t window_end = window_offset_ + window_.size();
+    fill_window(splice.restart_offset, window_end + (window_end - splice.restart_offset));
+    callback_values_.clear();
+    splice.resync = splice.restart;
+    seek(splice.restart_offset, splice.restart_line, 1);
+    return true;
+}
+
+/**
+ * A token in column 1 is the first on its line.
+ */
+bool lexing::Lexer::starts_line(const TokenStream& stream, std::size_t i) const {
+    return stream.columns[i] == 1;
+}
+
+/**
+ * Check if a token lexed from the edited code is the same as one after the edit in the old 
+ * code. Lexing from there on finds the same tokens as before, just shifted, so the rest of 
+ * the old stream can be kept. Tokens have to start after the edit so none of their text 
+ * could have changed.
+ */
+bool lexing::Lexer::resyncs(const TokenStream& stream, Splice& splice, const Token& tok) const {
+    if (tok.offset <= splice.new_end){
+        return false;
+    }
+
+    // The end of the window may have cut the token short
+    if (windowed_ && tok.offset + tok.length >= window_offset_ + window_.size()){
+        return false;
+    }
+
+    std::uint32_t old_offset = static_cast<std::uint32_t>(tok.offset - splice.shift);
+    std::size_t& i = splice.resync;
+    while (i < stream.size() && stream.offsets[i] < old_offset){
+        ++i;
+    }
+    if (i == stream.size() || stream.offsets[i] != old_offset || stream.symbols[i] != tok.symbol || 
+            stream.lengths[i] != tok.length){
+        return false;
+    }
+    return stream.columns[i] == (tok.colno ? tok.colno : colno(tok));
+}
+
+/**
+ * Swap the relexed tokens in for the old ones and shift the tokens kept after them.
+ */
+void lexing::Lexer::finish_relex(TokenStream& stream, const Splice& splice, const TokenStream& relexed, bool resynced){
+    const std::size_t kept = resynced ? splice.resync : stream.size();
+
+    // The values for the relexed tokens go between the ones before the restart and the kept ones
+    CallbackValues& values = stream.callback_values;
+    auto values_from = [&values](std::size_t offset){
+        return std::lower_bound(values.begin(), values.end(), offset, 
+            [](const std::pair<std::uint32_t, std::string>& entry, std::size_t offset){ return entry.first < offset; }) - values.begin();
+    };
+    const std::size_t values_begin = values_from(splice.restart_offset);
+    const std::size_t values_end = resynced ? values_from(stream.offsets[kept]) : values.size();
+    if (resynced){
+        // The token the tokens lined up on was lexed again, but its value is kept with the others
+        const std::uint32_t new_kept_offset = static_cast<std::uint32_t>(stream.offsets[kept] + splice.shift);
+        while (!callback_values_.empty() && callback_values_.back().first >= new_kept_offset){
+            callback_values_.pop_back();
+        }
+    }
+    for (std::size_t i = values_end; i < values.size(); ++i){
+        values[i].first += static_cast<std::uint32_t>(splice.shift);
+    }
+    replace_range(values, values_begin, values_end, callback_values_);
+
+    if (stream.depths.size() == stream.size() && relexed.depths.size() == relexed.size()){
+        replace_range(stream.depths, splice.restart, kept, relexed.depths);
+    }
+    else {
+        stream.depths.clear();
+    }
+
+    // Kept apart so each loop is a simple add over one array
+    const std::size_t num_tokens = stream.size();
+    const std::uint32_t shift = static_cast<std::uint32_t>(splice.shift);
+    if (shift){
+        std::uint32_t* offsets = stream.offsets.data();
+        for (std::size_t i = kept; i < num_tokens; ++i){
+            offsets[i] += shift;
+        }
+    }
+    if (splice.line_shift){
+        int* lines = stream.lines.data();
+        for (std::size_t i = kept; i < num_tokens; ++i){
+            lines[i] += splice.line_shift;
+        }
+    }
+    replace_range(stream.symbols, splice.restart, kept, relexed.symbols);
+    replace_range(stream.offsets, splice.restart, kept, relexed.offsets);
+    replace_range(stream.lengths, splice.restart, kept, relexed.lengths);
+    replace_range(stream.lines, splice.restart, kept, relexed.lines);
+    replace_range(stream.columns, splice.restart, kept, relexed.columns);
+
+    stream.source = source_;
+    stream.tail.clear();
+    callback_values_ = stream.callback_values;
+
+    windowed_ = false;
+    window_.clear();
+    if (resynced){
+        // The kept tokens run to the end of the code
+        seek(size(), stream.lines.back(), stream.columns.back());
+    }
+}
+
+/**
+ * Lex again from the last line before the edit until the tokens line up with the old ones.
+ */
+void lexing::Lexer::relex(TokenStream& stream, const Edit& edit){
+    Splice splice = start_relex(stream, edit);
+
+    TokenStream relexed;
+    bool resynced = false;
+    while (1){
+        relexed = TokenStream();
+        try {
+            Token tok = next_token();
+            while (!(resynced = resyncs(stream, splice, tok))){
+                push_token(relexed, tok);
+                if (tok.symbol == end_symbol_){
+                    break;
+                }
+                tok = next_token();
+            }
+        }
+        catch (...){
+            // Anything thrown in the window may be from a token cut short by its end
+            if (!widen_relex(splice)){
+                throw;
+            }
+            continue;
+        }
+        if (resynced || !widen_relex(splice)){
+            break;
+        }
+    }
+    finish_relex(stream, splice, relexed, resynced);
+}
+
 /**
  * Checks if the stream has reached the end.
  */
 bool lexing::Lexer::empty() const {
-    return lexcode_.empty();
+    return cursor_ >= size();
+}
+
+/**
+ * Convert a compact token found by this lexer to a LexToken.
+ */
+lexing::LexToken lexing::Lexer::lex_token(const Token& token) const {
+    return {symbols_[token.symbol], value(token), static_cast<int>(token.offset) + 1, lineno(token), colno(token)};
+}
+
+/**
+ * The value of a compact token found by this lexer.
+ */
+std::string lexing::Lexer::value(const Token& token) const {
+    if (const std::string* found = find_callback_value(callback_values_, token.offset)){
+        return *found;
+    }
+
+    std::string value(token.length, '\0');
+    for (std::size_t i = 0; i < token.length; ++i){
+        value[i] = at(token.offset + i);
+    }
+    return value;
+}
+
+const std::string* lexing::Lexer::callback_value(std::uint32_t offset) const {
+    return find_callback_value(callback_values_, offset);
+}
+
+const std::string& lexing::Lexer::symbol_name(int symbol) const {
+    return symbols_[symbol];
+}
+
+int lexing::Lexer::symbol_id(const std::string& symbol) const {
+    auto found = symbol_ids_.find(symbol);
+    return found == symbol_ids_.end() ? -1 : found->second;
+}
+
+std::size_t lexing::Lexer::num_symbols() const { return symbols_.size(); }
+int lexing::Lexer::end_symbol() const { return end_symbol_; }
+
+int lexing::Lexer::lineno(const Token& token) const {
+    if (token.lineno){
+        return token.lineno;
+    }
+    int lineno, colno;
+    position(token.offset, lineno, colno);
+    return lineno;
+}
+
+int lexing::Lexer::colno(const Token& token) const {
+    if (token.lineno){
+        return token.colno;
+    }
+    int lineno, colno;
+    position(token.offset, lineno, colno);
+    return colno;
 }
 
 /**
  * Getters
  */ 
-int lexing::Lexer::pos() const { return pos_; }
-int lexing::Lexer::lineno() const { return lineno_; }
-int lexing::Lexer::colno() const { return colno_; }
-const lexing::TokensMap& lexing::Lexer::tokens() const { return tokens_map_; }
-const std::string& lexing::Lexer::lexcode() const { return lexcode_; }
+int lexing::Lexer::pos() const { return static_cast<int>(cursor_) + 1; }
+int lexing::Lexer::lineno() const { 
+    if (tracking_ == TRACK_LINES){
+        return lineno_;
+    }
+    int lineno, colno;
+    position(cursor_, lineno, colno);
+    return lineno;
+}
+int lexing::Lexer::colno() const { 
+    if (tracking_ == TRACK_LINES){
+        return colno_;
+    }
+    int lineno, colno;
+    position(cursor_, lineno, colno);
+    return colno;
+}
+const lexing::TokensMap& lexing::Lexer::tokens() const { return tables_->tokens_map; }
+const std::shared_ptr<const lexing::SourceBuffer>& lexing::Lexer::source() const { return source_; }
+std::string lexing::Lexer::lexcode() const { 
+    const char *begin, *end, *tail, *tail_end;
+    remaining(begin, end, tail, tail_end);
+    return std::string(begin, end) + std::string(tail, tail_end);
+}
+std::string lexing::Lexer::lexcode(std::size_t max) const { 
+    const char *begin, *end, *tail, *tail_end;
+    remaining(begin, end, tail, tail_end);
+    std::size_t in_source = std::min<std::size_t>(max, end - begin);
+    std::size_t in_tail = std::min<std::size_t>(max - in_source, tail_end - tail);
+    return std::string(begin, in_source) + std::string(tail, in_tail);
+}
+std::size_t lexing::Lexer::cursor() const { return cursor_; }
+lexing::LexerEngine lexing::Lexer::engine() const { return engine_; }
+lexing::PositionTracking lexing::Lexer::tracking() const { return tracking_; }
+
+/************* TokenStream ************/
+
+std::size_t lexing::TokenStream::size() const { return symbols.size(); }
+
+lexing::Token lexing::TokenStream::token(std::size_t i) const {
+    return {symbols[i], offsets[i], lengths[i], lines[i], columns[i]};
+}
+
+const std::string* lexing::TokenStream::callback_value(std::uint32_t offset) const {
+    return find_callback_value(callback_values, offset);
+}
+
+std::string lexing::TokenStream::value(const Token& token) const {
+    if (const std::string* found = callback_value(token.offset)){
+        return *found;
+    }
+
+    std::string value(token.length, '\0');
+    std::size_t source_size = source->size();
+    std::size_t in_source = 0;
+    if (token.offset < source_size){
+        in_source = std::min<std::size_t>(token.length, source_size - token.offset);
+        source->copy(token.offset, in_source, &value[0]);
+    }
+    for (std::size_t i = in_source; i < token.length; ++i){
+        value[i] = tail[token.offset + i - source_size];
+    }
+    return value;
+}
 
 /************* LexError ************/ 
 
-lexing::LexError::LexError(const Lexer& lexer): std::runtime_error("Lexer error"), lexer_(lexer){}
+lexing::LexError::LexError(const Lexer& lexer): std::runtime_error(message(lexer)){}
 
-const char* lexing::LexError::what() const throw(){
+/**
+ * The message is created once on construction since the lexer may advance or be destroyed 
+ * before the error is caught.
+ */
+std::string lexing::LexError::message(const Lexer& lexer){
     std::ostringstream err;
-    err << std::runtime_error::what();
-    err << ": Start of string '" << lexer_.lexcode().substr(0, 10) << "' did not match the start of any tokens. Line " << lexer_.lineno() << ", col " << lexer_.colno() << ".";
-    return err.str().c_str();
+    err << "Lexer error";
+    err << ": Start of string '" << lexer.lexcode(10) << "' did not match the start of any tokens. Line " << lexer.lineno() << ", col " << lexer.colno() << ".";
+    return err.str();
 }
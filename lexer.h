@@ -2,9 +2,14 @@
 #define _LEXER_H
 
 #include <unordered_map>
+#include <vector>
+#include <deque>
+#include <cstdint>
 #include <regex>
 #include <stdexcept>
 #include <sstream>
+#include <memory>
+#include <mutex>
 
 namespace lexing {
     // Common token names
@@ -20,6 +25,55 @@ namespace lexing {
         std::string str() const;
     };
 
+    // Compact version of a LexToken that refers to its symbol by an ID and to its value by 
+    // where it is in the code, so finding one does not need to copy any strings. The lexer 
+    // that found the token can convert it back to a LexToken.
+    struct Token {
+        int symbol;
+        std::uint32_t offset;  // Bytes from the start of the code
+        std::uint32_t length;
+        int lineno, colno;
+    };
+
+    class SourceBuffer;
+
+    // Values set by token callbacks that are not part of the code, in order of the offsets 
+    // of their tokens
+    typedef std::vector<std::pair<std::uint32_t, std::string>> CallbackValues;
+
+    // Replaces the removed bytes at an offset in some code with the inserted text.
+    struct Edit {
+        std::size_t offset;
+        std::size_t removed;
+        std::string inserted;
+    };
+
+    /**
+     * Every token lexed from some code, stored as one array per field so the tokens can 
+     * be read in order without chasing pointers. A stream keeps the code its tokens refer 
+     * to, so it can be kept and read again after the lexer moves on to other code.
+     */
+    struct TokenStream {
+        std::vector<int> symbols;
+        std::vector<std::uint32_t> offsets;
+        std::vector<std::uint32_t> lengths;
+        std::vector<int> lines;
+        std::vector<int> columns;
+
+        std::shared_ptr<const SourceBuffer> source;
+        std::string tail;
+        CallbackValues callback_values;
+
+        // Indentation levels open after each token, for lexers that add indentation. Empty 
+        // if the tokens were lexed without them.
+        std::vector<int> depths;
+
+        std::size_t size() const;
+        Token token(std::size_t) const;
+        std::string value(const Token&) const;
+        const std::string* callback_value(std::uint32_t offset) const;  // nullptr if the token kept its value
+    };
+
     // Callback for handling a token found by the lexer.
     typedef void (*TokenCallback)(LexToken& token);
 
@@ -32,42 +86,368 @@ namespace lexing {
     // Simple conversion between the token maps.
     TokensMapRegex to_regex_map(const TokensMap&);
 
+    /**
+     * Read only code to be lexed. The contents either live in a file mapped into memory 
+     * or in a string owned by the buffer, so a source is only ever held once in memory 
+     * no matter how many lexers share it.
+     *
+     * An edited buffer is made of pieces of the buffer it was edited from and the inserted 
+     * text, so an edit does not copy the code around it. The pieces are only joined if 
+     * data() is called.
+     */
+    class SourceBuffer {
+        private:
+            std::string owned_;
+            const char* data_;
+            std::size_t size_;
+
+            // Set if the contents are a memory mapped file
+            void* mapping_ = nullptr;
+            std::size_t mapping_size_ = 0;
+
+            // Set if the contents are pieces of other buffers
+            struct Piece {
+                std::shared_ptr<const void> owner;  // Keeps the data alive
+                const char* data;
+                std::size_t size;
+                std::size_t offset;  // Where the piece starts in this buffer
+            };
+            std::vector<Piece> pieces_;
+            mutable std::string joined_;
+            mutable std::once_flag join_once_;
+
+            std::size_t piece_at(std::size_t) const;
+
+        public:
+            SourceBuffer();
+            SourceBuffer(const std::string&);
+            SourceBuffer(std::string&&);
+            SourceBuffer(const SourceBuffer&) = delete;
+            SourceBuffer& operator=(const SourceBuffer&) = delete;
+            ~SourceBuffer();
+
+            // Map a file into memory, or read it if it cannot be mapped.
+            static std::shared_ptr<const SourceBuffer> from_file(const std::string& filename);
+
+            // The code in a buffer followed by a tail, with an edit made to it.
+            static std::shared_ptr<const SourceBuffer> edited(const std::shared_ptr<const SourceBuffer>& code, 
+                                                              const std::string& tail, const Edit& edit);
+
+            const char* data() const;  // Joins the pieces of an edited buffer
+            char at(std::size_t) const;
+            void copy(std::size_t offset, std::size_t size, char* out) const;
+            std::size_t size() const;
+            bool empty() const;
+            bool mapped() const;
+            std::string str() const;
+    };
+
+    /**
+     * Scans over runs of bytes the lexer would otherwise check one at a time, like whitespace 
+     * and the bodies of comments and strings. These use SSE2 or AVX2 instructions to check 
+     * 16 or 32 bytes at a time, depending on what the CPU supports at runtime.
+     */
+    namespace scan {
+        enum InstructionSet {
+            SCALAR,
+            SSE2,
+            AVX2,
+        };
+
+        InstructionSet best_instruction_set();
+        InstructionSet instruction_set();
+        void set_instruction_set(InstructionSet);  // Not thread safe
+
+        // The first byte in [begin, end) equal to any of up to 3 bytes, or end if there is none.
+        const char* find_any(const char* begin, const char* end, const char* bytes, std::size_t num_bytes);
+
+        // The first byte in [begin, end) that is not c, or end if there is none.
+        const char* find_not(const char* begin, const char* end, char c);
+
+        // The first byte in [begin, end) that is not whitespace, or end if there is none.
+        const char* skip_space(const char* begin, const char* end);
+    }
+
+    // The method the Lexer uses for finding the next token.
+    enum LexerEngine {
+        REGEX_ENGINE,  // Try each std::regex in the tokens map until one matches
+        DFA_ENGINE,    // Run a single automaton compiled from every regex in the tokens map
+        GENERATED_ENGINE,  // Run a Scanner generated as C++ ahead of time
+    };
+
+    // Maps keywords to the symbol of the token they are lexed as.
+    typedef std::unordered_map<std::string, std::string> Keywords;
+
+    /**
+     * A TokensDFA compiled into C++ by generate_scanner(), so nothing needs to be built when 
+     * a lexer using it is created.
+     */
+    struct Scanner {
+        const char* const* symbols;  // Token -> symbol, in the same order as the TokensDFA
+        std::size_t num_tokens;
+        int keyword_token;  // Token that is checked for keywords (-1 if none)
+
+        // Same as TokensDFA::match()
+        int (*match)(const char* begin, const char* end, std::size_t& length,
+                     const char* tail, const char* tail_end);
+    };
+
+    /**
+     * Write the C++ source for a Scanner named ns::name that finds the same tokens as a 
+     * TokensDFA made from the tokens. The automaton is written as a switch on each byte 
+     * with a goto to the next state. 
+     *
+     * Keywords found by the keyword token (like names) are looked up in a perfect hash 
+     * after the match instead of being left to a callback, and tokens whose regex is 
+     * just one of the keywords are left out of the automaton. The keyword token's 
+     * callback is not run by a lexer using the generated scanner.
+     */
+    void generate_scanner(std::ostream& out, const TokensMap& tokens, const std::string& ns, 
+                          const std::string& name, const std::string& keyword_token="", 
+                          const Keywords& keywords={});
+
+    // How the Lexer keeps track of where tokens are in the code.
+    enum PositionTracking {
+        TRACK_LINES,    // Update the line and column for every character consumed
+        TRACK_OFFSETS,  // Only move the cursor and find lines and columns from a line index when asked
+    };
+
+    /**
+     * All of the regexs in a TokensMap compiled into one deterministic finite automaton
+     * that finds the next token in a single pass over the input.
+     *
+     * The regexs are parsed as a subset of the ECMAScript syntax std::regex uses:
+     * literals, escapes, character classes, '.', groups, alternation, and the 
+     * quantifiers '*', '+', '?' and '{m,n}'. A lookahead '(?!...)' or '(?=...)' is 
+     * also accepted at the very end of a regex and is checked once the rest of the 
+     * regex has matched. Anything else (anchors, backreferences, lookbehinds, ...) 
+     * throws a std::runtime_error.
+     *
+     * When more than one token matches, the longest match wins. Ties between matches
+     * of the same length go to the token whose regex is a plain literal string (so 
+     * 'def' is preferred over a regex for names), and then to the token whose name 
+     * comes first alphabetically. Empty matches are never returned.
+     */
+    class TokensDFA {
+        public:
+            // Transition tables for one automaton. Bytes are first mapped to classes of 
+            // bytes that are never distinguished by any regex, so each state only needs 
+            // one transition per class instead of one per byte.
+            struct Automaton {
+                std::vector<unsigned char> byte_classes;  // byte -> class
+                std::size_t num_classes = 0;
+                std::vector<int> transitions;  // state * num_classes + class -> next state (-1 if none)
+                std::vector<std::vector<int>> accepts;  // state -> accepted patterns in order of priority
+            };
+
+            // Lookahead at the end of a token regex
+            struct Lookahead {
+                bool negated;
+                Automaton automaton;
+            };
+
+        private:
+            // Ordered by priority
+            std::vector<std::string> symbols_;
+            std::vector<TokenCallback> callbacks_;
+            std::vector<int> lookaheads_;  // index into lookahead_automata_ for each symbol (-1 if none)
+
+            Automaton automaton_;
+            std::vector<Lookahead> lookahead_automata_;
+
+            // States that loop on themselves for most bytes (like inside a comment) or for only 
+            // one byte (like between spaces) can skip ahead with a scan instead of stepping 
+            // through the transitions one byte at a time.
+            struct Skip {
+                enum Kind {NONE, UNTIL_ANY, WHILE_BYTE} kind = NONE;
+                char bytes[3];  // Bytes leaving the state for UNTIL_ANY, or the looping byte for WHILE_BYTE
+                std::size_t num_bytes = 0;
+            };
+            std::vector<Skip> skips_;  // state -> skip
+
+            void find_skips();
+
+            friend void generate_scanner(std::ostream&, const TokensMap&, const std::string&, 
+                                         const std::string&, const std::string&, const Keywords&);
+
+            bool lookahead_matches(const Lookahead&, const char*, const char*, const char*, const char*) const;
+
+        public:
+            TokensDFA(){}
+            TokensDFA(const TokensMap&);
+
+            // Find the longest token matching the start of [begin, end) followed by [tail, tail_end).
+            // Returns the index of the token, or -1 if none matched, and sets the length of the match.
+            int match(const char* begin, const char* end, std::size_t& length,
+                      const char* tail=nullptr, const char* tail_end=nullptr) const;
+
+            // Getters
+            const std::string& symbol(int) const;
+            TokenCallback callback(int) const;
+            std::size_t num_tokens() const;
+            std::size_t num_states() const;
+    };
+
     class Lexer {
         private:
-            std::string lexcode_;
-            int pos_ = 1, lineno_ = 1, colno_ = 1;
-            const TokensMap tokens_map_;
-            const TokensMapRegex tokens_;
+            // The input is never modified while lexing. Tokens are read from the cursor onwards.
+            // The tail is a short string lexed as though it followed the source, so the 
+            // source does not need to be copied to add it.
+            std::shared_ptr<const SourceBuffer> source_;
+            std::string tail_;
+            std::string regex_code_;  // Source and tail joined for the regex engine when needed
+
+            // While relexing, the code from the restart up to a little past the edit is copied 
+            // here and lexed instead of the edited source, so the source is never joined. The 
+            // window is widened if the tokens do not line up with the old ones inside of it.
+            std::string window_;
+            std::size_t window_offset_ = 0;
+            bool windowed_ = false;
+            std::size_t cursor_ = 0;
+            int lineno_ = 1, colno_ = 1;  // Only updated when tracking lines
+            const LexerEngine engine_;
+            const PositionTracking tracking_;
+
+            // What tokens are matched with, which never changes once the lexer is made, so 
+            // copies of the lexer share it
+            struct Tables {
+                TokensMap tokens_map;
+                TokensMapRegex tokens;
+                TokensDFA dfa;
+                std::vector<int> dfa_symbols;  // DFA or scanner token -> symbol ID
+                std::vector<TokenCallback> dfa_callbacks;
+            };
+            std::shared_ptr<const Tables> tables_;
+            const Scanner* const scanner_;
+
+            // Symbol IDs. A deque is used so references to names stay valid as symbols are added.
+            std::deque<std::string> symbols_;
+            std::unordered_map<std::string, int> symbol_ids_;
+            int end_symbol_, comment_symbol_;
+
+            CallbackValues callback_values_;
+            LexToken callback_token_;  // Reused for every callback
+            std::string callback_value_;
+
+            // Offsets of the start of each line, filled in up to line_index_end_ as positions 
+            // are asked for
+            mutable std::vector<std::uint32_t> line_starts_ = {0};
+            mutable std::size_t line_index_end_ = 0;
+            int line_base_ = 0, col_base_ = 0;  // Where the first line in the index starts
+            mutable std::size_t last_line_ = 0;  // Line of the last lookup
 
             void advance_pos(char);
-            void advance_stream_and_pos(const std::string&);
-            void advance_stream_and_pos(char);
-            bool find_match(LexToken&);
+            void advance_stream_and_pos(std::size_t);
+            char at(std::size_t) const;
+            char peek() const;
+            std::size_t size() const;
+            void remaining(const char*&, const char*&, const char*&, const char*&) const;
+            void skip_space();
+            bool find_match(Token&);
+            bool find_regex_match(Token&);
+            bool find_dfa_match(Token&);
+            void run_callback(TokenCallback, Token&);
+            void index_lines(std::size_t) const;
+            void position(std::size_t, int&, int&) const;
+            void set_callback_value(std::uint32_t, const std::string&);
+            void fill_window(std::size_t begin, std::size_t end);
+
+        protected:
+            int add_symbol(const std::string&);
+            void init_symbols();
+
+            // A lexer for another lexer's code that shares its tables and starts with its 
+            // symbols, but with none of its other state. It starts at an offset known to be 
+            // at the given line and column, as with seek().
+            Lexer(const Lexer&, std::size_t offset, int lineno, int colno);
+
+            // For filling a stream with the tokens from the cursor onwards
+            TokenStream start_stream() const;
+            void push_token(TokenStream&, const Token&) const;
+            void finish_stream(TokenStream&) const;
+
+            // Where a stream is lexed again after an edit. Offsets before the edit are in the 
+            // old code and the ones after it in the new code.
+            struct Splice {
+                std::size_t restart;    // First token of the stream that is lexed again
+                std::size_t resync;     // First token of the stream that may be kept after the edit
+                std::size_t offset, old_end, new_end;
+                std::size_t restart_offset;  // Start of the line of the restart token
+                int restart_line;
+                std::int64_t shift;
+                int line_shift;
+            };
+            Splice start_relex(const TokenStream&, const Edit&);
+
+            // Called when lexing from the restart did not line up with the old tokens. If the 
+            // window did not reach the end of the code, it is widened and the cursor goes back 
+            // to the restart so the tokens can be lexed again.
+            bool widen_relex(Splice&);
+            virtual bool starts_line(const TokenStream&, std::size_t) const;
+            bool resyncs(const TokenStream&, Splice&, const Token&) const;
+            void finish_relex(TokenStream&, const Splice&, const TokenStream& relexed, bool resynced);
 
         public:
-            Lexer(const TokensMap&);
+            Lexer(const TokensMap&, LexerEngine engine=DFA_ENGINE, PositionTracking tracking=TRACK_LINES);
+
+            // Lex with a generated scanner. The tokens map it was generated from is still 
+            // needed for the callbacks.
+            Lexer(const TokensMap&, const Scanner&, PositionTracking tracking=TRACK_LINES);
+            virtual ~Lexer(){}
 
             void input(const std::string&);
-            virtual LexToken token();
+            void input(const std::shared_ptr<const SourceBuffer>&);
+            void input_tail(const std::string&);
+            virtual Token next_token();
+            LexToken token();
+
+            // All tokens from the cursor up to and including the END token
+            virtual TokenStream tokenize();
+
+            // Move the cursor to an offset that is known to be at the given line and column. 
+            // Positions before the start of that line cannot be found afterwards.
+            void seek(std::size_t offset, int lineno, int colno);
+
+            // Update a stream from this lexer for an edit to its code, lexing only the tokens 
+            // around the edit. The lexer moves on to the edited code and its end.
+            virtual void relex(TokenStream&, const Edit&);
             bool empty() const;
 
+            // Reading compact tokens
+            LexToken lex_token(const Token&) const;
+            std::string value(const Token&) const;
+            const std::string* callback_value(std::uint32_t offset) const;  // nullptr if the token kept its value
+            const std::string& symbol_name(int) const;
+            int symbol_id(const std::string&) const;  // -1 if the symbol is unknown
+            std::size_t num_symbols() const;
+            int end_symbol() const;
+
+            // The line and column of a compact token. Tokens found while only tracking offsets 
+            // have a line and column of 0, and these look them up in the line index instead.
+            int lineno(const Token&) const;
+            int colno(const Token&) const;
+
             // Getters
             int pos() const;
             int lineno() const;
             int colno() const;
             const TokensMap& tokens() const;
-            const std::string& lexcode() const;
+            const std::shared_ptr<const SourceBuffer>& source() const;
+            std::string lexcode() const;  // The remaining code from the cursor onwards
+            std::string lexcode(std::size_t max) const;  // At most max bytes of it
+            std::size_t cursor() const;
+            LexerEngine engine() const;
+            PositionTracking tracking() const;
     };
 
     // Runtime error on finding a start of string that does not match 
     // any regexs provided.
     class LexError: public std::runtime_error {
         private:
-            const Lexer& lexer_;
+            static std::string message(const Lexer&);
 
         public:
             LexError(const Lexer&);
-            virtual const char* what() const throw();
     };
 }
 
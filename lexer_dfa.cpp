@@ -0,0 +1,807 @@
+#include "lexer.h"
+
+#include <bitset>
+#include <cassert>
+#include <cctype>
+#include <map>
+#include <memory>
+#include <algorithm>
+
+typedef std::bitset<256> ByteSet;
+
+/********* Regex parsing **********/
+
+/**
+ * Nodes in the tree parsed from a single regex.
+ */
+typedef struct RegexNode RegexNode;
+struct RegexNode {
+    enum Kind {BYTES, CONCAT, ALTERNATE, REPEAT} kind;
+    ByteSet bytes;  // BYTES
+    std::vector<std::shared_ptr<RegexNode>> children;  // CONCAT, ALTERNATE, REPEAT
+    int min = 0, max = 0;  // REPEAT; max of -1 is unbounded
+};
+
+typedef std::shared_ptr<RegexNode> RegexNodePtr;
+
+static RegexNodePtr make_regex_node(RegexNode::Kind kind){
+    RegexNodePtr node = std::make_shared<RegexNode>();
+    node->kind = kind;
+    return node;
+}
+
+/**
+ * Recursive descent parser for the subset of the ECMAScript regex syntax the DFA supports.
+ */
+class RegexParser {
+    private:
+        const std::string& pattern_;
+        std::size_t pos_ = 0;
+        int depth_ = 0;
+
+        // Lookahead found at the end of the pattern
+        RegexNodePtr lookahead_;
+        bool lookahead_negated_ = false;
+
+        void error(const std::string& msg) const {
+            std::ostringstream err;
+            err << "Unable to compile regex '" << pattern_ << "' into a DFA: " << msg
+                << " (at position " << pos_ << ").";
+            throw std::runtime_error(err.str());
+        }
+
+        bool at_end() const { return pos_ >= pattern_.size(); }
+        char peek() const { return pattern_[pos_]; }
+
+        bool consume(char c){
+            if (!at_end() && peek() == c){
+                ++pos_;
+                return true;
+            }
+            return false;
+        }
+
+        static ByteSet digits(){
+            ByteSet s;
+            for (int c = '0'; c <= '9'; ++c){ s.set(c); }
+            return s;
+        }
+
+        static ByteSet word(){
+            ByteSet s = digits();
+            for (int c = 'a'; c <= 'z'; ++c){ s.set(c); }
+            for (int c = 'A'; c <= 'Z'; ++c){ s.set(c); }
+            s.set('_');
+            return s;
+        }
+
+        static ByteSet space(){
+            ByteSet s;
+            for (char c : std::string(" \t\n\r\f\v")){ s.set(static_cast<unsigned char>(c)); }
+            return s;
+        }
+
+        int parse_hex(std::size_t len){
+            int value = 0;
+            for (std::size_t i = 0; i < len; ++i){
+                if (at_end() || !isxdigit(peek())){
+                    error("expected hex digit");
+                }
+                char c = pattern_[pos_++];
+                value = value * 16 + (isdigit(c) ? c - '0' : tolower(c) - 'a' + 10);
+            }
+            return value;
+        }
+
+        /**
+         * Parse the character after a backslash into the set of bytes it matches.
+         */
+        ByteSet parse_escape(bool in_class){
+            if (at_end()){
+                error("trailing backslash");
+            }
+            char c = pattern_[pos_++];
+            ByteSet s;
+            switch (c){
+                case 'd': return digits();
+                case 'D': return ~digits();
+                case 'w': return word();
+                case 'W': return ~word();
+                case 's': return space();
+                case 'S': return ~space();
+                case 'n': s.set('\n'); return s;
+                case 't': s.set('\t'); return s;
+                case 'r': s.set('\r'); return s;
+                case 'f': s.set('\f'); return s;
+                case 'v': s.set('\v'); return s;
+                case '0': s.set(0); return s;
+                case 'x': s.set(parse_hex(2)); return s;
+                case 'b':
+                    if (in_class){
+                        s.set('\b');
+                        return s;
+                    }
+                    error("word boundaries are not supported");
+                    break;
+                default:
+                    if (isalnum(c)){
+                        error(std::string("unsupported escape \\") + c);
+                    }
+                    s.set(static_cast<unsigned char>(c));
+                    return s;
+            }
+            return s;
+        }
+
+        /**
+         * [abc], [^a-z\d], ...
+         */
+        RegexNodePtr parse_class(){
+            bool negated = consume('^');
+            ByteSet s;
+            while (!at_end() && peek() != ']'){
+                ByteSet lower;
+                int lower_byte = -1;
+                if (consume('\\')){
+                    lower = parse_escape(true);
+                    if (lower.count() == 1){
+                        for (int b = 0; b < 256; ++b){
+                            if (lower.test(b)){ lower_byte = b; }
+                        }
+                    }
+                }
+                else {
+                    lower_byte = static_cast<unsigned char>(pattern_[pos_++]);
+                    lower.set(lower_byte);
+                }
+
+                // Range
+                if (lower_byte >= 0 && pos_ + 1 < pattern_.size() && peek() == '-' && pattern_[pos_+1] != ']'){
+                    ++pos_;
+                    int upper_byte;
+                    if (consume('\\')){
+                        ByteSet upper = parse_escape(true);
+                        if (upper.count() != 1){
+                            error("invalid range in character class");
+                        }
+                        upper_byte = 0;
+                        while (!upper.test(upper_byte)){ ++upper_byte; }
+                    }
+                    else {
+                        upper_byte = static_cast<unsigned char>(pattern_[pos_++]);
+                    }
+                    if (upper_byte < lower_byte){
+                        error("invalid range in character class");
+                    }
+                    for (int b = lower_byte; b <= upper_byte; ++b){
+                        s.set(b);
+                    }
+                }
+                else {
+                    s |= lower;
+                }
+            }
+            if (!consume(']')){
+                error("unterminated character class");
+            }
+
+            RegexNodePtr node = make_regex_node(RegexNode::BYTES);
+            node->bytes = negated ? ~s : s;
+            return node;
+        }
+
+        RegexNodePtr parse_atom(){
+            char c = pattern_[pos_++];
+            RegexNodePtr node;
+            switch (c){
+                case '(':
+                    if (consume('?')){
+                        if (consume(':')){
+                            // Non capturing group
+                        }
+                        else if (!at_end() && (peek() == '!' || peek() == '=')){
+                            return parse_lookahead();
+                        }
+                        else {
+                            error("unsupported group");
+                        }
+                    }
+                    ++depth_;
+                    node = parse_alternation();
+                    --depth_;
+                    if (!consume(')')){
+                        error("missing ')'");
+                    }
+                    return node;
+                case '[':
+                    return parse_class();
+                case '.':
+                    node = make_regex_node(RegexNode::BYTES);
+                    node->bytes.set();
+                    node->bytes.reset('\n');
+                    node->bytes.reset('\r');
+                    return node;
+                case '\\':
+                    node = make_regex_node(RegexNode::BYTES);
+                    if (!at_end() && peek() >= '1' && peek() <= '9'){
+                        error("backreferences are not supported");
+                    }
+                    node->bytes = parse_escape(false);
+                    return node;
+                case '^':
+                case '$':
+                    error("anchors are not supported");
+                    break;
+                case '*':
+                case '+':
+                case '?':
+                case '{':
+                    --pos_;
+                    error("nothing to repeat");
+                    break;
+                case ')':
+                    --pos_;
+                    error("unmatched ')'");
+                    break;
+                default:
+                    node = make_regex_node(RegexNode::BYTES);
+                    node->bytes.set(static_cast<unsigned char>(c));
+                    return node;
+            }
+            return node;
+        }
+
+        /**
+         * (?!...) or (?=...). Only allowed as the last part of the whole regex.
+         * Returns an empty concatenation in place of the lookahead.
+         */
+        RegexNodePtr parse_lookahead(){
+            if (depth_ || lookahead_){
+                error("lookaheads are only supported at the end of a regex");
+            }
+            lookahead_negated_ = pattern_[pos_++] == '!';
+
+            ++depth_;
+            lookahead_ = parse_alternation();
+            --depth_;
+            if (!consume(')')){
+                error("missing ')'");
+            }
+            if (!at_end()){
+                error("lookaheads are only supported at the end of a regex");
+            }
+            return make_regex_node(RegexNode::CONCAT);
+        }
+
+        bool parse_number(int& n){
+            if (at_end() || !isdigit(peek())){
+                return false;
+            }
+            n = 0;
+            while (!at_end() && isdigit(peek())){
+                n = n * 10 + (pattern_[pos_++] - '0');
+            }
+            return true;
+        }
+
+        RegexNodePtr parse_repeat(){
+            RegexNodePtr atom = parse_atom();
+
+            while (!at_end()){
+                int min, max;
+                char c = peek();
+                if (c == '*'){ min = 0; max = -1; ++pos_; }
+                else if (c == '+'){ min = 1; max = -1; ++pos_; }
+                else if (c == '?'){ min = 0; max = 1; ++pos_; }
+                else if (c == '{'){
+                    std::size_t start = pos_++;
+                    if (!parse_number(min)){
+                        // A '{' that does not start a quantifier is a literal in ECMAScript
+                        pos_ = start;
+                        break;
+                    }
+                    max = min;
+                    if (consume(',') && !parse_number(max)){
+                        max = -1;
+                    }
+                    if (!consume('}')){
+                        pos_ = start;
+                        break;
+                    }
+                    if (max != -1 && max < min){
+                        error("invalid repeat range");
+                    }
+                }
+                else {
+                    break;
+                }
+                consume('?');  // Lazy and greedy repeats match the same strings
+
+                if (lookahead_){
+                    error("lookaheads are only supported at the end of a regex");
+                }
+
+                RegexNodePtr repeat = make_regex_node(RegexNode::REPEAT);
+                repeat->children.push_back(atom);
+                repeat->min = min;
+                repeat->max = max;
+                atom = repeat;
+            }
+
+            return atom;
+        }
+
+        RegexNodePtr parse_concat(){
+            RegexNodePtr node = make_regex_node(RegexNode::CONCAT);
+            while (!at_end() && peek() != '|' && peek() != ')'){
+                node->children.push_back(parse_repeat());
+            }
+            return node;
+        }
+
+        RegexNodePtr parse_alternation(){
+            RegexNodePtr first = parse_concat();
+            if (at_end() || peek() != '|'){
+                return first;
+            }
+
+            RegexNodePtr node = make_regex_node(RegexNode::ALTERNATE);
+            node->children.push_back(first);
+            while (consume('|')){
+                if (lookahead_){
+                    error("lookaheads are only supported at the end of a regex");
+                }
+                node->children.push_back(parse_concat());
+            }
+            return node;
+        }
+
+    public:
+        RegexParser(const std::string& pattern): pattern_(pattern){}
+
+        RegexNodePtr parse(){
+            RegexNodePtr node = parse_alternation();
+            if (!at_end()){
+                error("unmatched ')'");
+            }
+            if (lookahead_ && node->kind == RegexNode::ALTERNATE){
+                error("lookaheads are only supported at the end of a regex");
+            }
+            return node;
+        }
+
+        RegexNodePtr lookahead() const { return lookahead_; }
+        bool lookahead_negated() const { return lookahead_negated_; }
+};
+
+/**
+ * A regex is a literal if it only matches one string.
+ */
+static bool is_literal(const RegexNodePtr& node){
+    switch (node->kind){
+        case RegexNode::BYTES:
+            return node->bytes.count() == 1;
+        case RegexNode::CONCAT:
+            return std::all_of(node->children.begin(), node->children.end(), is_literal);
+        case RegexNode::ALTERNATE:
+            return false;
+        case RegexNode::REPEAT:
+            return node->min == node->max && is_literal(node->children.front());
+    }
+    return false;
+}
+
+
+/********* NFA **********/
+
+/**
+ * Thompson construction of a nondeterministic automaton. Each state either has a single
+ * transition on a set of bytes or any number of epsilon transitions.
+ */
+typedef struct NFAState NFAState;
+struct NFAState {
+    ByteSet bytes;
+    int next = -1;
+    std::vector<int> epsilons;
+    int accept = -1;  // Index of the pattern accepted in this state
+};
+
+class NFA {
+    private:
+        std::vector<NFAState> states_;
+
+        int new_state(){
+            states_.push_back(NFAState());
+            return static_cast<int>(states_.size()) - 1;
+        }
+
+        void epsilon(int from, int to){
+            states_[from].epsilons.push_back(to);
+        }
+
+    public:
+        /**
+         * Add the states for a regex node between start and a new returned end state.
+         */
+        int add(const RegexNodePtr& node, int start){
+            int end;
+            switch (node->kind){
+                case RegexNode::BYTES:
+                    end = new_state();
+                    states_[start].bytes = node->bytes;
+                    states_[start].next = end;
+                    return end;
+                case RegexNode::CONCAT:
+                    end = start;
+                    for (const RegexNodePtr& child : node->children){
+                        int next = new_state();
+                        epsilon(end, next);
+                        end = add(child, next);
+                    }
+                    return end;
+                case RegexNode::ALTERNATE:
+                    end = new_state();
+                    for (const RegexNodePtr& child : node->children){
+                        int child_start = new_state();
+                        epsilon(start, child_start);
+                        epsilon(add(child, child_start), end);
+                    }
+                    return end;
+                case RegexNode::REPEAT: {
+                    const RegexNodePtr& child = node->children.front();
+                    end = start;
+                    for (int i = 0; i < node->min; ++i){
+                        int next = new_state();
+                        epsilon(end, next);
+                        end = add(child, next);
+                    }
+                    if (node->max == -1){
+                        // Kleene star
+                        int loop = new_state();
+                        int after = new_state();
+                        epsilon(end, loop);
+                        epsilon(loop, after);
+                        int child_start = new_state();
+                        epsilon(loop, child_start);
+                        epsilon(add(child, child_start), loop);
+                        end = after;
+                    }
+                    else {
+                        int after = new_state();
+                        for (int i = node->min; i < node->max; ++i){
+                            epsilon(end, after);
+                            int next = new_state();
+                            epsilon(end, next);
+                            end = add(child, next);
+                        }
+                        epsilon(end, after);
+                        end = after;
+                    }
+                    return end;
+                }
+            }
+            return start;
+        }
+
+        /**
+         * Add a whole pattern which is accepted in its end state.
+         * Returns the start state for the pattern.
+         */
+        int add_pattern(const RegexNodePtr& node, int pattern){
+            int start = new_state();
+            int end = add(node, start);
+            states_[end].accept = pattern;
+            return start;
+        }
+
+        int add_start(const std::vector<int>& starts){
+            int start = new_state();
+            for (int s : starts){
+                epsilon(start, s);
+            }
+            return start;
+        }
+
+        /**
+         * Expand the states with all states reachable through epsilon transitions.
+         * Returned sorted so the set can be used as a key.
+         */
+        std::vector<int> closure(std::vector<int> states) const {
+            std::vector<bool> found(states_.size(), false);
+            for (int s : states){
+                found[s] = true;
+            }
+            for (std::size_t i = 0; i < states.size(); ++i){
+                for (int next : states_[states[i]].epsilons){
+                    if (!found[next]){
+                        found[next] = true;
+                        states.push_back(next);
+                    }
+                }
+            }
+            std::sort(states.begin(), states.end());
+            return states;
+        }
+
+        const std::vector<NFAState>& states() const { return states_; }
+};
+
+/**
+ * Split the 256 bytes into classes of bytes that no transition in the NFA distinguishes.
+ */
+static std::vector<unsigned char> make_byte_classes(const NFA& nfa, std::size_t& num_classes){
+    std::vector<int> classes(256, 0);
+    num_classes = 1;
+    for (const NFAState& state : nfa.states()){
+        if (state.next < 0){
+            continue;
+        }
+
+        // Split each existing class into the bytes inside and outside of this set
+        std::map<std::pair<int, bool>, int> split;
+        for (int b = 0; b < 256; ++b){
+            split.insert({{classes[b], state.bytes.test(b)}, static_cast<int>(split.size())});
+        }
+        if (split.size() == num_classes){
+            continue;
+        }
+        for (int b = 0; b < 256; ++b){
+            classes[b] = split.at({classes[b], state.bytes.test(b)});
+        }
+        num_classes = split.size();
+    }
+    assert(num_classes <= 256);
+    return std::vector<unsigned char>(classes.begin(), classes.end());
+}
+
+/**
+ * Subset construction of the DFA from each pattern. State 0 is the start state.
+ */
+static lexing::TokensDFA::Automaton make_automaton(const std::vector<RegexNodePtr>& patterns){
+    NFA nfa;
+    std::vector<int> starts;
+    for (std::size_t i = 0; i < patterns.size(); ++i){
+        starts.push_back(nfa.add_pattern(patterns[i], static_cast<int>(i)));
+    }
+    int start = nfa.add_start(starts);
+
+    lexing::TokensDFA::Automaton automaton;
+    automaton.byte_classes = make_byte_classes(nfa, automaton.num_classes);
+
+    // A representative byte for each class
+    std::vector<int> class_bytes(automaton.num_classes, 0);
+    for (int b = 255; b >= 0; --b){
+        class_bytes[automaton.byte_classes[b]] = b;
+    }
+
+    std::vector<std::vector<int>> dfa_states = {nfa.closure({start})};
+    std::map<std::vector<int>, int> found_states = {{dfa_states.front(), 0}};
+
+    const std::vector<NFAState>& nfa_states = nfa.states();
+    for (std::size_t i = 0; i < dfa_states.size(); ++i){
+        // Accepted patterns, which are already in order of priority
+        std::vector<int> accepts;
+        for (int s : dfa_states[i]){
+            if (nfa_states[s].accept >= 0){
+                accepts.push_back(nfa_states[s].accept);
+            }
+        }
+        std::sort(accepts.begin(), accepts.end());
+        automaton.accepts.push_back(accepts);
+
+        for (std::size_t c = 0; c < automaton.num_classes; ++c){
+            std::vector<int> moved;
+            for (int s : dfa_states[i]){
+                const NFAState& nfa_state = nfa_states[s];
+                if (nfa_state.next >= 0 && nfa_state.bytes.test(class_bytes[c])){
+                    moved.push_back(nfa_state.next);
+                }
+            }
+
+            int next = -1;
+            if (!moved.empty()){
+                std::vector<int> next_set = nfa.closure(moved);
+                auto found = found_states.find(next_set);
+                if (found == found_states.end()){
+                    next = static_cast<int>(dfa_states.size());
+                    found_states[next_set] = next;
+                    dfa_states.push_back(next_set);
+                }
+                else {
+                    next = found->second;
+                }
+            }
+            automaton.transitions.push_back(next);
+        }
+    }
+
+    return automaton;
+}
+
+
+/********* TokensDFA **********/
+
+/**
+ * Regexs that are literals are tried before others of the same length. Otherwise, tokens are
+ * ordered by name so the priority does not depend on the order of the unordered map.
+ */
+lexing::TokensDFA::TokensDFA(const TokensMap& tokens){
+    typedef std::pair<bool, std::string> Priority;
+    std::map<Priority, RegexNodePtr> ordered;
+    std::unordered_map<std::string, std::pair<RegexNodePtr, bool>> lookaheads;
+
+    for (auto it = tokens.begin(); it != tokens.end(); ++it){
+        const std::string& symbol = it->first;
+        const std::string& regex_str = it->second.first;
+        if (regex_str.empty()){
+            // Fictitious tokens
+            continue;
+        }
+
+        RegexParser parser(regex_str);
+        RegexNodePtr node = parser.parse();
+        ordered[{!is_literal(node), symbol}] = node;
+        if (parser.lookahead()){
+            lookaheads[symbol] = {parser.lookahead(), parser.lookahead_negated()};
+        }
+    }
+
+    std::vector<RegexNodePtr> patterns;
+    for (auto it = ordered.begin(); it != ordered.end(); ++it){
+        const std::string& symbol = it->first.second;
+        symbols_.push_back(symbol);
+        callbacks_.push_back(tokens.at(symbol).second);
+        patterns.push_back(it->second);
+
+        auto lookahead = lookaheads.find(symbol);
+        if (lookahead == lookaheads.end()){
+            lookaheads_.push_back(-1);
+        }
+        else {
+            lookaheads_.push_back(static_cast<int>(lookahead_automata_.size()));
+            lookahead_automata_.push_back({
+                lookahead->second.second,
+                make_automaton({lookahead->second.first})
+            });
+        }
+    }
+
+    automaton_ = make_automaton(patterns);
+    find_skips();
+}
+
+/**
+ * Find the states that can be skipped through with a scan. A state can only be skipped 
+ * through if staying in it can never change which token is found, so any state accepting a 
+ * token with a lookahead is left alone.
+ */
+void lexing::TokensDFA::find_skips(){
+    const std::size_t num_classes = automaton_.num_classes;
+    skips_.assign(automaton_.accepts.size(), Skip());
+
+    for (std::size_t state = 0; state < skips_.size(); ++state){
+        bool has_lookahead = false;
+        for (int pattern : automaton_.accepts[state]){
+            has_lookahead |= lookaheads_[pattern] >= 0;
+        }
+        if (has_lookahead){
+            continue;
+        }
+
+        std::vector<char> exits, loops;
+        for (int byte = 0; byte < 256; ++byte){
+            int next = automaton_.transitions[state * num_classes + automaton_.byte_classes[byte]];
+            (next == static_cast<int>(state) ? loops : exits).push_back(static_cast<char>(byte));
+        }
+        if (loops.empty()){
+            continue;
+        }
+
+        Skip& skip = skips_[state];
+        if (exits.size() <= 3){
+            skip.kind = Skip::UNTIL_ANY;
+            std::copy(exits.begin(), exits.end(), skip.bytes);
+            skip.num_bytes = exits.size();
+        }
+        else if (loops.size() == 1){
+            skip.kind = Skip::WHILE_BYTE;
+            skip.bytes[0] = loops[0];
+            skip.num_bytes = 1;
+        }
+    }
+}
+
+/**
+ * Check if the lookahead matches any prefix of [begin, end) followed by [tail, tail_end).
+ */
+bool lexing::TokensDFA::lookahead_matches(const Lookahead& lookahead, const char* begin, const char* end,
+                                          const char* tail, const char* tail_end) const {
+    const Automaton& automaton = lookahead.automaton;
+    int state = 0;
+    for (const char* p = begin; ; ++p){
+        if (!automaton.accepts[state].empty()){
+            return true;
+        }
+        if (p == end){
+            if (tail == tail_end){
+                return false;
+            }
+            p = tail;
+            end = tail_end;
+            tail = tail_end;
+        }
+        state = automaton.transitions[state * automaton.num_classes +
+                                      automaton.byte_classes[static_cast<unsigned char>(*p)]];
+        if (state < 0){
+            return false;
+        }
+    }
+}
+
+int lexing::TokensDFA::match(const char* begin, const char* end, std::size_t& length,
+                             const char* tail, const char* tail_end) const {
+    int found = -1;
+    if (automaton_.transitions.empty()){
+        return found;
+    }
+
+    const unsigned char* byte_classes = automaton_.byte_classes.data();
+    const int* transitions = automaton_.transitions.data();
+    const std::size_t num_classes = automaton_.num_classes;
+
+    int state = 0;
+    std::size_t consumed = 0;
+    for (const char* p = begin; ; ){
+        if (p == end){
+            if (tail == tail_end){
+                break;
+            }
+            // Continue into the tail
+            p = tail;
+            end = tail_end;
+            tail = tail_end;
+        }
+
+        state = transitions[state * num_classes + byte_classes[static_cast<unsigned char>(*p)]];
+        if (state < 0){
+            break;
+        }
+        ++p;
+        ++consumed;
+
+        // Skip the rest of a run of bytes that stay in this state. The state does not 
+        // have lookaheads, so whatever it accepts is accepted at the end of the run too.
+        const Skip& skip = skips_[state];
+        if (skip.kind != Skip::NONE && p != end){
+            const char* run_end = skip.kind == Skip::UNTIL_ANY ? 
+                scan::find_any(p, end, skip.bytes, skip.num_bytes) :
+                scan::find_not(p, end, skip.bytes[0]);
+            consumed += run_end - p;
+            p = run_end;
+        }
+
+        // Take the highest priority token accepted here whose lookahead (if any) passes
+        for (int pattern : automaton_.accepts[state]){
+            int lookahead = lookaheads_[pattern];
+            if (lookahead >= 0){
+                const Lookahead& automaton = lookahead_automata_[lookahead];
+                if (lookahead_matches(automaton, p, end, tail, tail_end) == automaton.negated){
+                    continue;
+                }
+            }
+            found = pattern;
+            length = consumed;
+            break;
+        }
+    }
+
+    return found;
+}
+
+/**
+ * Getters
+ */
+const std::string& lexing::TokensDFA::symbol(int i) const { return symbols_[i]; }
+lexing::TokenCallback lexing::TokensDFA::callback(int i) const { return callbacks_[i]; }
+std::size_t lexing::TokensDFA::num_tokens() const { return symbols_.size(); }
+std::size_t lexing::TokensDFA::num_states() const { return automaton_.accepts.size(); }
@@ -0,0 +1,335 @@
+#include "lexer.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <map>
+#include <set>
+
+/**
+ * A byte as it would appear in a case label or a string literal in the generated code.
+ */
+static std::string case_byte(int byte){
+    if (std::isalnum(byte) || byte == '_'){
+        return std::string("'") + static_cast<char>(byte) + "'";
+    }
+    return std::to_string(byte);
+}
+
+/**
+ * The bytes leading from a state to each next state, with the next state most bytes go to
+ * (which may be -1 for no state) chosen as the default case.
+ */
+static std::map<int, std::vector<int>> group_transitions(const lexing::TokensDFA::Automaton& automaton,
+                                                         std::size_t state, int& default_state){
+    std::map<int, std::vector<int>> groups;
+    for (int byte = 0; byte < 256; ++byte){
+        int next = automaton.transitions[state * automaton.num_classes + automaton.byte_classes[byte]];
+        groups[next].push_back(byte);
+    }
+
+    default_state = -1;
+    std::size_t most = 0;
+    for (auto it = groups.begin(); it != groups.end(); ++it){
+        if (it->second.size() > most){
+            most = it->second.size();
+            default_state = it->first;
+        }
+    }
+    groups.erase(default_state);
+    return groups;
+}
+
+/**
+ * States that are the target of any transition need a label.
+ */
+static std::set<int> targeted_states(const lexing::TokensDFA::Automaton& automaton){
+    return std::set<int>(automaton.transitions.begin(), automaton.transitions.end());
+}
+
+/**
+ * Switch on the byte at p for one state, moving to the next state or to the given
+ * statement if there is none.
+ */
+static void write_switch(std::ostream& out, const lexing::TokensDFA::Automaton& automaton, std::size_t state,
+                         const std::string& label_prefix, const std::string& step, const std::string& no_state){
+    int default_state;
+    std::map<int, std::vector<int>> groups = group_transitions(automaton, state, default_state);
+
+    auto target = [&](int next){
+        return next < 0 ? no_state : step + " goto " + label_prefix + std::to_string(next) + ";";
+    };
+
+    out << "    switch (static_cast<unsigned char>(*p)){" << std::endl;
+    for (auto it = groups.begin(); it != groups.end(); ++it){
+        const std::vector<int>& bytes = it->second;
+        for (std::size_t i = 0; i < bytes.size(); ++i){
+            out << (i % 8 ? " " : "        ") << "case " << case_byte(bytes[i]) << ":";
+            if (i % 8 == 7 || i + 1 == bytes.size()){
+                out << std::endl;
+            }
+        }
+        out << "            " << target(it->first) << std::endl;
+    }
+    out << "        default:" << std::endl;
+    out << "            " << target(default_state) << std::endl;
+    out << "    }" << std::endl;
+}
+
+static const char* const NEXT_RANGE =
+    "    if (p == end){\n"
+    "        if (tail == tail_end) %s\n"
+    "        p = tail;\n"
+    "        end = tail_end;\n"
+    "        tail = tail_end;\n"
+    "    }\n";
+
+static void write_next_range(std::ostream& out, const std::string& at_end){
+    std::string code = NEXT_RANGE;
+    code.replace(code.find("%s"), 2, at_end);
+    out << code;
+}
+
+/**
+ * A lookahead is a function returning whether any prefix of the rest of the code matches it.
+ */
+static void write_lookahead(std::ostream& out, std::size_t index, const lexing::TokensDFA::Automaton& automaton){
+    const std::string prefix = "l" + std::to_string(index) + "_s";
+    std::set<int> targets = targeted_states(automaton);
+
+    out << "static bool lookahead_" << index
+        << "(const char* p, const char* end, const char* tail, const char* tail_end){" << std::endl;
+    for (std::size_t state = 0; state < automaton.accepts.size(); ++state){
+        if (targets.count(static_cast<int>(state))){
+            out << prefix << state << ":" << std::endl;
+        }
+        if (!automaton.accepts[state].empty()){
+            out << "    return true;" << std::endl;
+            continue;
+        }
+        write_next_range(out, "return false;");
+        write_switch(out, automaton, state, prefix, "++p;", "return false;");
+    }
+    out << "}" << std::endl << std::endl;
+}
+
+/**
+ * A perfect hash of the keywords on their length and first and last bytes. The multipliers
+ * and table size are searched for until every keyword lands in its own slot.
+ */
+static void find_keyword_hash(const std::vector<std::string>& keywords, unsigned& a, unsigned& b, unsigned& m){
+    auto hash = [&](const std::string& word){
+        return (word.size() * a + static_cast<unsigned char>(word.front()) * b +
+                static_cast<unsigned char>(word.back())) % m;
+    };
+
+    for (m = keywords.size(); m <= 16 * keywords.size(); ++m){
+        for (a = 1; a < 64; ++a){
+            for (b = 1; b < 64; ++b){
+                std::set<std::size_t> slots;
+                for (const std::string& word : keywords){
+                    slots.insert(hash(word));
+                }
+                if (slots.size() == keywords.size()){
+                    return;
+                }
+            }
+        }
+    }
+    throw std::runtime_error("Unable to find a perfect hash for the keywords.");
+}
+
+static void write_keywords(std::ostream& out, const lexing::Keywords& keywords,
+                           const std::vector<std::string>& symbols){
+    std::vector<std::string> words;
+    std::size_t min_length = SIZE_MAX, max_length = 0;
+    for (auto it = keywords.begin(); it != keywords.end(); ++it){
+        if (it->first.empty()){
+            throw std::runtime_error("Keywords cannot be empty.");
+        }
+        words.push_back(it->first);
+        min_length = std::min(min_length, it->first.size());
+        max_length = std::max(max_length, it->first.size());
+    }
+    std::sort(words.begin(), words.end());
+
+    unsigned a, b, m;
+    find_keyword_hash(words, a, b, m);
+
+    std::vector<std::string> slots(m);
+    for (const std::string& word : words){
+        slots[(word.size() * a + static_cast<unsigned char>(word.front()) * b +
+               static_cast<unsigned char>(word.back())) % m] = word;
+    }
+
+    out << "struct Keyword {" << std::endl;
+    out << "    const char* text;" << std::endl;
+    out << "    std::size_t length;" << std::endl;
+    out << "    int token;" << std::endl;
+    out << "};" << std::endl << std::endl;
+
+    out << "static const Keyword KEYWORDS[" << m << "] = {" << std::endl;
+    for (const std::string& word : slots){
+        if (word.empty()){
+            out << "    {\"\", 0, -1}," << std::endl;
+        }
+        else {
+            int token = std::find(symbols.begin(), symbols.end(), keywords.at(word)) - symbols.begin();
+            out << "    {" << string_literal(word) << ", " << word.size() << ", " << token << "}," << std::endl;
+        }
+    }
+    out << "};" << std::endl << std::endl;
+
+    out << "/**" << std::endl;
+    out << " * The keyword token for a match, or the token found if it is not a keyword." << std::endl;
+    out << " */" << std::endl;
+    out << "static int keyword(const char* begin, const char* source_end, const char* tail, "
+        << "std::size_t length, int found){" << std::endl;
+    out << "    if (length < " << min_length << " || length > " << max_length << "){" << std::endl;
+    out << "        return found;" << std::endl;
+    out << "    }" << std::endl;
+    out << "    char text[" << max_length << "];" << std::endl;
+    out << "    for (std::size_t i = 0; i < length; ++i){" << std::endl;
+    out << "        text[i] = begin + i < source_end ? begin[i] : tail[begin + i - source_end];" << std::endl;
+    out << "    }" << std::endl;
+    out << "    const Keyword& kw = KEYWORDS[(length * " << a << " + static_cast<unsigned char>(text[0]) * " << b
+        << " + static_cast<unsigned char>(text[length - 1])) % " << m << "];" << std::endl;
+    out << "    if (kw.length == length && !std::memcmp(kw.text, text, length)){" << std::endl;
+    out << "        return kw.token;" << std::endl;
+    out << "    }" << std::endl;
+    out << "    return found;" << std::endl;
+    out << "}" << std::endl << std::endl;
+}
+
+/**
+ * Write the whole DFA as one function, where each state is a label followed by a switch
+ * on the next byte that jumps to the label of the next state.
+ */
+void lexing::generate_scanner(std::ostream& out, const TokensMap& tokens, const std::string& ns,
+                              const std::string& name, const std::string& keyword_token, const Keywords& keywords){
+    if (!keywords.empty() && !tokens.count(keyword_token)){
+        throw std::runtime_error("Unknown keyword token '" + keyword_token + "'.");
+    }
+
+    // Tokens that only match their keyword are found through the keyword lookup instead
+    TokensMap scanned = tokens;
+    for (auto it = keywords.begin(); it != keywords.end(); ++it){
+        auto token = scanned.find(it->second);
+        if (token != scanned.end() && token->second.first == it->first){
+            scanned.erase(token);
+        }
+    }
+    const TokensDFA dfa(scanned);
+    const TokensDFA::Automaton& automaton = dfa.automaton_;
+
+    std::vector<std::string> symbols(dfa.symbols_);
+    for (auto it = keywords.begin(); it != keywords.end(); ++it){
+        if (std::find(symbols.begin(), symbols.end(), it->second) == symbols.end()){
+            symbols.push_back(it->second);
+        }
+    }
+    int keyword_index = -1;
+    if (!keywords.empty()){
+        keyword_index = std::find(symbols.begin(), symbols.end(), keyword_token) - symbols.begin();
+    }
+
+    out << "// Generated by generate_scanner() in lexer_gen.cpp. Do not edit." << std::endl << std::endl;
+    out << "#include \"lexer.h\"" << std::endl << std::endl;
+    out << "#include <cstring>" << std::endl << std::endl;
+
+    out << "static const char* const SYMBOLS[] = {" << std::endl;
+    for (const std::string& symbol : symbols){
+        out << "    " << string_literal(symbol) << "," << std::endl;
+    }
+    out << "};" << std::endl << std::endl;
+
+    for (std::size_t i = 0; i < dfa.lookahead_automata_.size(); ++i){
+        write_lookahead(out, i, dfa.lookahead_automata_[i].automaton);
+    }
+    if (!keywords.empty()){
+        write_keywords(out, keywords, symbols);
+    }
+
+    out << "static int match(const char* p, const char* end, std::size_t& length, "
+        << "const char* tail, const char* tail_end){" << std::endl;
+    out << "    const char* const begin = p;" << std::endl;
+    out << "    const char* const source_end = end;" << std::endl;
+    out << "    const char* const source_tail = tail;" << std::endl;
+    out << "    int found = -1;" << std::endl;
+    out << "    std::size_t consumed = 0;" << std::endl;
+    if (automaton.transitions.empty()){
+        out << "    goto done;" << std::endl;
+    }
+    else {
+        out << "    goto s0_next;" << std::endl << std::endl;
+    }
+
+    std::set<int> targets = targeted_states(automaton);
+    for (std::size_t state = 0; state < automaton.accepts.size(); ++state){
+        if (targets.count(static_cast<int>(state))){
+            out << "s" << state << ":" << std::endl;
+
+            const TokensDFA::Skip& skip = dfa.skips_[state];
+            if (skip.kind != TokensDFA::Skip::NONE){
+                out << "    if (p != end){" << std::endl;
+                out << "        const char* run_end = ";
+                if (skip.kind == TokensDFA::Skip::UNTIL_ANY){
+                    out << "lexing::scan::find_any(p, end, "
+                        << string_literal(std::string(skip.bytes, skip.num_bytes)) << ", " << skip.num_bytes << ");";
+                }
+                else {
+                    out << "lexing::scan::find_not(p, end, " << static_cast<int>(skip.bytes[0]) << ");";
+                }
+                out << std::endl;
+                out << "        consumed += run_end - p;" << std::endl;
+                out << "        p = run_end;" << std::endl;
+                out << "    }" << std::endl;
+            }
+
+            // The highest priority token accepted here whose lookahead (if any) passes
+            const std::vector<int>& accepts = automaton.accepts[state];
+            for (std::size_t i = 0; i < accepts.size(); ++i){
+                int pattern = accepts[i];
+                int lookahead = dfa.lookaheads_[pattern];
+                out << "    " << (i ? "else " : "");
+                if (lookahead >= 0){
+                    out << "if (" << (dfa.lookahead_automata_[lookahead].negated ? "!" : "")
+                        << "lookahead_" << lookahead << "(p, end, tail, tail_end))";
+                }
+                out << "{" << std::endl;
+                out << "        found = " << pattern << ";" << std::endl;
+                out << "        length = consumed;" << std::endl;
+                out << "    }" << std::endl;
+                if (lookahead < 0){
+                    break;
+                }
+            }
+        }
+        if (!state){
+            out << "s0_next:" << std::endl;
+        }
+        write_next_range(out, "goto done;");
+        write_switch(out, automaton, state, "s", "++p; ++consumed;", "goto done;");
+        out << std::endl;
+    }
+
+    out << "done:" << std::endl;
+    if (keyword_index >= 0){
+        out << "    if (found == " << keyword_index << "){" << std::endl;
+        out << "        found = keyword(begin, source_end, source_tail, length, found);" << std::endl;
+        out << "    }" << std::endl;
+    }
+    else {
+        out << "    (void)begin;" << std::endl;
+        out << "    (void)source_end;" << std::endl;
+        out << "    (void)source_tail;" << std::endl;
+    }
+    out << "    return found;" << std::endl;
+    out << "}" << std::endl << std::endl;
+
+    out << "namespace " << ns << " {" << std::endl;
+    out << "    extern const lexing::Scanner " << name << ";" << std::endl;
+    out << "    const lexing::Scanner " << name << " = {SYMBOLS, " << symbols.size() << ", "
+        << keyword_index << ", match};" << std::endl;
+    out << "}" << std::endl;
+}
@@ -0,0 +1,235 @@
+#include "lexer.h"
+
+#include <cctype>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LEXING_X86_SCANS
+#include <immintrin.h>
+#endif
+
+/**
+ * Scalar scans. These are also used for whatever is left over after the vectorized scans
+ * run out of whole blocks.
+ */
+static const char* find_any_scalar(const char* begin, const char* end, const char* bytes, std::size_t num_bytes){
+    for (const char* p = begin; p != end; ++p){
+        for (std::size_t i = 0; i < num_bytes; ++i){
+            if (*p == bytes[i]){
+                return p;
+            }
+        }
+    }
+    return end;
+}
+
+static const char* find_not_scalar(const char* begin, const char* end, char c){
+    const char* p = begin;
+    while (p != end && *p == c){
+        ++p;
+    }
+    return p;
+}
+
+static const char* skip_space_scalar(const char* begin, const char* end){
+    const char* p = begin;
+    while (p != end && std::isspace(static_cast<unsigned char>(*p))){
+        ++p;
+    }
+    return p;
+}
+
+#ifdef LEXING_X86_SCANS
+
+/**
+ * SSE2 scans over 16 bytes at a time. Each block is compared against the bytes searched for
+ * and the comparisons are turned into a bit mask whose lowest set bit is the first hit.
+ */
+__attribute__((target("sse2")))
+static const char* find_any_sse2(const char* begin, const char* end, const char* bytes, std::size_t num_bytes){
+    // Unused needles repeat the first one so they never change the result
+    const __m128i n0 = _mm_set1_epi8(bytes[0]);
+    const __m128i n1 = _mm_set1_epi8(bytes[num_bytes > 1 ? 1 : 0]);
+    const __m128i n2 = _mm_set1_epi8(bytes[num_bytes > 2 ? 2 : 0]);
+
+    const char* p = begin;
+    for (; end - p >= 16; p += 16){
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, n0), _mm_cmpeq_epi8(block, n1)),
+                                    _mm_cmpeq_epi8(block, n2));
+        int mask = _mm_movemask_epi8(hits);
+        if (mask){
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return find_any_scalar(p, end, bytes, num_bytes);
+}
+
+__attribute__((target("sse2")))
+static const char* find_not_sse2(const char* begin, const char* end, char c){
+    const __m128i needle = _mm_set1_epi8(c);
+
+    const char* p = begin;
+    for (; end - p >= 16; p += 16){
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)) & 0xffff;
+        if (mask){
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return find_not_scalar(p, end, c);
+}
+
+/**
+ * Whitespace is ' ' or any of '\t', '\n', '\v', '\f' and '\r', which are 9 to 13. Subtracting 9
+ * maps the latter to 0-4, and anything below 9 wraps around to a large unsigned byte.
+ */
+__attribute__((target("sse2")))
+static const char* skip_space_sse2(const char* begin, const char* end){
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i control_start = _mm_set1_epi8('\t');
+    const __m128i control_range = _mm_set1_epi8('\r' - '\t');
+
+    const char* p = begin;
+    for (; end - p >= 16; p += 16){
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i shifted = _mm_sub_epi8(block, control_start);
+        __m128i controls = _mm_cmpeq_epi8(_mm_min_epu8(shifted, control_range), shifted);
+        __m128i spaces = _mm_or_si128(_mm_cmpeq_epi8(block, space), controls);
+        int mask = ~_mm_movemask_epi8(spaces) & 0xffff;
+        if (mask){
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return skip_space_scalar(p, end);
+}
+
+/**
+ * Same as the SSE2 scans, but over 32 bytes at a time.
+ */
+__attribute__((target("avx2")))
+static const char* find_any_avx2(const char* begin, const char* end, const char* bytes, std::size_t num_bytes){
+    const __m256i n0 = _mm256_set1_epi8(bytes[0]);
+    const __m256i n1 = _mm256_set1_epi8(bytes[num_bytes > 1 ? 1 : 0]);
+    const __m256i n2 = _mm256_set1_epi8(bytes[num_bytes > 2 ? 2 : 0]);
+
+    const char* p = begin;
+    for (; end - p >= 32; p += 32){
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, n0), _mm256_cmpeq_epi8(block, n1)),
+                                       _mm256_cmpeq_epi8(block, n2));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(hits));
+        if (mask){
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return find_any_sse2(p, end, bytes, num_bytes);
+}
+
+__attribute__((target("avx2")))
+static const char* find_not_avx2(const char* begin, const char* end, char c){
+    const __m256i needle = _mm256_set1_epi8(c);
+
+    const char* p = begin;
+    for (; end - p >= 32; p += 32){
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)));
+        if (mask){
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return find_not_sse2(p, end, c);
+}
+
+__attribute__((target("avx2")))
+static const char* skip_space_avx2(const char* begin, const char* end){
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i control_start = _mm256_set1_epi8('\t');
+    const __m256i control_range = _mm256_set1_epi8('\r' - '\t');
+
+    const char* p = begin;
+    for (; end - p >= 32; p += 32){
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i shifted = _mm256_sub_epi8(block, control_start);
+        __m256i controls = _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, control_range), shifted);
+        __m256i spaces = _mm256_or_si256(_mm256_cmpeq_epi8(block, space), controls);
+        unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(spaces));
+        if (mask){
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return skip_space_sse2(p, end);
+}
+
+#endif
+
+/**
+ * The scans for the instruction set in use.
+ */
+struct ScanFunctions {
+    lexing::scan::InstructionSet instruction_set;
+    const char* (*find_any)(const char*, const char*, const char*, std::size_t);
+    const char* (*find_not)(const char*, const char*, char);
+    const char* (*skip_space)(const char*, const char*);
+};
+
+static ScanFunctions make_scan_functions(lexing::scan::InstructionSet instruction_set){
+    switch (instruction_set){
+#ifdef LEXING_X86_SCANS
+        case lexing::scan::AVX2:
+            return {instruction_set, find_any_avx2, find_not_avx2, skip_space_avx2};
+        case lexing::scan::SSE2:
+            return {instruction_set, find_any_sse2, find_not_sse2, skip_space_sse2};
+#endif
+        default:
+            return {lexing::scan::SCALAR, find_any_scalar, find_not_scalar, skip_space_scalar};
+    }
+}
+
+static ScanFunctions& scan_functions(){
+    static ScanFunctions functions = make_scan_functions(lexing::scan::best_instruction_set());
+    return functions;
+}
+
+/**
+ * Check the CPU for the widest instructions the scans can use.
+ */
+lexing::scan::InstructionSet lexing::scan::best_instruction_set(){
+#ifdef LEXING_X86_SCANS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")){
+        return AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")){
+        return SSE2;
+    }
+#endif
+    return SCALAR;
+}
+
+lexing::scan::InstructionSet lexing::scan::instruction_set(){
+    return scan_functions().instruction_set;
+}
+
+/**
+ * Use a different instruction set for the scans. Anything the CPU does not support falls back
+ * to the best one it does.
+ */
+void lexing::scan::set_instruction_set(InstructionSet instruction_set){
+    InstructionSet best = best_instruction_set();
+    scan_functions() = make_scan_functions(instruction_set > best ? best : instruction_set);
+}
+
+const char* lexing::scan::find_any(const char* begin, const char* end, const char* bytes, std::size_t num_bytes){
+    if (!num_bytes){
+        return end;
+    }
+    return scan_functions().find_any(begin, end, bytes, num_bytes);
+}
+
+const char* lexing::scan::find_not(const char* begin, const char* end, char c){
+    return scan_functions().find_not(begin, end, c);
+}
+
+const char* lexing::scan::skip_space(const char* begin, const char* end){
+    return scan_functions().skip_space(begin, end);
+}
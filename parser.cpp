@@ -1,4 +1,16 @@
 #include "parser.h"
+#include "ring_buffer.h"
+
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <thread>
 
 static char PRECEDENCE_OVERIDER = '%';
 
@@ -30,6 +42,13 @@ std::string parsing::ParseRule::str() const {
     return s.str();
 }
 
+/**
+ * Give back the only node.
+ */
+std::shared_ptr<void> parsing::pass_through(NodeSpan nodes){
+    return std::move(nodes[0]);
+}
+
 /**
  * Hashing for the ParseRule. Logic is borrowed from python 3.6's tuple hash.
  */ 
@@ -126,9 +145,8 @@ std::string parsing::action_str(const ParseInstr::Action& action){
  * Add a substitute rule that will act as the new top level rule
  */
 
-static std::shared_ptr<void> parse_prime(
-        std::vector<std::shared_ptr<void>>& args){
-    return args.front();
+static std::shared_ptr<void> parse_prime(parsing::NodeSpan args){
+    return args[0];
 }
 
 std::vector<parsing::ParseRule> parsing::prepend_prime_rule(std::vector<ParseRule> parse_rules){
@@ -172,17 +190,16 @@ void parsing::init_closure(LRItemSet& item_set, const std::vector<ParseRule>& pa
 
     std::size_t i = 0;
     while (i < item_set.size()){
-        const LRItem& item = item_set[i];
-        std::size_t pos = item.pos;  // dot position
-        std::vector<std::string> prod = item.parse_rule.production;  // production list
+        std::size_t pos = item_set[i].pos;  // dot position
+        const std::vector<std::string>& prod = item_set[i].parse_rule.production;  // production list
 
         // If we have not reached the end of a production
         if (pos < prod.size()){
-            std::string next_symbol = prod[pos];
+            // Copied since the item set may grow
+            const std::string next_symbol = prod[pos];
             
             // Find all productions that start with the next_symbol
-            // TODO: See if we can optomize this later
-            for (const ParseRule parse_rule : parse_rules){
+            for (const ParseRule& parse_rule : parse_rules){
                 if (next_symbol == parse_rule.rule){
                     LRItem next_item = {parse_rule, 0};
 
@@ -213,9 +230,9 @@ parsing::LRItemSet parsing::move_pos(const LRItemSet& item_set,
                                      const std::vector<ParseRule>& parse_rules){
     LRItemSet moved_item_set;
 
-    for (const LRItem lr_item : item_set){
-        ParseRule parse_rule = lr_item.parse_rule;
-        std::vector<std::string>& prod = parse_rule.production;
+    for (const LRItem& lr_item : item_set){
+        const ParseRule& parse_rule = lr_item.parse_rule;
+        const std::vector<std::string>& prod = parse_rule.production;
         std::size_t pos = lr_item.pos;
 
         if (pos < prod.size()){
@@ -232,6 +249,84 @@ parsing::LRItemSet parsing::move_pos(const LRItemSet& item_set,
     return moved_item_set;
 }
 
+/**
+ * Hash the items of the set in order.
+ */
+std::size_t parsing::LRItemIDSetHasher::operator()(const LRItemIDSet& item_set) const {
+    std::size_t hash = item_set.size();
+    for (const LRItemID& item : item_set){
+        hash = hash * 1000003 ^ (static_cast<std::size_t>(item.rule) << 16 ^ item.pos);
+    }
+    return hash;
+}
+
+parsing::InternedRules::InternedRules(const std::vector<ParseRule>& parse_rules):
+    productions_(parse_rules.size())
+{
+    auto intern = [this](const std::string& symbol){
+        auto inserted = symbol_ids_.insert({symbol, symbols_.size()});
+        if (inserted.second){
+            symbols_.push_back(symbol);
+            rules_by_symbol_.emplace_back();
+        }
+        return inserted.first->second;
+    };
+
+    std::unordered_set<ParseRule, ParseRuleHasher> found_rules;
+    for (std::size_t i = 0; i < parse_rules.size(); ++i){
+        std::size_t rule = intern(parse_rules[i].rule);
+        for (const std::string& symbol : parse_rules[i].production){
+            productions_[i].push_back(intern(symbol));
+        }
+        if (found_rules.insert(parse_rules[i]).second){
+            rules_by_symbol_[rule].push_back(i);
+        }
+    }
+}
+
+/**
+ * Same as init_closure, but only items at position 0 need to be checked for since those 
+ * are the only ones added.
+ */
+void parsing::InternedRules::closure(LRItemIDSet& item_set, std::vector<bool>& started) const {
+    for (const LRItemID& item : item_set){
+        if (!item.pos){
+            started[item.rule] = true;
+        }
+    }
+
+    for (std::size_t i = 0; i < item_set.size(); ++i){
+        std::size_t symbol = next_symbol(item_set[i]);
+        if (symbol == symbols_.size()){
+            continue;
+        }
+        for (std::uint32_t rule : rules_by_symbol_[symbol]){
+            if (!started[rule]){
+                started[rule] = true;
+                item_set.push_back({rule, 0});
+            }
+        }
+    }
+
+    for (const LRItemID& item : item_set){
+        if (!item.pos){
+            started[item.rule] = false;
+        }
+    }
+}
+
+/**
+ * Get the lr items the IDs refer to in the rules.
+ */
+parsing::LRItemSet parsing::make_item_set(const LRItemIDSet& item_ids, const std::vector<ParseRule>& parse_rules){
+    LRItemSet items;
+    items.reserve(item_ids.size());
+    for (const LRItemID& item : item_ids){
+        items.push_back({parse_rules[item.rule], item.pos});
+    }
+    return items;
+}
+
 /**
  * Create the canonical collections of the DFA.
  *
@@ -242,37 +337,204 @@ parsing::LRItemSet parsing::move_pos(const LRItemSet& item_set,
  *             C |= move_pos(item_set, X)
  * until C not changing
  * return C
+ *
+ * This is done on (rule, pos) pairs, and each item set is looked up by the items it was 
+ * moved to before taking the closure since the closure follows from them. The item sets
+ * come out the same and in the same order as doing this with init_closure and move_pos.
  */ 
 parsing::DFA parsing::make_dfa(const std::vector<ParseRule>& parse_rules){
-    const ParseRule& entry = parse_rules.front();
-    LRItemSet top_item_set = {{entry, 0}};
-    init_closure(top_item_set, parse_rules);
-    DFA dfa = {top_item_set};
+    Transitions transitions;
+    return make_dfa(parse_rules, transitions);
+}
+
+/**
+ * Also record the transitions between the item sets as they are found.
+ */
+parsing::DFA parsing::make_dfa(const std::vector<ParseRule>& parse_rules, Transitions& transitions,
+                               std::size_t num_threads){
+    const InternedRules rules(parse_rules);
+    std::vector<bool> started(rules.num_rules(), false);
+
+    DFA dfa;
+    std::vector<LRItemIDSet> kernels = make_kernels(rules, transitions, num_threads);
+    dfa.reserve(kernels.size());
+    for (LRItemIDSet& item_set : kernels){
+        rules.closure(item_set, started);
+        dfa.push_back(make_item_set(item_set, parse_rules));
+    }
+    return dfa;
+}
+
+/**
+ * The kernels an item set moves to on each symbol after its items, in the order the 
+ * symbols come up, with the hash of each kernel. Once the kernels are looked up, each
+ * is given the state it is, or NEW_KERNEL if no item set has it yet, and the kernels 
+ * found earlier in the same level point to the first one.
+ */
+struct KernelMoves {
+    std::vector<std::size_t> symbols;
+    std::vector<parsing::LRItemIDSet> kernels;
+    std::vector<std::size_t> hashes;
+    std::vector<std::size_t> states;
+    std::vector<const std::size_t*> same_as;
+};
 
-    std::unordered_set<LRItemSet, LRItemSetHasher> found_sets(dfa.begin(), dfa.end());
+static const std::size_t NEW_KERNEL = static_cast<std::size_t>(-1);
 
-    std::size_t i = 0;
-    while (i < dfa.size()){
-        const LRItemSet item_set = dfa[i];  // do copy since this item_set may be edited
-
-        for (const LRItem& lr_item : item_set){
-            std::vector<std::string> production = lr_item.parse_rule.production;
-            std::size_t pos = lr_item.pos;
-            if (pos < production.size()){
-                std::string next_symbol = production[pos];
-                LRItemSet moved_item_set = move_pos(item_set, next_symbol, parse_rules);
-
-                if (found_sets.find(moved_item_set) == found_sets.end()){
-                    dfa.push_back(moved_item_set);
-                    found_sets.insert(moved_item_set);
+static void move_items(const parsing::InternedRules& rules, const parsing::LRItemIDSet& item_set,
+                       std::vector<parsing::LRItemIDSet>& moved, KernelMoves& moves){
+    for (const parsing::LRItemID& item : item_set){
+        std::size_t symbol = rules.next_symbol(item);
+        if (symbol == rules.num_symbols()){
+            continue;
+        }
+        if (moved[symbol].empty()){
+            moves.symbols.push_back(symbol);
+        }
+        moved[symbol].push_back({item.rule, item.pos + 1});
+    }
+
+    parsing::LRItemIDSetHasher hasher;
+    for (std::size_t symbol : moves.symbols){
+        moves.hashes.push_back(hasher(moved[symbol]));
+        moves.kernels.push_back(std::move(moved[symbol]));
+        moved[symbol].clear();
+    }
+    moves.states.assign(moves.symbols.size(), NEW_KERNEL);
+    moves.same_as.assign(moves.symbols.size(), nullptr);
+}
+
+// The same from a kernel, taking its closure first
+static void find_moves(const parsing::InternedRules& rules, parsing::LRItemIDSet item_set,
+                       std::vector<bool>& started, std::vector<parsing::LRItemIDSet>& moved, 
+                       KernelMoves& moves){
+    rules.closure(item_set, started);
+    move_items(rules, item_set, moved, moves);
+}
+
+// A kernel first found in the current level, before it is numbered
+struct NewKernel {
+    const parsing::LRItemIDSet* kernel;
+    const std::size_t* state;
+};
+
+/**
+ * Find the kernel of each item set in the DFA, which are the items moved to from another 
+ * item set, or the first item for the first set. The closure of each item set is only 
+ * taken while finding the sets it moves to. 
+ *
+ * The item sets are found a level at a time on the same threads. The moves out of each set 
+ * in a level are found in parallel, then the kernels moved to are looked up in parallel 
+ * with the found sets split by hash between the threads. Only numbering the new sets is left
+ * to one thread, which does it in the order a single thread would have found them, so the 
+ * DFA is the same for any number of threads. 0 threads uses as many as the hardware has.
+ */
+std::vector<parsing::LRItemIDSet> parsing::make_kernels(const InternedRules& rules, Transitions& transitions,
+                                                        std::size_t num_threads){
+    if (!num_threads){
+        num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    WorkerThreads workers(num_threads);
+
+    // Item sets handed to a thread at a time
+    const std::size_t block_size = 16;
+
+    std::vector<LRItemIDSet> kernels = {{{0, 0}}};
+    transitions.assign(1, {});
+
+    // The states of the sets found so far by kernel hash, and the new kernels in this level
+    const std::size_t num_shards = num_threads;
+    std::vector<std::unordered_map<std::size_t, std::vector<std::size_t>>> found_sets(num_shards);
+    std::vector<std::unordered_map<std::size_t, std::vector<NewKernel>>> new_kernels(num_shards);
+    const std::size_t first_hash = LRItemIDSetHasher()(kernels.front());
+    found_sets[first_hash % num_shards][first_hash].push_back(0);
+
+    // Scratch space for each thread, made when the thread first needs it
+    std::vector<std::vector<bool>> started(num_threads);
+    std::vector<std::vector<LRItemIDSet>> moved(num_threads);
+
+    std::size_t level_start = 0;
+    while (level_start < kernels.size()){
+        const std::size_t level_end = kernels.size();
+        std::vector<KernelMoves> level_moves(level_end - level_start);
+
+        const std::size_t num_blocks = (level_moves.size() + block_size - 1) / block_size;
+        workers.run(num_blocks, [&](std::size_t block, std::size_t thread){
+            if (started[thread].empty()){
+                started[thread].assign(rules.num_rules(), false);
+                moved[thread].resize(rules.num_symbols());
+            }
+            std::size_t end = std::min(level_end, level_start + (block + 1) * block_size);
+            for (std::size_t i = level_start + block * block_size; i < end; ++i){
+                find_moves(rules, kernels[i], started[thread], moved[thread], level_moves[i - level_start]);
+            }
+        });
+
+        // Each shard goes over the moves in order, so the first of each new kernel comes first
+        workers.run(num_shards, [&](std::size_t shard, std::size_t){
+            std::unordered_map<std::size_t, std::vector<std::size_t>>& shard_found = found_sets[shard];
+            std::unordered_map<std::size_t, std::vector<NewKernel>>& shard_new = new_kernels[shard];
+            for (KernelMoves& moves : level_moves){
+                for (std::size_t j = 0; j < moves.symbols.size(); ++j){
+                    const std::size_t hash = moves.hashes[j];
+                    if (hash % num_shards != shard){
+                        continue;
+                    }
+                    const LRItemIDSet& kernel = moves.kernels[j];
+
+                    auto same_hash = shard_found.find(hash);
+                    if (same_hash != shard_found.end()){
+                        auto found = std::find_if(same_hash->second.begin(), same_hash->second.end(), 
+                                                  [&](std::size_t state){ return kernels[state] == kernel; });
+                        if (found != same_hash->second.end()){
+                            moves.states[j] = *found;
+                            continue;
+                        }
+                    }
+
+                    std::vector<NewKernel>& same_hash_new = shard_new[hash];
+                    auto found = std::find_if(same_hash_new.begin(), same_hash_new.end(), 
+                                              [&](const NewKernel& other){ return *other.kernel == kernel; });
+                    if (found != same_hash_new.end()){
+                        moves.same_as[j] = found->state;
+                    }
+                    else {
+                        same_hash_new.push_back({&kernel, &moves.states[j]});
+                    }
                 }
             }
+        });
+
+        for (std::size_t i = level_start; i < level_end; ++i){
+            KernelMoves& moves = level_moves[i - level_start];
+            transitions[i].reserve(moves.symbols.size());
+            for (std::size_t j = 0; j < moves.symbols.size(); ++j){
+                if (moves.same_as[j]){
+                    moves.states[j] = *moves.same_as[j];
+                }
+                else if (moves.states[j] == NEW_KERNEL){
+                    moves.states[j] = kernels.size();
+                    kernels.push_back(std::move(moves.kernels[j]));
+                    transitions.emplace_back();
+                }
+                transitions[i][rules.symbol(moves.symbols[j])] = moves.states[j];
+            }
         }
 
-        ++i;
+        // The new sets now have states
+        workers.run(num_shards, [&](std::size_t shard, std::size_t){
+            for (auto& same_hash : new_kernels[shard]){
+                std::vector<std::size_t>& states = found_sets[shard][same_hash.first];
+                for (const NewKernel& new_kernel : same_hash.second){
+                    states.push_back(*new_kernel.state);
+                }
+            }
+            new_kernels[shard].clear();
+        });
+        level_start = level_end;
     }
 
-    return dfa;
+    return kernels;
 }
 
 /**
@@ -295,6 +557,43 @@ parsing::PrecedenceTable parsing::make_precedence_table(const PrecedenceList& pr
 
 /********* Grammar **********/ 
 
+/**
+ * Set of symbols as bits indexed by their IDs. These are the firsts and follows sets, and 
+ * the LALR(1) and LR(1) lookaheads numbered by a TerminalIds.
+ */
+class TerminalSet {
+    private:
+        std::vector<std::uint64_t> words_;
+
+    public:
+        TerminalSet(){}
+        explicit TerminalSet(std::size_t num_terminals): words_((num_terminals + 63) / 64, 0){}
+
+        void insert(std::size_t terminal){ words_[terminal / 64] |= std::uint64_t(1) << (terminal % 64); }
+        bool contains(std::size_t terminal) const { return words_[terminal / 64] >> (terminal % 64) & 1; }
+
+        // Add the other set to this one, returning true if this set changed
+        bool add(const TerminalSet& other){
+            bool changed = false;
+            for (std::size_t i = 0; i < words_.size(); ++i){
+                std::uint64_t word = words_[i] | other.words_[i];
+                changed |= word != words_[i];
+                words_[i] = word;
+            }
+            return changed;
+        }
+
+        bool intersects(const TerminalSet& other) const {
+            for (std::size_t i = 0; i < words_.size(); ++i){
+                if (words_[i] & other.words_[i]){
+                    return true;
+                }
+            }
+            return false;
+        }
+};
+
+
 /**
  * A symbol is a terminal if it's in the tokens set.
  */
@@ -339,14 +638,14 @@ void parsing::Grammar::update_with_precedence(
         const ParseInstr& existing_instr,
         const ParseInstr& new_instr,
         const std::string& lookahead,
-        std::size_t state){
+        std::size_t state,
+        std::unordered_map<std::string, ParseInstr>& action_table,
+        std::vector<ParserConflict>& conflicts) const {
     // Check if both are the same first 
     if (existing_instr == new_instr){
         return;
     }
 
-    std::unordered_map<std::string, ParseInstr>& action_table = parse_table_[state];
-
     // Tterminal key for existing instr
     const std::string key_existing = token_for_instr(existing_instr, lookahead);
 
@@ -391,7 +690,7 @@ void parsing::Grammar::update_with_precedence(
             }
             else {
                 // Both are reduce. Cannot resolve this, so add it as a conflict.
-                conflicts_.push_back({
+                conflicts.push_back({
                     state,
                     existing_instr,
                     new_instr,
@@ -402,7 +701,7 @@ void parsing::Grammar::update_with_precedence(
     }
     else {
         // Conflict
-        conflicts_.push_back({
+        conflicts.push_back({
             state,
             existing_instr,
             new_instr,
@@ -450,47 +749,174 @@ std::string parsing::Grammar::rightmost_terminal(const std::vector<std::string>&
 }
 
 /**
- * Method for initially creating the firsts set for a nonterminal before memoizing.
+ * Find the firsts and follows sets of every symbol in the rules, and which can be empty.
+ *
+ * The firsts of a rule's nonterminal get the firsts of each symbol in the production up to
+ * and including the first that cannot be empty, and it can be empty if they all can. Rules 
+ * are checked again whenever a symbol in their production changes, until nothing does.
+ *
+ * Each symbol is followed by the firsts of everything after it in a production, and by 
+ * whatever follows the rule's nonterminal if everything after it can be empty. The second 
+ * part is passed along from each nonterminal until nothing changes.
+ *
+ * The sets are made once, by whichever thread first needs them.
  */
-std::unordered_set<std::string> parsing::Grammar::nonterminal_firsts(const std::string& symbol){
-    std::unordered_set<std::string> firsts_set;
+void parsing::Grammar::make_firsts_follows() const {
+    OnDemand& on_demand = *on_demand_;
+    if (on_demand.has_firsts_follows.load(std::memory_order_acquire)){
+        return;
+    }
+    std::lock_guard<std::mutex> lock(on_demand.mutex);
+    if (on_demand.has_firsts_follows.load(std::memory_order_relaxed)){
+        return;
+    }
 
-    for (const auto& parse_rule : parse_rules_){
-        const std::string& rule = parse_rule.rule;
-        const std::vector<std::string>& prod = parse_rule.production;
-        if (rule == symbol){
-            // For each production mapped to rule X 
-            // put firsts(Y1) - {e} into firsts(X)
-            std::unordered_set<std::string> diff(firsts(prod[0]));
-            if (diff.find(parsing::nonterminals::EPSILON) != diff.end()){
-                diff.erase(parsing::nonterminals::EPSILON);
-            }
-            firsts_set.insert(diff.begin(), diff.end());
-
-            // Check for epsilon in each symbol in the prod 
-            bool all_have_empty = true;
-            for (std::size_t i = 0; i < prod.size()-1; ++i){
-                const std::unordered_set<std::string> current_set = firsts(prod[i]);
-                if (current_set.find(parsing::nonterminals::EPSILON) != current_set.end()){
-                    std::unordered_set<std::string> next_set = firsts(prod[i+1]);
-                    if (next_set.find(parsing::nonterminals::EPSILON) != next_set.end()){
-                        next_set.erase(parsing::nonterminals::EPSILON);
-                    }
-                    firsts_set.insert(next_set.begin(), next_set.end());
-                }
-                else {
-                    all_have_empty = false;
+    const std::size_t num_symbols = rules_.num_symbols();
+    const std::size_t end = num_symbols;  // END is numbered after the other symbols
+    std::vector<TerminalSet> firsts(num_symbols, TerminalSet(num_symbols + 1));
+    std::vector<bool> nullable(num_symbols, false);
+
+    std::vector<std::vector<std::size_t>> rules_using(num_symbols);
+    std::vector<std::size_t> rule_symbols(parse_rules_.size());
+    for (std::size_t rule = 0; rule < parse_rules_.size(); ++rule){
+        rule_symbols[rule] = rules_.symbol_id(parse_rules_[rule].rule);
+        for (std::size_t symbol : rules_.production(rule)){
+            if (rules_using[symbol].empty() || rules_using[symbol].back() != rule){
+                rules_using[symbol].push_back(rule);
+            }
+        }
+    }
+    for (std::size_t symbol = 0; symbol < num_symbols; ++symbol){
+        if (is_terminal(rules_.symbol(symbol))){
+            firsts[symbol].insert(symbol);
+        }
+        else if (rules_.symbol(symbol) == nonterminals::EPSILON){
+            nullable[symbol] = true;
+        }
+    }
+
+    std::deque<std::size_t> worklist;
+    std::vector<bool> queued(parse_rules_.size(), true);
+    for (std::size_t rule = 0; rule < parse_rules_.size(); ++rule){
+        worklist.push_back(rule);
+    }
+    while (!worklist.empty()){
+        const std::size_t rule = worklist.front();
+        worklist.pop_front();
+        queued[rule] = false;
+
+        const std::size_t symbol = rule_symbols[rule];
+        bool changed = false;
+        bool all_nullable = true;
+        for (std::size_t next : rules_.production(rule)){
+            changed |= firsts[symbol].add(firsts[next]);
+            if (!nullable[next]){
+                all_nullable = false;
+                break;
+            }
+        }
+        if (all_nullable && !nullable[symbol]){
+            nullable[symbol] = true;
+            changed = true;
+        }
+
+        if (changed){
+            for (std::size_t user : rules_using[symbol]){
+                if (!queued[user]){
+                    worklist.push_back(user);
+                    queued[user] = true;
                 }
             }
-            // Check for last one having epsilon
-            const std::unordered_set<std::string> last_set = firsts(prod.back());
-            if (all_have_empty && last_set.find(parsing::nonterminals::EPSILON) != last_set.end()){
-                firsts_set.insert(parsing::nonterminals::EPSILON);
+        }
+    }
+
+    // Add the firsts of what comes after each symbol, and link the symbols at the ends of 
+    // productions to the rule's nonterminal
+    std::vector<TerminalSet> follows(num_symbols, TerminalSet(num_symbols + 1));
+    std::vector<std::vector<std::size_t>> followed_by(num_symbols);
+    follows[rules_.symbol_id(start_nonterminal_)].insert(end);
+    for (std::size_t rule = 0; rule < parse_rules_.size(); ++rule){
+        const std::vector<std::size_t>& prod = rules_.production(rule);
+        TerminalSet rest(num_symbols + 1);
+        bool rest_nullable = true;
+        for (std::size_t pos = prod.size(); pos > 0; --pos){
+            const std::size_t symbol = prod[pos - 1];
+            follows[symbol].add(rest);
+            if (rest_nullable){
+                followed_by[rule_symbols[rule]].push_back(symbol);
+            }
+            if (!nullable[symbol]){
+                rest = firsts[symbol];
+                rest_nullable = false;
+            }
+            else {
+                rest.add(firsts[symbol]);
+            }
+        }
+    }
+
+    for (std::size_t symbol = 0; symbol < num_symbols; ++symbol){
+        worklist.push_back(symbol);
+    }
+    queued.assign(num_symbols, true);
+    while (!worklist.empty()){
+        const std::size_t symbol = worklist.front();
+        worklist.pop_front();
+        queued[symbol] = false;
+        for (std::size_t next : followed_by[symbol]){
+            if (follows[next].add(follows[symbol]) && !queued[next]){
+                worklist.push_back(next);
+                queued[next] = true;
+            }
+        }
+    }
+
+    auto names = [&](const TerminalSet& set){
+        std::unordered_set<std::string> symbols;
+        for (std::size_t symbol = 0; symbol <= num_symbols; ++symbol){
+            if (set.contains(symbol)){
+                symbols.insert(symbol == end ? lexing::tokens::END : rules_.symbol(symbol));
             }
         }
+        return symbols;
+    };
+    for (std::size_t symbol = 0; symbol < num_symbols; ++symbol){
+        std::unordered_set<std::string>& symbol_firsts = on_demand.firsts_map[rules_.symbol(symbol)];
+        symbol_firsts = names(firsts[symbol]);
+        if (nullable[symbol]){
+            symbol_firsts.insert(nonterminals::EPSILON);
+        }
+        on_demand.follows_map[rules_.symbol(symbol)] = names(follows[symbol]);
+    }
+    on_demand.has_firsts_follows.store(true, std::memory_order_release);
+}
+
+/**
+ * The parse table is filled from the dense table for a grammar loaded from a cache. A 
+ * built grammar fills it as it builds the dense table.
+ */
+void parsing::Grammar::make_parse_table() const {
+    OnDemand& on_demand = *on_demand_;
+    if (on_demand.has_parse_table.load(std::memory_order_acquire)){
+        return;
+    }
+    std::lock_guard<std::mutex> lock(on_demand.mutex);
+    if (on_demand.has_parse_table.load(std::memory_order_relaxed)){
+        return;
     }
 
-    return firsts_set;
+    ParseTable& parse_table = on_demand.parse_table;
+    parse_table.reserve(dense_table_.num_states());
+    for (std::size_t state = 0; state < dense_table_.num_states(); ++state){
+        std::unordered_map<std::string, ParseInstr>& action_table = parse_table[state];
+        for (std::size_t symbol = 0; symbol < symbols_.size(); ++symbol){
+            PackedInstr packed = dense_table_.instr(state, symbol);
+            if (packed != NO_INSTR){
+                action_table[symbols_[symbol]] = unpack_instr(packed);
+            }
+        }
+    }
+    on_demand.has_parse_table.store(true, std::memory_order_release);
 }
 
 /**
@@ -499,273 +925,1577 @@ std::unordered_set<std::string> parsing::Grammar::nonterminal_firsts(const std::
  */
 parsing::Grammar::Grammar(const std::unordered_set<std::string>& tokens, 
                           const std::vector<ParseRule>& parse_rules, 
-                          const PrecedenceList& precedence):
+                          const PrecedenceList& precedence,
+                          TableConstruction construction,
+                          std::size_t num_threads,
+                          UnitRules unit_rules):
+    Grammar("", tokens, parse_rules, precedence, construction, num_threads, unit_rules){}
+
+parsing::Grammar::Grammar(const std::string& cache_file,
+                          const std::unordered_set<std::string>& tokens, 
+                          const std::vector<ParseRule>& parse_rules, 
+                          const PrecedenceList& precedence,
+                          TableConstruction construction,
+                          std::size_t num_threads,
+                          UnitRules unit_rules):
     tokens_(tokens), 
     parse_rules_with_overloads_(prepend_prime_rule(parse_rules)),
     parse_rules_(trim_overload_tokens(parse_rules_with_overloads_)), 
     start_nonterminal_(parse_rules_.front().rule),
     precedence_map_(make_precedence_table(precedence)),
-    dfa_(make_dfa(parse_rules_))
+    construction_(construction),
+    unit_rules_(unit_rules),
+    rules_(parse_rules_),
+    on_demand_(std::make_shared<OnDemand>())
 {
-    const ParseRule& top_parse_rule = parse_rules_.front();
-    parse_table_.reserve(dfa_.size());
-
-    std::unordered_map<LRItemSet, std::size_t, LRItemSetHasher> item_set_map;
-    item_set_map.reserve(dfa_.size());
-
-    // Map the production rules to the order in which they appear
-    std::unordered_map<ParseRule, std::size_t, ParseRuleHasher> parse_rule_map;
-    parse_rule_map.reserve(parse_rules_.size());
-    for (std::size_t i = 0; i < parse_rules_.size(); ++i){
-        parse_rule_map[parse_rules_[i]] = i;
+    if (construction_ != LAZY_SLR_TABLE && !cache_file.empty() && read_cache(cache_file)){
+        return;
     }
 
-    // Map the item_sets to their final indeces in the map 
-    for (std::size_t i = 0; i < dfa_.size(); ++i){
-        item_set_map[dfa_[i]] = i;
-
-        std::unordered_map<std::string, ParseInstr> action_map;
-        parse_table_[i] = action_map;
-    }
-
-    for (std::size_t i = 0; i < dfa_.size(); ++i){
-        const LRItemSet& item_set = dfa_[i];
-        for (const LRItem& lr_item : item_set){
-            const ParseRule& parse_rule = lr_item.parse_rule;
-            const std::vector<std::string>& prod = parse_rule.production;
-            const std::size_t& pos = lr_item.pos;
-            std::unordered_map<std::string, ParseInstr>& action_table = parse_table_[i];
-            if (pos < prod.size()){
-                // If A -> x . a y and GOTO(I_i, a) == I_j, then ACTION[i, a] = Shift j 
-                // If we have a rule where the symbol following the parser position is 
-                // a terminal, shift to the jth state which is equivalent to GOTO(I_i, a).
-                const std::string& next_symbol = prod[pos];
-                const LRItemSet I_j = move_pos(item_set, next_symbol, parse_rules_);
-                int j = item_set_map.at(I_j);
-
-                if (is_terminal(next_symbol)){
-                    // next_symbol is a token 
-                    auto existing_it = action_table.find(next_symbol);
-                    ParseInstr shift_instr = {parsing::ParseInstr::Action::SHIFT, j};
-                    if (existing_it != action_table.cend()){
-                        // Possible action conlfict. Check for precedence 
-                        update_with_precedence(existing_it->second, shift_instr, next_symbol, i);
-                    }
-                    else {
-                        // No conflict. Fill with shift
-                        action_table[next_symbol] = shift_instr;
-                    }
-                }
-                else {
-                    action_table[next_symbol] = {parsing::ParseInstr::Action::GOTO, j};
-                }
-            }
-            else {
-                if (parse_rule == top_parse_rule){
-                    // Finished whole module; cannot reduce further
-                    action_table[lexing::tokens::END] = {parsing::ParseInstr::Action::ACCEPT, 0};
-                }
-                else {
-                    // End of rule; Reduce 
-                    // If A -> a ., then ACTION[i, b] = Reduce A -> a for all terminals 
-                    // in B -> A . b where b is a terminal
-                    int rule_num = parse_rule_map.at(parse_rule);
-                    const std::string& rule = parse_rule.rule;
-                    ParseInstr instr = {parsing::ParseInstr::Action::REDUCE, rule_num};
-                    
-                    for (const std::string& follow : follows(rule)){
-                        if (action_table.find(follow) != action_table.cend()){
-                            // Possible conflict 
-                            update_with_precedence(action_table[follow], instr, follow, i);
-                        }
-                        else {
-                            action_table[follow] = instr;
-                        }
-                    }
-                }
-            }
+    make_firsts_follows();
+    if (construction_ == LAZY_SLR_TABLE){
+        init_lazy_states();
+    }
+    else {
+        build_table(num_threads);
+        if (!cache_file.empty()){
+            write_cache(cache_file);
         }
     }
-
-    assert(firsts_stack_.empty());
-    assert(follows_stack_.empty());
 }
 
 /**
- * Pretty print the parse table similar to how ply prints it.
+ * The number each rule reduces by. Rules that are the same reduce by the last of them.
  */
-void parsing::Grammar::dump(std::ostream& stream) const {
-    stream << "Grammar" << std::endl << std::endl;
-    for (std::size_t i = 0; i < parse_rules_with_overloads_.size(); ++i){
-        stream << "Rule " << i << ": " << parse_rules_with_overloads_[i].str() << std::endl;
-    }
-    stream << std::endl;
-
-    // States 
-    for (std::size_t i = 0; i < parse_table_.size(); ++i){
-        dump_state(i, stream);
+static std::vector<std::size_t> reduce_rule_nums(const std::vector<parsing::ParseRule>& parse_rules){
+    std::unordered_map<parsing::ParseRule, std::size_t, parsing::ParseRuleHasher> parse_rule_map;
+    parse_rule_map.reserve(parse_rules.size());
+    for (std::size_t i = 0; i < parse_rules.size(); ++i){
+        parse_rule_map[parse_rules[i]] = i;
     }
-    stream << std::endl;
-
-    // Conflicts  
-    stream << "Conflicts (" << conflicts_.size() << ")" << std::endl << std::endl;
-    for (const ParserConflict& conflict : conflicts_){
-        std::size_t state = conflict.state;
-        const ParseInstr& chosen = conflict.instr1;
-        const ParseInstr& other = conflict.instr2;
-        const std::string& lookahead = conflict.lookahead;
-
-        const ParseInstr::Action& act1 = chosen.action;
-        const ParseInstr::Action& act2 = other.action;
-        stream << action_str(act1) << "/" << action_str(act2) << " conflict in state " << state
-               << " (defaulting to " 
-               << action_str(act1) << ")" << std::endl;
-        stream << "- " << conflict_str(chosen, lookahead) << std::endl;
-        stream << "- " << conflict_str(other, lookahead) << std::endl;
+    std::vector<std::size_t> rule_nums(parse_rules.size());
+    for (std::size_t i = 0; i < parse_rules.size(); ++i){
+        rule_nums[i] = parse_rule_map.at(parse_rules[i]);
     }
+    return rule_nums;
 }
 
 /**
- * Dump a state in the grammar, the state being an LRItemSet.
+ * Find the states and fill the parse table for them.
  */
-void parsing::Grammar::dump_state(std::size_t state, std::ostream& stream) const {
-    stream << "state " << state << std::endl << std::endl;
+void parsing::Grammar::build_table(std::size_t num_threads){
+    const std::vector<std::size_t> rule_nums = reduce_rule_nums(parse_rules_);
 
-    // Print item sets
-    const LRItemSet& item_set = dfa_[state];
-    for (const LRItem& lr_item : item_set){
-        stream << "\t" << lr_item.str() << std::endl;
+    if (construction_ == LR1_TABLE){
+        make_lr1_states(rule_nums);
+    }
+    else {
+        kernels_ = make_kernels(rules_, transitions_, num_threads);
+        if (construction_ == LALR_TABLE){
+            make_lalr_lookaheads(rule_nums);
+        }
     }
-    stream << std::endl;
-
-    // Print parse instructions
-    const auto& action_map = parse_table_.at(state);
-    for (auto it = action_map.cbegin(); it != action_map.cend(); ++it){
-        const std::string& symbol = it->first;
-        const ParseInstr& instr = it->second;
-        const ParseInstr::Action& action = instr.action;
 
-        int val = instr.value;
-        stream << "\t" << symbol << "\t\t";
+    ParseTable& parse_table = on_demand_->parse_table;
+    parse_table.reserve(kernels_.size());
+    for (std::size_t i = 0; i < kernels_.size(); ++i){
+        std::unordered_map<std::string, ParseInstr> action_map;
+        parse_table[i] = action_map;
+    }
 
-        switch (action){
-            case ParseInstr::SHIFT:
-                stream << "shift and go to state ";
-                break;
-            case ParseInstr::REDUCE:
-                stream << "reduce using rule ";
-                break;
-            case ParseInstr::GOTO:
-                stream << "goto state ";
-                break;
-            case ParseInstr::ACCEPT:
-                stream << "accept ";
-                break;
-        }
-        stream << val << std::endl;
+    std::vector<bool> started(parse_rules_.size(), false);
+    LRItemIDSet item_set;
+    for (std::size_t i = 0; i < kernels_.size(); ++i){
+        item_set = kernels_[i];
+        rules_.closure(item_set, started);
+        fill_state(i, item_set, transitions_[i], rule_nums, parse_table[i], conflicts_);
     }
-    stream << std::endl;
+    if (unit_rules_ == ELIMINATE_UNIT_RULES){
+        eliminate_unit_rules();
+    }
+    on_demand_->has_parse_table = true;
+
+    number_symbols();
+    dense_table_ = DenseParseTable(parse_table, symbol_ids_);
+    compressed_table_ = CompressedParseTable(dense_table_, num_terminals_);
 }
 
 /**
- * The first and follow sets are found lazily, but memoized.
+ * Send everything that goes to a state that only reduces by a pass_through unit rule, 
+ * A -> B, to where the reduction would have gone instead, which is the GOTO on A from the
+ * same state. Chains of these rules are followed to their ends. The skipped states stay
+ * in the table, though nothing may go to them anymore.
+ *
+ * Everything a skipped state reduces on can follow A, and so can everything the state 
+ * after it acts on, so an error the skipped state would have found is still found there.
  */
-std::unordered_set<std::string> parsing::Grammar::firsts(const std::string& symbol){
-    if (firsts_map_.find(symbol) != firsts_map_.end()){
-        return firsts_map_[symbol];
-    }
-
-    if (is_terminal(symbol) || symbol == parsing::nonterminals::EPSILON){
-        firsts_map_[symbol] = {symbol};
-        return firsts_map_[symbol];
-    }
-    else {
-        if (firsts_stack_.find(symbol) == firsts_stack_.end()){
-            firsts_stack_.insert(symbol);
-            firsts_map_[symbol] = nonterminal_firsts(symbol);
-            firsts_stack_.erase(symbol);
-            return firsts_map_[symbol];
+void parsing::Grammar::eliminate_unit_rules(){
+    ParseTable& parse_table = on_demand_->parse_table;
+    std::vector<int> unit_reductions(parse_table.size(), -1);
+    for (std::size_t state = 0; state < parse_table.size(); ++state){
+        int rule = -1;
+        for (const auto& symbol_instr : parse_table.at(state)){
+            const ParseInstr& instr = symbol_instr.second;
+            if (instr.action != ParseInstr::REDUCE || (rule >= 0 && instr.value != rule)){
+                rule = -1;
+                break;
+            }
+            rule = instr.value;
         }
-        else {
-            std::unordered_set<std::string> s;
-            return s;
+        if (rule >= 0 && parse_rules_[rule].production.size() == 1 && parse_rules_[rule].callback == pass_through){
+            unit_reductions[state] = rule;
         }
     }
-}
 
-std::unordered_set<std::string> parsing::Grammar::follows(const std::string& symbol){
-    // If the symbol is already in the follows map, return it
-    if (follows_map_.find(symbol) != follows_map_.end()){
-        return follows_map_[symbol];
-    }
+    const ParseTable original = parse_table;
+    for (std::size_t state = 0; state < parse_table.size(); ++state){
+        const auto& original_actions = original.at(state);
+        for (auto& symbol_instr : parse_table.at(state)){
+            ParseInstr& instr = symbol_instr.second;
+            if (instr.action != ParseInstr::SHIFT && instr.action != ParseInstr::GOTO){
+                continue;
+            }
 
-    // Return nothing if we have already seen this symbol in a recursive call
-    if (follows_stack_.find(symbol) != follows_stack_.end()){
-        std::unordered_set<std::string> s;
-        return s;
+            // Rules that go in a cycle make conflicts, but stop anyway
+            for (std::size_t steps = 0; unit_reductions[instr.value] >= 0 && steps < original.size(); ++steps){
+                instr.value = original_actions.at(parse_rules_[unit_reductions[instr.value]].rule).value;
+            }
+        }
     }
+}
 
-    // Add for the first time
-    follows_stack_.insert(symbol);
-
-    // Initialize the set with the symbol if it is the starting nonterminal
-    std::unordered_set<std::string> follows_set;
-    if (symbol == start_nonterminal_){
-        follows_set.insert(lexing::tokens::END);
+/**
+ * Fill the instructions for a state from all of its items and the states it goes to on 
+ * each symbol. Conflicts not settled by precedence are added to the conflicts.
+ */
+void parsing::Grammar::fill_state(std::size_t state, const LRItemIDSet& item_set,
+                                  const std::unordered_map<std::string, std::size_t>& transitions,
+                                  const std::vector<std::size_t>& rule_nums,
+                                  std::unordered_map<std::string, ParseInstr>& action_table,
+                                  std::vector<ParserConflict>& conflicts) const {
+    for (const LRItemID& lr_item : item_set){
+        const ParseRule& parse_rule = parse_rules_[lr_item.rule];
+        const std::vector<std::string>& prod = parse_rule.production;
+        const std::size_t pos = lr_item.pos;
+        if (pos < prod.size()){
+            // If A -> x . a y and GOTO(I_i, a) == I_j, then ACTION[i, a] = Shift j 
+            // If we have a rule where the symbol following the parser position is 
+            // a terminal, shift to the jth state which is equivalent to GOTO(I_i, a).
+            const std::string& next_symbol = prod[pos];
+            int j = transitions.at(next_symbol);
+
+            if (is_terminal(next_symbol)){
+                // next_symbol is a token 
+                auto existing_it = action_table.find(next_symbol);
+                ParseInstr shift_instr = {parsing::ParseInstr::Action::SHIFT, j};
+                if (existing_it != action_table.cend()){
+                    // Possible action conlfict. Check for precedence 
+                    update_with_precedence(existing_it->second, shift_instr, next_symbol, state, action_table, conflicts);
+                }
+                else {
+                    // No conflict. Fill with shift
+                    action_table[next_symbol] = shift_instr;
+                }
+            }
+            else {
+                action_table[next_symbol] = {parsing::ParseInstr::Action::GOTO, j};
+            }
+        }
+        else {
+            if (lr_item.rule == 0){
+                // Finished whole module; cannot reduce further
+                action_table[lexing::tokens::END] = {parsing::ParseInstr::Action::ACCEPT, 0};
+            }
+            else {
+                // End of rule; Reduce 
+                // If A -> a ., then ACTION[i, b] = Reduce A -> a for all terminals 
+                // in B -> A . b where b is a terminal
+                int rule_num = rule_nums[lr_item.rule];
+                const std::string& rule = parse_rule.rule;
+                ParseInstr instr = {parsing::ParseInstr::Action::REDUCE, rule_num};
+
+                // SLR(1) tables reduce on anything that can follow the rule. The others
+                // only reduce on what can follow it from this state.
+                std::vector<std::string> lookaheads;
+                if (construction_ == SLR_TABLE || construction_ == LAZY_SLR_TABLE){
+                    const std::unordered_set<std::string> rule_follows = follows(rule);
+                    lookaheads.assign(rule_follows.begin(), rule_follows.end());
+                }
+                else {
+                    lookaheads = lookaheads_[state].at(rule_num);
+                }
+                
+                for (const std::string& follow : lookaheads){
+                    if (action_table.find(follow) != action_table.cend()){
+                        // Possible conflict 
+                        update_with_precedence(action_table[follow], instr, follow, state, action_table, conflicts);
+                    }
+                    else {
+                        action_table[follow] = instr;
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * The states of a LAZY_SLR_TABLE grammar found so far. Every state found has its kernel, 
+ * but only the states something has asked about have their instructions, with a row of 
+ * instructions indexed by symbol ID. Parsers on separate threads may share them.
+ *
+ * Everything is only used with the lock held, except for the rows of built states, which
+ * parsers read without it. The row of state s is published in chunk k at s + 1 - 2^k, 
+ * where 2^k <= s + 1 < 2^(k + 1), so a chunk never moves once it is made.
+ */
+class parsing::LazyStates {
+    private:
+        typedef std::atomic<const PackedInstr*> Slot;
+
+        std::atomic<Slot*> chunks_[64];
+        std::vector<std::unique_ptr<Slot[]>> chunk_storage_;
+        std::vector<std::unique_ptr<PackedInstr[]>> rows_;
+
+        static std::size_t chunk_of(std::size_t state){
+            return 63 - __builtin_clzll(static_cast<unsigned long long>(state) + 1);
+        }
+
+    public:
+        std::mutex mutex;
+        std::vector<std::size_t> rule_nums;
+        std::vector<LRItemIDSet> kernels;
+        std::unordered_map<std::size_t, std::vector<std::size_t>> found_sets;  // By kernel hash
+        std::vector<std::unordered_map<std::string, ParseInstr>> action_tables;
+        std::vector<ParserConflict> conflicts;
+
+        // Scratch space for building a state
+        std::vector<bool> started;
+        std::vector<LRItemIDSet> moved;
+
+        LazyStates(){
+            for (std::atomic<Slot*>& chunk : chunks_){
+                chunk.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        // The row of a state, or null if it is not built yet. Does not need the lock.
+        const PackedInstr* row(std::size_t state) const {
+            const std::size_t chunk = chunk_of(state);
+            const Slot* slots = chunks_[chunk].load(std::memory_order_acquire);
+            return slots ? slots[state + 1 - (std::size_t(1) << chunk)].load(std::memory_order_acquire) : nullptr;
+        }
+
+        // Make a built state's row readable. The lock must be held.
+        void publish(std::size_t state, std::unique_ptr<PackedInstr[]> row){
+            const std::size_t chunk = chunk_of(state);
+            Slot* slots = chunks_[chunk].load(std::memory_order_relaxed);
+            if (!slots){
+                const std::size_t size = std::size_t(1) << chunk;
+                chunk_storage_.emplace_back(new Slot[size]);
+                slots = chunk_storage_.back().get();
+                for (std::size_t i = 0; i < size; ++i){
+                    slots[i].store(nullptr, std::memory_order_relaxed);
+                }
+                chunks_[chunk].store(slots, std::memory_order_release);
+            }
+            slots[state + 1 - (std::size_t(1) << chunk)].store(row.get(), std::memory_order_release);
+            rows_.push_back(std::move(row));
+        }
+
+        std::size_t num_built() const { return rows_.size(); }
+};
+
+/**
+ * Start a lazy grammar with only the first state found and nothing built.
+ */
+void parsing::Grammar::init_lazy_states(){
+    lazy_states_ = std::make_shared<LazyStates>();
+    LazyStates& lazy = *lazy_states_;
+    lazy.rule_nums = reduce_rule_nums(parse_rules_);
+    lazy.kernels = {{{0, 0}}};
+    lazy.found_sets[LRItemIDSetHasher()(lazy.kernels.front())].push_back(0);
+    lazy.action_tables.resize(1);
+    lazy.started.assign(rules_.num_rules(), false);
+    lazy.moved.resize(rules_.num_symbols());
+
+    number_symbols();
+}
+
+/**
+ * Fill the instructions for a state of a lazy grammar, finding the states it goes to. This
+ * is the same as one step of make_kernels, so the states are the same as the SLR(1) ones,
+ * just numbered in the order they are reached. The lock must be held.
+ */
+void parsing::Grammar::build_lazy_state(std::size_t state) const {
+    LazyStates& lazy = *lazy_states_;
+    if (lazy.row(state)){
+        return;
+    }
+
+    LRItemIDSet item_set = lazy.kernels[state];
+    rules_.closure(item_set, lazy.started);
+    KernelMoves moves;
+    move_items(rules_, item_set, lazy.moved, moves);
+
+    std::unordered_map<std::string, std::size_t> transitions;
+    for (std::size_t i = 0; i < moves.symbols.size(); ++i){
+        std::vector<std::size_t>& same_hash = lazy.found_sets[moves.hashes[i]];
+        auto found = std::find_if(same_hash.begin(), same_hash.end(), [&](std::size_t other){
+            return lazy.kernels[other] == moves.kernels[i];
+        });
+
+        std::size_t next_state;
+        if (found == same_hash.end()){
+            next_state = lazy.kernels.size();
+            same_hash.push_back(next_state);
+            lazy.kernels.push_back(std::move(moves.kernels[i]));
+            lazy.action_tables.emplace_back();
+        }
+        else {
+            next_state = *found;
+        }
+        transitions[rules_.symbol(moves.symbols[i])] = next_state;
+    }
+
+    std::unordered_map<std::string, ParseInstr>& action_table = lazy.action_tables[state];
+    fill_state(state, item_set, transitions, lazy.rule_nums, action_table, lazy.conflicts);
+
+    std::unique_ptr<PackedInstr[]> row(new PackedInstr[symbols_.size()]);
+    std::fill(row.get(), row.get() + symbols_.size(), NO_INSTR);
+    for (const auto& symbol_instr : action_table){
+        row[symbol_ids_.at(symbol_instr.first)] = pack_instr(symbol_instr.second);
+    }
+    lazy.publish(state, std::move(row));
+}
+
+/**
+ * Built states are read without the lock, which is only taken to build a missing one.
+ */
+parsing::PackedInstr parsing::Grammar::lazy_instr(std::size_t state, int symbol) const {
+    const PackedInstr* row = lazy_states_->row(state);
+    if (!row){
+        std::lock_guard<std::mutex> lock(lazy_states_->mutex);
+        build_lazy_state(state);
+        row = lazy_states_->row(state);
+    }
+    return row[symbol];
+}
+
+std::size_t parsing::Grammar::num_lazy_states() const {
+    if (!lazy_states_){
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(lazy_states_->mutex);
+    return lazy_states_->num_built();
+}
+
+/**
+ * Give every symbol in the grammar an ID for indexing the dense table. Terminals come 
+ * first in sorted order so the numbering does not depend on hashing, then the nonterminals 
+ * in the order their rules first appear.
+ */
+void parsing::Grammar::number_symbols(){
+    std::vector<std::string> nonterminals;
+    std::unordered_set<std::string> seen;
+    for (const ParseRule& parse_rule : parse_rules_){
+        if (seen.insert(parse_rule.rule).second){
+            nonterminals.push_back(parse_rule.rule);
+        }
+    }
+
+    // Tokens the lexer does not declare, like END, only show up in the table. A lazy 
+    // grammar has no table yet, so they are taken from the rules instead.
+    std::unordered_set<std::string> terminals(tokens_);
+    if (lazy_states_){
+        terminals.insert(lexing::tokens::END);
+        for (const ParseRule& parse_rule : parse_rules_){
+            for (const std::string& symbol : parse_rule.production){
+                if (seen.find(symbol) == seen.end()){
+                    terminals.insert(symbol);
+                }
+            }
+        }
+    }
+    for (const auto& state_actions : on_demand_->parse_table){
+        for (const auto& symbol_instr : state_actions.second){
+            if (seen.find(symbol_instr.first) == seen.end()){
+                terminals.insert(symbol_instr.first);
+            }
+        }
+    }
+
+    symbols_.assign(terminals.begin(), terminals.end());
+    std::sort(symbols_.begin(), symbols_.end());
+    num_terminals_ = symbols_.size();
+    symbols_.insert(symbols_.end(), nonterminals.begin(), nonterminals.end());
+
+    symbol_ids_.reserve(symbols_.size());
+    for (std::size_t i = 0; i < symbols_.size(); ++i){
+        symbol_ids_[symbols_[i]] = i;
+    }
+}
+
+/**
+ * Numbers for the tokens and END in sorted order.
+ */
+class TerminalIds {
+    private:
+        std::vector<std::string> names_;
+        std::unordered_map<std::string, std::size_t> ids_;
+
+    public:
+        TerminalIds(const std::unordered_set<std::string>& tokens): names_(tokens.begin(), tokens.end()){
+            if (tokens.find(lexing::tokens::END) == tokens.end()){
+                names_.push_back(lexing::tokens::END);
+            }
+            std::sort(names_.begin(), names_.end());
+            for (std::size_t i = 0; i < names_.size(); ++i){
+                ids_[names_[i]] = i;
+            }
+        }
+
+        std::size_t size() const { return names_.size(); }
+        std::size_t id(const std::string& name) const { return ids_.at(name); }
+
+        std::vector<std::string> names(const TerminalSet& terminals) const {
+            std::vector<std::string> found;
+            for (std::size_t i = 0; i < names_.size(); ++i){
+                if (terminals.contains(i)){
+                    found.push_back(names_[i]);
+                }
+            }
+            return found;
+        }
+};
+
+/**
+ * The firsts set of every symbol used in the rules as a TerminalSet, and whether it can be empty.
+ */
+struct SymbolFirsts {
+    TerminalSet terminals;
+    bool nullable;
+};
+
+static std::unordered_map<std::string, SymbolFirsts> symbol_firsts(
+        const parsing::Grammar& grammar, const std::vector<parsing::ParseRule>& parse_rules, const TerminalIds& ids){
+    std::unordered_map<std::string, SymbolFirsts> symbol_firsts;
+    for (const parsing::ParseRule& parse_rule : parse_rules){
+        for (const std::string& symbol : parse_rule.production){
+            if (symbol_firsts.find(symbol) != symbol_firsts.end()){
+                continue;
+            }
+            SymbolFirsts& firsts = symbol_firsts[symbol];
+            firsts.terminals = TerminalSet(ids.size());
+            firsts.nullable = false;
+            for (const std::string& first : grammar.firsts(symbol)){
+                if (first == parsing::nonterminals::EPSILON){
+                    firsts.nullable = true;
+                }
+                else {
+                    firsts.terminals.insert(ids.id(first));
+                }
+            }
+        }
+    }
+    return symbol_firsts;
+}
+
+/**
+ * The indices of the rules for each nonterminal.
+ */
+static std::unordered_map<std::string, std::vector<std::size_t>> rules_by_nonterminal(
+        const std::vector<parsing::ParseRule>& parse_rules){
+    std::unordered_map<std::string, std::vector<std::size_t>> rules;
+    for (std::size_t i = 0; i < parse_rules.size(); ++i){
+        rules[parse_rules[i].rule].push_back(i);
+    }
+    return rules;
+}
+
+/**
+ * DeRemer and Pennello's digraph algorithm. Adds to each set the sets of everything it is 
+ * related to, directly or not, visiting each relation once. Sets in the same cycle end up equal.
+ */
+static void traverse(std::size_t x, const std::vector<std::vector<std::size_t>>& relation, 
+                     std::vector<TerminalSet>& sets, std::vector<std::size_t>& depths, 
+                     std::vector<std::size_t>& stack){
+    stack.push_back(x);
+    const std::size_t depth = stack.size();
+    depths[x] = depth;
+
+    for (std::size_t y : relation[x]){
+        if (!depths[y]){
+            traverse(y, relation, sets, depths, stack);
+        }
+        depths[x] = std::min(depths[x], depths[y]);
+        sets[x].add(sets[y]);
+    }
+
+    if (depths[x] == depth){
+        while (1){
+            std::size_t top = stack.back();
+            stack.pop_back();
+            depths[top] = SIZE_MAX;
+            if (top == x){
+                break;
+            }
+            sets[top] = sets[x];
+        }
+    }
+}
+
+static void digraph(const std::vector<std::vector<std::size_t>>& relation, std::vector<TerminalSet>& sets){
+    std::vector<std::size_t> depths(relation.size(), 0);
+    std::vector<std::size_t> stack;
+    for (std::size_t x = 0; x < relation.size(); ++x){
+        if (!depths[x]){
+            traverse(x, relation, sets, depths, stack);
+        }
+    }
+}
+
+/**
+ * Find the LALR(1) lookaheads of the LR(0) states as described in DeRemer and Pennello's
+ * "Efficient Computation of LALR(1) Look-Ahead Sets".
+ *
+ * For each transition (p, A) on a nonterminal:
+ * - DR(p, A) are the terminals shifted right after it.
+ * - (p, A) reads (r, C) if C can be empty and comes right after it.
+ * - (p, A) includes (p', B) if B -> x A y where y can be empty and p' goes to p on x.
+ * Read(p, A) is DR(p, A) plus the Read sets it reads, and Follow(p, A) is Read(p, A) plus 
+ * the Follow sets it includes. A state q that finishes A -> w reduces on the Follow sets of 
+ * the transitions (p, A) where p goes to q on w.
+ */
+void parsing::Grammar::make_lalr_lookaheads(const std::vector<std::size_t>& rule_nums){
+    const TerminalIds ids(tokens_);
+    const std::unordered_map<std::string, SymbolFirsts> firsts = symbol_firsts(*this, parse_rules_, ids);
+    const std::unordered_map<std::string, std::vector<std::size_t>> rules = rules_by_nonterminal(parse_rules_);
+    auto nullable = [&firsts](const std::string& symbol){
+        auto found = firsts.find(symbol);
+        return found != firsts.end() && found->second.nullable;
+    };
+
+    // Number the nonterminal transitions
+    std::vector<std::pair<std::size_t, std::string>> gotos;
+    std::vector<std::unordered_map<std::string, std::size_t>> goto_ids(kernels_.size());
+    for (std::size_t state = 0; state < kernels_.size(); ++state){
+        for (const auto& transition : transitions_[state]){
+            if (!is_terminal(transition.first)){
+                goto_ids[state][transition.first] = gotos.size();
+                gotos.push_back({state, transition.first});
+            }
+        }
+    }
+
+    // Direct reads and the reads relation
+    std::vector<TerminalSet> follow_sets(gotos.size(), TerminalSet(ids.size()));
+    std::vector<std::vector<std::size_t>> reads(gotos.size());
+    const std::string& start = parse_rules_.front().production.front();
+    for (std::size_t i = 0; i < gotos.size(); ++i){
+        std::size_t next_state = transitions_[gotos[i].first].at(gotos[i].second);
+        for (const auto& transition : transitions_[next_state]){
+            if (is_terminal(transition.first)){
+                follow_sets[i].insert(ids.id(transition.first));
+            }
+            else if (nullable(transition.first)){
+                reads[i].push_back(goto_ids[next_state].at(transition.first));
+            }
+        }
+
+        // The module is accepted on END
+        if (gotos[i].first == 0 && gotos[i].second == start){
+            follow_sets[i].insert(ids.id(lexing::tokens::END));
+        }
+    }
+    digraph(reads, follow_sets);
+
+    // Walk each rule from each state it starts in for the includes and lookback relations
+    std::vector<std::vector<std::size_t>> includes(gotos.size());
+    std::vector<std::unordered_map<std::size_t, std::vector<std::size_t>>> lookback(kernels_.size());
+    for (std::size_t i = 0; i < gotos.size(); ++i){
+        auto found = rules.find(gotos[i].second);
+        if (found == rules.end()){
+            continue;
+        }
+        for (std::size_t rule : found->second){
+            const std::vector<std::string>& prod = parse_rules_[rule].production;
+
+            // Whether everything after each position can be empty
+            std::vector<bool> nullable_after(prod.size(), true);
+            for (std::size_t pos = prod.size() - 1; pos > 0; --pos){
+                nullable_after[pos - 1] = nullable_after[pos] && nullable(prod[pos]);
+            }
+
+            std::size_t state = gotos[i].first;
+            for (std::size_t pos = 0; pos < prod.size(); ++pos){
+                if (!is_terminal(prod[pos]) && nullable_after[pos]){
+                    includes[goto_ids[state].at(prod[pos])].push_back(i);
+                }
+                state = transitions_[state].at(prod[pos]);
+            }
+            lookback[state][rule_nums[rule]].push_back(i);
+        }
+    }
+    digraph(includes, follow_sets);
+
+    lookaheads_.resize(kernels_.size());
+    for (std::size_t state = 0; state < kernels_.size(); ++state){
+        for (const auto& rule_gotos : lookback[state]){
+            TerminalSet lookaheads(ids.size());
+            for (std::size_t i : rule_gotos.second){
+                lookaheads.add(follow_sets[i]);
+            }
+            lookaheads_[state][rule_gotos.first] = ids.names(lookaheads);
+        }
+    }
+}
+
+/**
+ * A state in the LR(1) automaton. The kernel items are sorted by (rule, pos) so states 
+ * with the same items can be found by them.
+ */
+struct LR1State {
+    std::vector<std::pair<std::size_t, std::size_t>> kernel;
+    std::vector<TerminalSet> lookaheads;
+};
+
+/**
+ * Check if merging the lookaheads of two states with the same kernel could not make a 
+ * reduce/reduce conflict that neither had. This is Pager's weak compatibility: for any two 
+ * items, either their lookaheads cannot mix between the states, or they already overlap 
+ * in one of them.
+ */
+static bool weakly_compatible(const std::vector<TerminalSet>& a, const std::vector<TerminalSet>& b){
+    for (std::size_t i = 0; i < a.size(); ++i){
+        for (std::size_t j = i + 1; j < a.size(); ++j){
+            if ((a[i].intersects(b[j]) || a[j].intersects(b[i])) && 
+                    !a[i].intersects(a[j]) && !b[i].intersects(b[j])){
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Build the LR(1) states, merging each new state into an existing one with the same kernel 
+ * if they are weakly compatible. A state that gains lookaheads from a merge has its 
+ * successors built again to pass them on.
+ */
+void parsing::Grammar::make_lr1_states(const std::vector<std::size_t>& rule_nums){
+    const TerminalIds ids(tokens_);
+    const std::unordered_map<std::string, SymbolFirsts> firsts = symbol_firsts(*this, parse_rules_, ids);
+    const std::unordered_map<std::string, std::vector<std::size_t>> rules = rules_by_nonterminal(parse_rules_);
+
+    // Firsts of the rest of each production after each position, and whether that can be empty
+    std::vector<std::vector<TerminalSet>> firsts_after(parse_rules_.size());
+    std::vector<std::vector<bool>> nullable_after(parse_rules_.size());
+    for (std::size_t rule = 0; rule < parse_rules_.size(); ++rule){
+        const std::vector<std::string>& prod = parse_rules_[rule].production;
+        firsts_after[rule].assign(prod.size() + 1, TerminalSet(ids.size()));
+        nullable_after[rule].assign(prod.size() + 1, true);
+        for (std::size_t pos = prod.size(); pos > 0; --pos){
+            const SymbolFirsts& symbol = firsts.at(prod[pos - 1]);
+            firsts_after[rule][pos - 1] = symbol.terminals;
+            if (symbol.nullable){
+                firsts_after[rule][pos - 1].add(firsts_after[rule][pos]);
+            }
+            nullable_after[rule][pos - 1] = symbol.nullable && nullable_after[rule][pos];
+        }
+    }
+
+    // For A -> x . B y with lookaheads L, add B -> . z with lookaheads firsts(y), plus L 
+    // if y can be empty, until no lookaheads change
+    auto closure = [&](const LR1State& state, std::vector<std::pair<std::size_t, std::size_t>>& items,
+                       std::vector<TerminalSet>& lookaheads){
+        items = state.kernel;
+        lookaheads = state.lookaheads;
+        std::unordered_map<std::size_t, std::size_t> started;  // Items at position 0 by rule
+        for (std::size_t i = 0; i < items.size(); ++i){
+            if (!items[i].second){
+                started[items[i].first] = i;
+            }
+        }
+
+        bool changed = true;
+        while (changed){
+            changed = false;
+            for (std::size_t i = 0; i < items.size(); ++i){
+                const std::size_t rule = items[i].first, pos = items[i].second;
+                const std::vector<std::string>& prod = parse_rules_[rule].production;
+                auto found = pos < prod.size() ? rules.find(prod[pos]) : rules.end();
+                if (found == rules.end()){
+                    continue;
+                }
+
+                TerminalSet next_lookaheads = firsts_after[rule][pos + 1];
+                if (nullable_after[rule][pos + 1]){
+                    next_lookaheads.add(lookaheads[i]);
+                }
+                for (std::size_t next_rule : found->second){
+                    auto existing = started.find(next_rule);
+                    if (existing == started.end()){
+                        started[next_rule] = items.size();
+                        items.push_back({next_rule, 0});
+                        lookaheads.push_back(next_lookaheads);
+                    }
+                    else {
+                        changed |= lookaheads[existing->second].add(next_lookaheads);
+                    }
+                }
+            }
+        }
+    };
+
+    std::vector<LR1State> states;
+    std::map<std::vector<std::pair<std::size_t, std::size_t>>, std::vector<std::size_t>> kernels;
+    std::deque<std::size_t> worklist;
+    std::vector<bool> queued;
+
+    // Use the state that has the kernel and can take the lookaheads, or make a new one
+    auto add_state = [&](LR1State& state, std::size_t preferred){
+        std::vector<std::size_t>& candidates = kernels[state.kernel];
+        std::vector<std::size_t> order;
+        if (preferred != SIZE_MAX){
+            order.push_back(preferred);
+        }
+        order.insert(order.end(), candidates.begin(), candidates.end());
+
+        for (std::size_t candidate : order){
+            if (weakly_compatible(states[candidate].lookaheads, state.lookaheads)){
+                bool changed = false;
+                for (std::size_t i = 0; i < state.lookaheads.size(); ++i){
+                    changed |= states[candidate].lookaheads[i].add(state.lookaheads[i]);
+                }
+                if (changed && !queued[candidate]){
+                    worklist.push_back(candidate);
+                    queued[candidate] = true;
+                }
+                return candidate;
+            }
+        }
+
+        std::size_t added = states.size();
+        candidates.push_back(added);
+        states.push_back(state);
+        transitions_.emplace_back();
+        worklist.push_back(added);
+        queued.push_back(true);
+        return added;
+    };
+
+    LR1State start = {{{0, 0}}, {TerminalSet(ids.size())}};
+    start.lookaheads.front().insert(ids.id(lexing::tokens::END));
+    add_state(start, SIZE_MAX);
+
+    std::vector<std::pair<std::size_t, std::size_t>> items;
+    std::vector<TerminalSet> lookaheads;
+    while (!worklist.empty()){
+        const std::size_t state = worklist.front();
+        worklist.pop_front();
+        queued[state] = false;
+        closure(states[state], items, lookaheads);
+
+        // Advance past each symbol in the order the symbols appear
+        std::vector<std::string> symbols;
+        std::unordered_map<std::string, LR1State> successors;
+        for (std::size_t i = 0; i < items.size(); ++i){
+            const std::size_t rule = items[i].first, pos = items[i].second;
+            const std::vector<std::string>& prod = parse_rules_[rule].production;
+            if (pos == prod.size()){
+                continue;
+            }
+            if (successors.find(prod[pos]) == successors.end()){
+                symbols.push_back(prod[pos]);
+            }
+            LR1State& successor = successors[prod[pos]];
+            auto existing = std::find(successor.kernel.begin(), successor.kernel.end(), std::make_pair(rule, pos + 1));
+            if (existing == successor.kernel.end()){
+                successor.kernel.push_back({rule, pos + 1});
+                successor.lookaheads.push_back(lookaheads[i]);
+            }
+            else {
+                successor.lookaheads[existing - successor.kernel.begin()].add(lookaheads[i]);
+            }
+        }
+
+        for (const std::string& symbol : symbols){
+            const LR1State& unsorted = successors.at(symbol);
+            std::vector<std::size_t> order(unsorted.kernel.size());
+            for (std::size_t i = 0; i < order.size(); ++i){
+                order[i] = i;
+            }
+            std::sort(order.begin(), order.end(), [&unsorted](std::size_t a, std::size_t b){
+                return unsorted.kernel[a] < unsorted.kernel[b];
+            });
+            LR1State successor;
+            for (std::size_t i : order){
+                successor.kernel.push_back(unsorted.kernel[i]);
+                successor.lookaheads.push_back(unsorted.lookaheads[i]);
+            }
+
+            auto existing = transitions_[state].find(symbol);
+            std::size_t next_state = add_state(successor, existing == transitions_[state].end() ? SIZE_MAX : existing->second);
+            transitions_[state][symbol] = next_state;
+        }
+    }
+
+    // The kernel of each state and what it reduces on
+    kernels_.resize(states.size());
+    lookaheads_.resize(states.size());
+    for (std::size_t state = 0; state < states.size(); ++state){
+        for (const auto& item : states[state].kernel){
+            kernels_[state].push_back({static_cast<std::uint32_t>(item.first), static_cast<std::uint32_t>(item.second)});
+        }
+
+        closure(states[state], items, lookaheads);
+        std::map<std::size_t, TerminalSet> reductions;
+        for (std::size_t i = 0; i < items.size(); ++i){
+            const std::size_t rule = items[i].first, pos = items[i].second;
+            if (pos == parse_rules_[rule].production.size()){
+                auto inserted = reductions.insert({rule_nums[rule], lookaheads[i]});
+                if (!inserted.second){
+                    inserted.first->second.add(lookaheads[i]);
+                }
+            }
+        }
+        for (const auto& reduction : reductions){
+            lookaheads_[state][reduction.first] = ids.names(reduction.second);
+        }
+    }
+}
+
+/**
+ * Reading and writing the grammar cache. Values are stored as they are in memory, since the 
+ * cache is only read back by the same build on the same machine, and the magic number 
+ * catches files written with a different byte order.
+ */
+static const std::uint32_t CACHE_MAGIC = 0x4c524731;  // "LRG1"
+static const std::uint32_t CACHE_VERSION = 2;
+
+/**
+ * 64 bit FNV-1a hash.
+ */
+static std::uint64_t fnv_hash(const char* data, std::size_t size, std::uint64_t h=14695981039346656037ULL){
+    for (std::size_t i = 0; i < size; ++i){
+        h = (h ^ static_cast<unsigned char>(data[i])) * 1099511628211ULL;
+    }
+    return h;
+}
+
+/**
+ * FNV-1a over 8 bytes at a time for checking the body of a cache, which is read on every 
+ * load and is too large to hash one byte at a time.
+ */
+static std::uint64_t cache_checksum(const char* data, std::size_t size){
+    std::uint64_t h = 14695981039346656037ULL;
+    std::size_t i = 0;
+    for (; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t)){
+        std::uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        h = (h ^ word) * 1099511628211ULL;
+    }
+    return fnv_hash(data + i, size - i, h);
+}
+
+class parsing::CacheWriter {
+    private:
+        std::string data_;
+
+    public:
+        template <typename T>
+        void write(const T& value){
+            data_.append(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        template <typename T>
+        void write(const std::vector<T>& values){
+            write<std::uint64_t>(values.size());
+            data_.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+        }
+
+        // Table arrays are padded to be aligned for their type from the start of the data, 
+        // so a reader can point into them
+        template <typename T>
+        void write(const TableArray<T>& values){
+            write<std::uint64_t>(values.size());
+            data_.append((alignof(T) - data_.size() % alignof(T)) % alignof(T), '\0');
+            data_.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+        }
+
+        void write(const std::string& value){
+            write<std::uint64_t>(value.size());
+            data_.append(value);
+        }
+
+        const std::string& data() const { return data_; }
+};
+
+class parsing::CacheReader {
+    private:
+        const char* const begin_;
+        const char* pos_;
+        const char* const end_;
+        const std::shared_ptr<const void> owner_;  // Keeps the data table arrays point into alive
+
+        void check_remaining(std::size_t size) const {
+            if (static_cast<std::size_t>(end_ - pos_) < size){
+                throw std::runtime_error("Grammar cache is truncated");
+            }
+        }
+
+    public:
+        CacheReader(const char* begin, const char* end, const std::shared_ptr<const void>& owner=nullptr):
+            begin_(begin), pos_(begin), end_(end), owner_(owner){}
+
+        template <typename T>
+        T read(){
+            check_remaining(sizeof(T));
+            T value;
+            std::memcpy(&value, pos_, sizeof(T));
+            pos_ += sizeof(T);
+            return value;
+        }
+
+        template <typename T>
+        void read(std::vector<T>& values){
+            std::uint64_t size = read<std::uint64_t>();
+            check_remaining(size <= SIZE_MAX / sizeof(T) ? size * sizeof(T) : SIZE_MAX);
+            values.resize(size);
+            if (size){
+                std::memcpy(values.data(), pos_, size * sizeof(T));
+                pos_ += size * sizeof(T);
+            }
+        }
+
+        // Points into the data instead of copying it, unless the data is not aligned in memory
+        template <typename T>
+        void read(TableArray<T>& values){
+            std::uint64_t size = read<std::uint64_t>();
+            std::size_t padding = (alignof(T) - (pos_ - begin_) % alignof(T)) % alignof(T);
+            check_remaining(padding);
+            pos_ += padding;
+            check_remaining(size <= SIZE_MAX / sizeof(T) ? size * sizeof(T) : SIZE_MAX);
+            if (owner_ && reinterpret_cast<std::uintptr_t>(pos_) % alignof(T) == 0){
+                values = TableArray<T>(owner_, reinterpret_cast<const T*>(pos_), size);
+            }
+            else {
+                std::vector<T> copy(size);
+                if (size){
+                    std::memcpy(copy.data(), pos_, size * sizeof(T));
+                }
+                values = std::move(copy);
+            }
+            pos_ += size * sizeof(T);
+        }
+
+        std::string read_string(){
+            std::uint64_t size = read<std::uint64_t>();
+            check_remaining(size);
+            std::string value(pos_, size);
+            pos_ += size;
+            return value;
+        }
+
+        const char* pos() const { return pos_; }
+        std::size_t remaining() const { return end_ - pos_; }
+};
+
+/**
+ * The nonterminal and production of each rule, which is all of a rule that is hashed.
+ */
+static void write_rules(parsing::CacheWriter& key, std::vector<parsing::ParseRule>::const_iterator begin, 
+                        std::vector<parsing::ParseRule>::const_iterator end){
+    for (auto it = begin; it != end; ++it){
+        key.write(it->rule);
+        key.write<std::uint64_t>(it->production.size());
+        for (const std::string& symbol : it->production){
+            key.write(symbol);
+        }
+
+        // Tables without unit rules depend on which ones pass through
+        key.write<std::uint8_t>(it->callback == parsing::pass_through);
+    }
+}
+
+std::uint64_t parsing::Grammar::hash() const {
+    CacheWriter key;
+    key.write(CACHE_VERSION);
+    key.write(static_cast<std::uint32_t>(construction_));
+    key.write(static_cast<std::uint32_t>(unit_rules_));
+
+    std::vector<std::string> tokens(tokens_.begin(), tokens_.end());
+    std::sort(tokens.begin(), tokens.end());
+    key.write<std::uint64_t>(tokens.size());
+    for (const std::string& token : tokens){
+        key.write(token);
+    }
+
+    key.write<std::uint64_t>(parse_rules_with_overloads_.size());
+    write_rules(key, parse_rules_with_overloads_.begin(), parse_rules_with_overloads_.end());
+
+    std::map<std::string, std::pair<std::size_t, Associativity>> precedence(precedence_map_.begin(), precedence_map_.end());
+    key.write<std::uint64_t>(precedence.size());
+    for (const auto& symbol_precedence : precedence){
+        key.write(symbol_precedence.first);
+        key.write<std::uint64_t>(symbol_precedence.second.first);
+        key.write<std::uint32_t>(symbol_precedence.second.second);
+    }
+
+    return fnv_hash(key.data().data(), key.data().size());
+}
+
+static std::uint64_t hash_rule_range(std::vector<parsing::ParseRule>::const_iterator begin, 
+                                     std::vector<parsing::ParseRule>::const_iterator end){
+    parsing::CacheWriter key;
+    write_rules(key, begin, end);
+    return fnv_hash(key.data().data(), key.data().size());
+}
+
+std::uint64_t parsing::hash_rules(const std::vector<ParseRule>& parse_rules){
+    return hash_rule_range(parse_rules.begin(), parse_rules.end());
+}
+
+/**
+ * Leaves out the prime rule the grammar added to the front.
+ */
+std::uint64_t parsing::Grammar::rules_hash() const {
+    return hash_rule_range(parse_rules_with_overloads_.begin() + 1, parse_rules_with_overloads_.end());
+}
+
+/**
+ * Load the kernels, symbols, tables and conflicts from a cache file, returning false if there 
+ * is no cache for this grammar in the file. The tables point into the mapped file, which they 
+ * keep open.
+ */
+bool parsing::Grammar::read_cache(const std::string& cache_file){
+    std::shared_ptr<const lexing::SourceBuffer> buffer;
+    try {
+        buffer = lexing::SourceBuffer::from_file(cache_file);
+    } catch (const std::runtime_error&){
+        return false;
+    }
+
+    try {
+        CacheReader header(buffer->data(), buffer->data() + buffer->size());
+        if (header.read<std::uint32_t>() != CACHE_MAGIC || 
+                header.read<std::uint32_t>() != CACHE_VERSION || 
+                header.read<std::uint64_t>() != hash()){
+            return false;
+        }
+        std::uint64_t checksum = header.read<std::uint64_t>();
+        if (cache_checksum(header.pos(), header.remaining()) != checksum){
+            return false;
+        }
+
+        CacheReader reader(header.pos(), header.pos() + header.remaining(), buffer);
+        kernels_.resize(reader.read<std::uint64_t>());
+        for (LRItemIDSet& kernel : kernels_){
+            reader.read(kernel);
+        }
+
+        symbols_.resize(reader.read<std::uint64_t>());
+        for (std::string& symbol : symbols_){
+            symbol = reader.read_string();
+        }
+        num_terminals_ = reader.read<std::uint64_t>();
+        dense_table_.read(reader);
+        compressed_table_.read(reader);
+
+        conflicts_.resize(reader.read<std::uint64_t>());
+        for (ParserConflict& conflict : conflicts_){
+            conflict.state = reader.read<std::uint64_t>();
+            conflict.instr1 = unpack_instr(reader.read<PackedInstr>());
+            conflict.instr2 = unpack_instr(reader.read<PackedInstr>());
+            conflict.lookahead = reader.read_string();
+        }
+
+        if (reader.remaining() || dense_table_.num_symbols() != symbols_.size() || 
+                dense_table_.num_states() != kernels_.size()){
+            throw std::runtime_error("Grammar cache does not match its tables");
+        }
+    } catch (const std::runtime_error&){
+        kernels_.clear();
+        symbols_.clear();
+        conflicts_.clear();
+        return false;
+    }
+
+    symbol_ids_.reserve(symbols_.size());
+    for (std::size_t i = 0; i < symbols_.size(); ++i){
+        symbol_ids_[symbols_[i]] = i;
+    }
+
+    cached_ = true;
+    return true;
+}
+
+/**
+ * Save the tables to the cache file. The file is written under another name first and 
+ * moved into place, so other processes never load half of it. The cache is only there 
+ * to save time, so failing to write it is not an error.
+ */
+void parsing::Grammar::write_cache(const std::string& cache_file) const {
+    CacheWriter writer;
+    writer.write<std::uint64_t>(kernels_.size());
+    for (const LRItemIDSet& kernel : kernels_){
+        writer.write(kernel);
+    }
+
+    writer.write<std::uint64_t>(symbols_.size());
+    for (const std::string& symbol : symbols_){
+        writer.write(symbol);
+    }
+    writer.write<std::uint64_t>(num_terminals_);
+    dense_table_.write(writer);
+    compressed_table_.write(writer);
+
+    writer.write<std::uint64_t>(conflicts_.size());
+    for (const ParserConflict& conflict : conflicts_){
+        writer.write<std::uint64_t>(conflict.state);
+        writer.write(pack_instr(conflict.instr1));
+        writer.write(pack_instr(conflict.instr2));
+        writer.write(conflict.lookahead);
+    }
+
+    CacheWriter header;
+    header.write(CACHE_MAGIC);
+    header.write(CACHE_VERSION);
+    header.write(hash());
+    header.write(cache_checksum(writer.data().data(), writer.data().size()));
+
+    const std::string tmp_file = cache_file + ".tmp" + std::to_string(getpid());
+    std::ofstream out(tmp_file, std::ios::binary);
+    out << header.data() << writer.data();
+    out.close();
+    if (!out || std::rename(tmp_file.c_str(), cache_file.c_str())){
+        std::remove(tmp_file.c_str());
+    }
+}
+
+/**
+ * Pretty print the parse table similar to how ply prints it.
+ */
+void parsing::Grammar::dump(std::ostream& stream) const {
+    stream << "Grammar" << std::endl << std::endl;
+    for (std::size_t i = 0; i < parse_rules_with_overloads_.size(); ++i){
+        stream << "Rule " << i << ": " << parse_rules_with_overloads_[i].str() << std::endl;
+    }
+    stream << std::endl;
+
+    // States 
+    for (std::size_t i = 0; i < parse_table().size(); ++i){
+        dump_state(i, stream);
+    }
+    stream << std::endl;
+
+    // Conflicts  
+    const std::vector<ParserConflict> found_conflicts = conflicts();
+    stream << "Conflicts (" << found_conflicts.size() << ")" << std::endl << std::endl;
+    for (const ParserConflict& conflict : found_conflicts){
+        std::size_t state = conflict.state;
+        const ParseInstr& chosen = conflict.instr1;
+        const ParseInstr& other = conflict.instr2;
+        const std::string& lookahead = conflict.lookahead;
+
+        const ParseInstr::Action& act1 = chosen.action;
+        const ParseInstr::Action& act2 = other.action;
+        stream << action_str(act1) << "/" << action_str(act2) << " conflict in state " << state
+               << " (defaulting to " 
+               << action_str(act1) << ")" << std::endl;
+        stream << "- " << conflict_str(chosen, lookahead) << std::endl;
+        stream << "- " << conflict_str(other, lookahead) << std::endl;
+    }
+}
+
+/**
+ * All the items in a state.
+ */
+parsing::LRItemIDSet parsing::Grammar::closure(std::size_t state) const {
+    std::vector<bool> started(parse_rules_.size(), false);
+    LRItemIDSet item_set = kernels_[state];
+    rules_.closure(item_set, started);
+    return item_set;
+}
+
+/**
+ * Dump a state in the grammar, the state being an LRItemSet.
+ */
+void parsing::Grammar::dump_state(std::size_t state, std::ostream& stream) const {
+    stream << "state " << state << std::endl << std::endl;
+    dump_items(state, stream);
+    stream << std::endl;
+
+    // Print parse instructions. A lazy grammar has built the state to list its items.
+    std::unordered_map<std::string, ParseInstr> action_map;
+    if (lazy_states_){
+        std::lock_guard<std::mutex> lock(lazy_states_->mutex);
+        action_map = lazy_states_->action_tables[state];
+    }
+    else {
+        action_map = parse_table().at(state);
+    }
+    for (auto it = action_map.cbegin(); it != action_map.cend(); ++it){
+        const std::string& symbol = it->first;
+        const ParseInstr& instr = it->second;
+        const ParseInstr::Action& action = instr.action;
+
+        int val = instr.value;
+        stream << "\t" << symbol << "\t\t";
+
+        switch (action){
+            case ParseInstr::SHIFT:
+                stream << "shift and go to state ";
+                break;
+            case ParseInstr::REDUCE:
+                stream << "reduce using rule ";
+                break;
+            case ParseInstr::GOTO:
+                stream << "goto state ";
+                break;
+            case ParseInstr::ACCEPT:
+                stream << "accept ";
+                break;
+        }
+        stream << val << std::endl;
+    }
+    stream << std::endl;
+}
+
+/**
+ * The items in a state, one to a line.
+ */
+void parsing::Grammar::dump_items(std::size_t state, std::ostream& stream) const {
+    // A lazy grammar builds the state if nothing has reached it yet
+    LRItemIDSet item_ids;
+    if (lazy_states_){
+        std::lock_guard<std::mutex> lock(lazy_states_->mutex);
+        build_lazy_state(state);
+        item_ids = lazy_states_->kernels[state];
+        rules_.closure(item_ids, lazy_states_->started);
+    }
+    else {
+        item_ids = closure(state);
+    }
+
+    const LRItemSet item_set = make_item_set(item_ids, parse_rules_);
+    for (const LRItem& lr_item : item_set){
+        stream << "\t" << lr_item.str() << std::endl;
     }
+}
 
-    // Find the productions with this symbol on the RHS 
-    for (const auto& parse_rule : parse_rules_){
-        // For each rule and production
-        const std::string& rule = parse_rule.rule;
-        const std::vector<std::string>& prod = parse_rule.production;
+/**
+ * The firsts set of a symbol. Tokens not in the rules are their own firsts set.
+ */
+std::unordered_set<std::string> parsing::Grammar::firsts(const std::string& symbol) const {
+    const std::unordered_map<std::string, std::unordered_set<std::string>>& firsts_map = firsts();
+    auto found = firsts_map.find(symbol);
+    if (found != firsts_map.end()){
+        return found->second;
+    }
+    if (is_terminal(symbol) || symbol == parsing::nonterminals::EPSILON){
+        return {symbol};
+    }
+    return {};
+}
 
-        // Check for other symbols that follow this one in a production
-        for (std::size_t i = 0; i < prod.size()-1; ++i){
-            if (prod[i] == symbol){
-                const std::unordered_set<std::string> next_set = firsts(prod[i+1]);
-                std::unordered_set<std::string> next_without_eps(next_set);
-                if (next_without_eps.find(parsing::nonterminals::EPSILON) != next_without_eps.end()){
-                    next_without_eps.erase(parsing::nonterminals::EPSILON);
-                }
+std::unordered_set<std::string> parsing::Grammar::follows(const std::string& symbol) const {
+    const std::unordered_map<std::string, std::unordered_set<std::string>>& follows_map = follows();
+    auto found = follows_map.find(symbol);
+    if (found != follows_map.end()){
+        return found->second;
+    }
+    return {};
+}
 
-                // Add to the follows set 
-                // follows_set |= self.firsts(prod[i+1]) - {EPSILON}
-                follows_set.insert(next_without_eps.begin(), next_without_eps.end());
 
-                // Add follows of this rule if the firsts contains epsilon
-                // if EPSILON in self.firsts(prod[i+1)
-                if (next_set.find(parsing::nonterminals::EPSILON) != next_set.end()){
-                    // follows_set |= self.follows(rule)
-                    std::unordered_set<std::string> rule_follows = follows(rule);
-                    follows_set.insert(rule_follows.begin(), rule_follows.end());
-                }
+/**
+ * Grammar getters
+ */
+const parsing::ParseTable& parsing::Grammar::parse_table() const { 
+    make_parse_table();
+    return on_demand_->parse_table; 
+}
+parsing::TableConstruction parsing::Grammar::construction() const { return construction_; }
+parsing::UnitRules parsing::Grammar::unit_rules() const { return unit_rules_; }
+const std::vector<parsing::ParseRule>& parsing::Grammar::parse_rules() const { return parse_rules_; }
+
+/**
+ * A lazy grammar only has the conflicts in the states built so far.
+ */
+std::vector<parsing::ParserConflict> parsing::Grammar::conflicts() const {
+    if (lazy_states_){
+        std::lock_guard<std::mutex> lock(lazy_states_->mutex);
+        return lazy_states_->conflicts;
+    }
+    return conflicts_;
+}
+
+const std::unordered_map<std::string, std::unordered_set<std::string>>& parsing::Grammar::firsts() const { 
+    make_firsts_follows();
+    return on_demand_->firsts_map; 
+}
+const std::unordered_map<std::string, std::unordered_set<std::string>>& parsing::Grammar::follows() const { 
+    make_firsts_follows();
+    return on_demand_->follows_map; 
+}
+const parsing::DenseParseTable& parsing::Grammar::dense_table() const { return dense_table_; }
+const parsing::CompressedParseTable& parsing::Grammar::compressed_table() const { return compressed_table_; }
+const std::vector<std::string>& parsing::Grammar::symbols() const { return symbols_; }
+std::size_t parsing::Grammar::num_terminals() const { return num_terminals_; }
+bool parsing::Grammar::cached() const { return cached_; }
+
+int parsing::Grammar::symbol_id(const std::string& symbol) const {
+    auto found = symbol_ids_.find(symbol);
+    return found == symbol_ids_.end() ? -1 : found->second;
+}
+
+
+/**************** DenseParseTable ************/ 
+
+parsing::DenseParseTable::DenseParseTable(const ParseTable& parse_table, 
+                                          const std::unordered_map<std::string, int>& symbol_ids):
+    num_symbols_(symbol_ids.size())
+{
+    std::vector<PackedInstr> instrs(parse_table.size() * num_symbols_, NO_INSTR);
+    for (const auto& state_actions : parse_table){
+        PackedInstr* row = &instrs[state_actions.first * num_symbols_];
+        for (const auto& symbol_instr : state_actions.second){
+            row[symbol_ids.at(symbol_instr.first)] = pack_instr(symbol_instr.second);
+        }
+    }
+    instrs_ = std::move(instrs);
+}
+
+void parsing::DenseParseTable::write(CacheWriter& writer) const {
+    writer.write<std::uint64_t>(num_symbols_);
+    writer.write(instrs_);
+}
+
+void parsing::DenseParseTable::read(CacheReader& reader){
+    num_symbols_ = reader.read<std::uint64_t>();
+    reader.read(instrs_);
+}
+
+
+/**************** CompressedParseTable ************/ 
+
+/**
+ * Pick the most common value, preferring the smallest on a tie so the table does not 
+ * depend on hashing. Returns the fallback if there are no values.
+ */
+static std::uint32_t most_common(const std::vector<std::uint32_t>& values, std::uint32_t fallback){
+    std::unordered_map<std::uint32_t, std::size_t> counts;
+    for (std::uint32_t value : values){
+        ++counts[value];
+    }
+    std::uint32_t best = fallback;
+    std::size_t best_count = 0;
+    for (const auto& value_count : counts){
+        if (value_count.second > best_count || 
+                (value_count.second == best_count && value_count.first < best)){
+            best = value_count.first;
+            best_count = value_count.second;
+        }
+    }
+    return best;
+}
+
+parsing::CompressedParseTable::CompressedParseTable(const DenseParseTable& dense, std::size_t num_terminals):
+    num_terminals_(num_terminals)
+{
+    const std::size_t num_states = dense.num_states();
+    const std::size_t num_nonterminals = dense.num_symbols() - num_terminals;
+
+    // Drop the default reduction from each row, leaving the columns of what remains
+    std::vector<PackedInstr> default_reductions(num_states, NO_INSTR);
+    std::vector<std::vector<PackedInstr>> columns(num_terminals, std::vector<PackedInstr>(num_states, NO_INSTR));
+    for (std::size_t state = 0; state < num_states; ++state){
+        std::vector<PackedInstr> reductions;
+        for (std::size_t symbol = 0; symbol < num_terminals; ++symbol){
+            PackedInstr instr = dense.instr(state, symbol);
+            if (instr != NO_INSTR && unpack_instr(instr).action == ParseInstr::REDUCE){
+                reductions.push_back(instr);
             }
         }
-        if (prod.back() == symbol){
-            // Add the follows(rule) if this symbol is the last one in the production
-            std::unordered_set<std::string> rule_follows = follows(rule);
-            follows_set.insert(rule_follows.begin(), rule_follows.end());
+        PackedInstr default_reduction = most_common(reductions, NO_INSTR);
+        default_reductions[state] = default_reduction;
+
+        for (std::size_t symbol = 0; symbol < num_terminals; ++symbol){
+            PackedInstr instr = dense.instr(state, symbol);
+            if (instr != default_reduction){
+                columns[symbol][state] = instr;
+            }
+        }
+    }
+
+    // Terminals with identical columns share a class
+    std::map<std::vector<PackedInstr>, int> classes;
+    std::vector<const std::vector<PackedInstr>*> class_columns;
+    std::vector<std::int32_t> terminal_classes(num_terminals);
+    for (std::size_t symbol = 0; symbol < num_terminals; ++symbol){
+        auto inserted = classes.insert({columns[symbol], class_columns.size()});
+        if (inserted.second){
+            class_columns.push_back(&inserted.first->first);
+        }
+        terminal_classes[symbol] = inserted.first->second;
+    }
+
+    std::vector<std::vector<std::pair<int, std::uint32_t>>> action_rows(num_states);
+    for (std::size_t terminal_class = 0; terminal_class < class_columns.size(); ++terminal_class){
+        const std::vector<PackedInstr>& column = *class_columns[terminal_class];
+        for (std::size_t state = 0; state < num_states; ++state){
+            if (column[state] != NO_INSTR){
+                action_rows[state].push_back({terminal_class, column[state]});
+            }
+        }
+    }
+    std::vector<CombEntry> actions;
+    action_bases_ = pack_rows(action_rows, class_columns.size(), actions);
+
+    // Keep the gotos that differ from the most common one for each nonterminal
+    std::vector<std::uint32_t> default_gotos(num_nonterminals);
+    std::vector<std::vector<std::pair<int, std::uint32_t>>> goto_rows(num_nonterminals);
+    for (std::size_t nonterminal = 0; nonterminal < num_nonterminals; ++nonterminal){
+        std::vector<std::uint32_t> targets(num_states, 0);
+        std::vector<std::uint32_t> found;
+        for (std::size_t state = 0; state < num_states; ++state){
+            PackedInstr instr = dense.instr(state, num_terminals + nonterminal);
+            if (instr != NO_INSTR){
+                targets[state] = unpack_instr(instr).value;
+                found.push_back(targets[state]);
+            }
         }
+        default_gotos[nonterminal] = most_common(found, 0);
+
+        for (std::size_t state = 0; state < num_states; ++state){
+            if (dense.instr(state, num_terminals + nonterminal) != NO_INSTR && 
+                    targets[state] != default_gotos[nonterminal]){
+                goto_rows[nonterminal].push_back({state, targets[state]});
+            }
+        }
+    }
+    std::vector<CombEntry> gotos;
+    goto_bases_ = pack_rows(goto_rows, num_states, gotos);
+
+    default_reductions_ = std::move(default_reductions);
+    terminal_classes_ = std::move(terminal_classes);
+    actions_ = std::move(actions);
+    default_gotos_ = std::move(default_gotos);
+    gotos_ = std::move(gotos);
+}
+
+/**
+ * Overlap sparse rows of (column, value) pairs in one array, returning where each row starts.
+ *
+ * Rows are placed largest first at the lowest base where none of their entries land on 
+ * another row's entry. Every distinct row gets its own base, so an entry checked against 
+ * its column can only belong to the row being looked up. Identical rows share a base. The 
+ * array is padded so that any base plus any column is in range.
+ */
+std::vector<std::int32_t> parsing::CompressedParseTable::pack_rows(
+        const std::vector<std::vector<std::pair<int, std::uint32_t>>>& rows, std::size_t num_columns,
+        std::vector<CombEntry>& comb){
+    std::vector<std::size_t> order(rows.size());
+    for (std::size_t i = 0; i < order.size(); ++i){
+        order[i] = i;
     }
+    std::stable_sort(order.begin(), order.end(), [&rows](std::size_t a, std::size_t b){
+        return rows[a].size() > rows[b].size();
+    });
+
+    const CombEntry empty = {-1, 0};
+    std::vector<std::int32_t> bases(rows.size());
+    std::map<std::vector<std::pair<int, std::uint32_t>>, std::int32_t> placed;
+    std::vector<bool> used_bases;
+    std::size_t first_free = 0;  // No empty entries before this
+    comb.clear();
+
+    for (std::size_t row_index : order){
+        const std::vector<std::pair<int, std::uint32_t>>& row = rows[row_index];
+        auto found = placed.find(row);
+        if (found != placed.end()){
+            bases[row_index] = found->second;
+            continue;
+        }
+
+        // Any base lower than this would put the first entry before the first empty one
+        std::size_t base = row.empty() || static_cast<std::size_t>(row.front().first) > first_free ? 
+            0 : first_free - row.front().first;
+        while (1){
+            bool fits = base >= used_bases.size() || !used_bases[base];
+            for (std::size_t i = 0; fits && i < row.size(); ++i){
+                std::size_t index = base + row[i].first;
+                fits = index >= comb.size() || comb[index].check < 0;
+            }
+            if (fits){
+                break;
+            }
+            ++base;
+        }
+
+        if (base >= used_bases.size()){
+            used_bases.resize(base + 1, false);
+        }
+        used_bases[base] = true;
+        for (const auto& column_value : row){
+            std::size_t index = base + column_value.first;
+            if (index >= comb.size()){
+                comb.resize(index + 1, empty);
+            }
+            comb[index] = {column_value.first, column_value.second};
+        }
+        while (first_free < comb.size() && comb[first_free].check >= 0){
+            ++first_free;
+        }
 
-    // Memoize and remove from stack 
-    follows_map_[symbol] = follows_set;
-    follows_stack_.erase(symbol);
+        bases[row_index] = base;
+        placed[row] = base;
+    }
 
-    return follows_set;
+    comb.resize(used_bases.size() + num_columns, empty);
+    return bases;
 }
 
+std::size_t parsing::CompressedParseTable::num_terminal_classes() const {
+    return terminal_classes_.empty() ? 0 : *std::max_element(terminal_classes_.begin(), terminal_classes_.end()) + 1;
+}
 
 /**
- * Grammar getters
+ * Bytes taken by the tables the parser reads.
  */
-const parsing::ParseTable& parsing::Grammar::parse_table() const { return parse_table_; }
-const std::vector<parsing::ParseRule>& parsing::Grammar::parse_rules() const { return parse_rules_; }
-const std::vector<parsing::ParserConflict>& parsing::Grammar::conflicts() const { return conflicts_; }
-const std::unordered_map<std::string, std::unordered_set<std::string>>& parsing::Grammar::firsts() const { return firsts_map_; };
-const std::unordered_map<std::string, std::unordered_set<std::string>>& parsing::Grammar::follows() const { return follows_map_; };
+std::size_t parsing::CompressedParseTable::size() const {
+    return terminal_classes_.size() * sizeof(std::int32_t) + 
+           default_reductions_.size() * sizeof(PackedInstr) + 
+           action_bases_.size() * sizeof(std::int32_t) + 
+           actions_.size() * sizeof(CombEntry) + 
+           default_gotos_.size() * sizeof(std::uint32_t) + 
+           goto_bases_.size() * sizeof(std::int32_t) + 
+           gotos_.size() * sizeof(CombEntry);
+}
+
+
+void parsing::CompressedParseTable::write(CacheWriter& writer) const {
+    writer.write<std::uint64_t>(num_terminals_);
+    writer.write(terminal_classes_);
+    writer.write(default_reductions_);
+    writer.write(action_bases_);
+    writer.write(actions_);
+    writer.write(default_gotos_);
+    writer.write(goto_bases_);
+    writer.write(gotos_);
+}
 
+void parsing::CompressedParseTable::read(CacheReader& reader){
+    num_terminals_ = reader.read<std::uint64_t>();
+    reader.read(terminal_classes_);
+    reader.read(default_reductions_);
+    reader.read(action_bases_);
+    reader.read(actions_);
+    reader.read(default_gotos_);
+    reader.read(goto_bases_);
+    reader.read(gotos_);
+}
 
 
 /**************** Parser ************/ 
@@ -774,174 +2504,604 @@ std::shared_ptr<void> parsing::NodeVisitor::visit(Node& node){
     return node.accept(*this);
 }
 
+// The token of a stack entry that holds a node or nothing
+static const lexing::Token NOT_A_TOKEN = {-1, 0, 0, 0, 0};
+
 /**
  * All terminal symbols on the stack have the same precedence and associativity.
  * Reduce depending on the type of associativity.
  */
-void parsing::Parser::reduce(
-        const ParseRule& parse_rule, 
-        std::vector<lexing::LexToken>& symbol_stack,
-        std::vector<std::shared_ptr<void>>& node_stack,
-        std::vector<std::size_t>& state_stack){
-    const std::string& rule = parse_rule.rule;
-    const std::vector<std::string>& prod = parse_rule.production;
-    const ParseCallback func = parse_rule.callback;
+void parsing::Parser::reduce(std::size_t rule_index, const TokenSource& tokens){
+    const std::size_t prod_size = rule_lengths_[rule_index];
+    const ParseCallback func = callbacks_[rule_index];
     
-    lexing::LexToken rule_token = {rule,"",0,0,0};
+    // The start state is always under the production
+    assert(stack_.size() > prod_size);
+    const std::size_t start = stack_.size() - prod_size;
 
-    // Note: the symbol stack and production may not be the same length, but the 
-    // symbol stack and node stack will always be the same size
-    assert(node_stack.size() == symbol_stack.size());
+    // The symbol's entry becomes the rule's as it is, whether it holds a token or a node
+    if (func == pass_through && prod_size == 1){
+        stack_.back().state = goto_state(stack_[start - 1].state, rule_ids_[rule_index]);
+        return;
+    }
 
-    auto start = node_stack.begin() + node_stack.size() - prod.size();
     std::shared_ptr<void> result_node;
-
     if (func){
-        std::vector<std::shared_ptr<void>> slice(start, node_stack.end());
-        result_node = func(slice);
+        result_node = func(NodeSpan(stack_.data() + start, prod_size, tokens));
     }
     else {
         // Otherwise, add the wrapper for the rule token
+        lexing::LexToken rule_token = {rule_names_[rule_index],"",0,0,0};
         result_node = std::make_shared<lexing::LexToken>(rule_token);
     }
 
-    node_stack.erase(start, node_stack.end());
-    node_stack.push_back(result_node);
-    
-    state_stack.erase(state_stack.end()-prod.size(), state_stack.end());
-    symbol_stack.erase(symbol_stack.end()-prod.size(), symbol_stack.end());
-    symbol_stack.push_back(rule_token);
+    // Popping first leaves room for the new entry, so the stack never grows here
+    stack_.resize(start);
 
     // Next instruction will be GOTO
-    ParseInstr next_instr = get_instr(state_stack.back(), rule_token);
-    assert(next_instr.action == ParseInstr::GOTO);
-    state_stack.push_back(next_instr.value);
-
-    assert(node_stack.size() == symbol_stack.size());
+    const std::size_t next_state = goto_state(stack_.back().state, rule_ids_[rule_index]);
+    stack_.push_back({next_state, NOT_A_TOKEN, std::move(result_node)});
 }
 
 
 /**
- * Lookup of a parse instruction in the parse table with possible parse error getting raised.
+ * Lookup of a parse instruction in the compressed table. Returns NO_INSTR if there is none.
  */
-const parsing::ParseInstr& parsing::Parser::get_instr(std::size_t state, const lexing::LexToken& lookahead){
-    const ParseTable& parse_table = grammar_.parse_table();
-    if (parse_table.at(state).find(lookahead.symbol) == parse_table.at(state).cend()){
-        throw ParseError(*this, state, lookahead);
+parsing::PackedInstr parsing::Parser::get_instr(std::size_t state, int terminal_class) const {
+    if (terminal_class < 0){
+        return NO_INSTR;
+    }
+    if (lazy_grammar_){
+        return lazy_grammar_->lazy_instr(state, terminal_class);
+    }
+    return table_.action(state, terminal_class);
+}
+
+std::size_t parsing::Parser::goto_state(std::size_t state, int symbol) const {
+    if (lazy_grammar_){
+        return unpack_instr(lazy_grammar_->lazy_instr(state, symbol)).value;
     }
-    return parse_table.at(state).at(lookahead.symbol);
+    return table_.goto_state(state, symbol);
 }
 
+/**
+ * Tokens read one at a time from the lexer.
+ */
+class LexerTokenReader: public parsing::TokenSource {
+    private:
+        lexing::Lexer& lexer_;
+
+    public:
+        LexerTokenReader(lexing::Lexer& lexer): lexer_(lexer){}
+
+        lexing::Token next(){ return lexer_.next_token(); }
+        std::string value(const lexing::Token& token) const { return lexer_.value(token); }
+        lexing::LexToken lex_token(const lexing::Token& token) const override { return lexer_.lex_token(token); }
+
+        // Tokens are made into LexTokens when a callback asks for them
+        std::shared_ptr<void> node(const lexing::Token&) const { return nullptr; }
+        const parsing::TokenSource& stack_tokens() const { return *this; }
+};
+
+/**
+ * Tokens read from a stream lexed ahead of time.
+ */
+class StreamTokenReader: public parsing::TokenSource {
+    private:
+        const lexing::Lexer& lexer_;
+        const lexing::TokenStream& stream_;
+        std::size_t next_ = 0;
+
+    public:
+        StreamTokenReader(const lexing::Lexer& lexer, const lexing::TokenStream& stream): 
+            lexer_(lexer), stream_(stream){}
+
+        lexing::Token next(){ 
+            // The last token is END, which is never shifted past
+            assert(next_ < stream_.size());
+            return stream_.token(next_++); 
+        }
+        std::string value(const lexing::Token& token) const { return stream_.value(token); }
+        lexing::LexToken lex_token(const lexing::Token& token) const override {
+            return {lexer_.symbol_name(token.symbol), stream_.value(token), static_cast<int>(token.offset) + 1,
+                    token.lineno, token.colno};
+        }
+
+        std::shared_ptr<void> node(const lexing::Token&) const { return nullptr; }
+        const parsing::TokenSource& stack_tokens() const { return *this; }
+};
+
+/**
+ * Tokens lexed on another thread and passed through a ring buffer.
+ *
+ * The lexer thread fills in the line and column of each token, since that needs the lexer's 
+ * line index, which it changes as it goes. The parser never reads from the lexer while it 
+ * runs, so the lexer thread also sends the name of each symbol the first time it is found 
+ * and the value of each token whose value is not its bytes in the source. The parser keeps 
+ * these to make the LexTokens of the tokens on its stack from the source. Anything thrown 
+ * while lexing is thrown again from next() once the parser reaches the token it was thrown at.
+ */
+class PipedTokenReader: public parsing::TokenSource {
+    private:
+        struct PipedToken {
+            lexing::Token token;
+            std::string symbol;  // Only set the first time a symbol is found
+            std::string value;   // Only set if the value is not the token's bytes in the source
+            bool in_source;
+        };
+
+        RingBuffer<PipedToken> ring_;
+        std::atomic<bool> done_, stop_;
+        std::exception_ptr error_;
+        PipedToken last_;
+        const std::shared_ptr<const lexing::SourceBuffer> source_;
+        std::vector<std::string> symbols_;  // Names of the symbols read so far
+        lexing::CallbackValues values_;  // Values of the tokens read so far that are not in the source
+        std::thread thread_;
+
+        void produce(lexing::Lexer& lexer){
+            try {
+                std::vector<bool> sent_symbols;
+                lexing::Token token;
+                do {
+                    token = lexer.next_token();
+                    PipedToken piped;
+                    piped.token = token;
+                    piped.token.lineno = lexer.lineno(token);
+                    piped.token.colno = lexer.colno(token);
+                    if (static_cast<std::size_t>(token.symbol) >= sent_symbols.size()){
+                        sent_symbols.resize(token.symbol + 1);
+                    }
+                    if (!sent_symbols[token.symbol]){
+                        piped.symbol = lexer.symbol_name(token.symbol);
+                        sent_symbols[token.symbol] = true;
+                    }
+                    piped.in_source = !lexer.callback_value(token.offset) && token.offset + token.length <= source_->size();
+                    if (!piped.in_source){
+                        piped.value = lexer.value(token);
+                    }
+                    while (!ring_.try_push(piped)){
+                        if (stop_.load(std::memory_order_relaxed)){
+                            return;
+                        }
+                        std::this_thread::yield();
+                    }
+                } while (token.symbol != lexer.end_symbol());
+            }
+            catch (...){
+                error_ = std::current_exception();
+            }
+            done_.store(true, std::memory_order_release);
+        }
+
+    public:
+        PipedTokenReader(lexing::Lexer& lexer, std::size_t buffer_size): 
+            ring_(buffer_size), done_(false), stop_(false), source_(lexer.source()){
+            thread_ = std::thread(&PipedTokenReader::produce, this, std::ref(lexer));
+        }
+
+        // Stops the lexer if the parser finishes or fails before it does
+        ~PipedTokenReader(){
+            stop_.store(true, std::memory_order_relaxed);
+            thread_.join();
+        }
+
+        lexing::Token next(){
+            while (!ring_.try_pop(last_)){
+                if (done_.load(std::memory_order_acquire)){
+                    // Check once more for anything pushed before the lexer finished
+                    if (ring_.try_pop(last_)){
+                        break;
+                    }
+                    assert(error_);
+                    std::rethrow_exception(error_);
+                }
+                std::this_thread::yield();
+            }
+
+            const lexing::Token& token = last_.token;
+            if (!last_.symbol.empty()){
+                if (static_cast<std::size_t>(token.symbol) >= symbols_.size()){
+                    symbols_.resize(token.symbol + 1);
+                }
+                symbols_[token.symbol] = std::move(last_.symbol);
+            }
+            if (!last_.in_source){
+                values_.emplace_back(token.offset, std::move(last_.value));
+            }
+            return token;
+        }
+
+        // Tokens are read in order, so their values are in order of their offsets
+        std::string value(const lexing::Token& token) const { 
+            auto found = std::lower_bound(values_.begin(), values_.end(), token.offset, 
+                [](const std::pair<std::uint32_t, std::string>& entry, std::uint32_t offset){ return entry.first < offset; });
+            if (found != values_.end() && found->first == token.offset){
+                return found->second;
+            }
+
+            std::string value(token.length, '\0');
+            if (token.length){
+                source_->copy(token.offset, token.length, &value[0]);
+            }
+            return value;
+        }
+
+        lexing::LexToken lex_token(const lexing::Token& token) const override { 
+            return {symbols_[token.symbol], value(token), static_cast<int>(token.offset) + 1, 
+                    token.lineno, token.colno};
+        }
+
+        std::shared_ptr<void> node(const lexing::Token&) const { return nullptr; }
+        const parsing::TokenSource& stack_tokens() const { return *this; }
+};
+
 
 /**
- * Constructors
+ * Constructors. The parser keeps its own copy of the grammar, which is shared between 
+ * copies of the parser so the table they read stays where it is.
  */
 parsing::Parser::Parser(lexing::Lexer& lexer, const Grammar& grammar): 
-    lexer_(lexer), grammar_(grammar){}
+    lexer_(lexer), grammar_(std::make_shared<const Grammar>(grammar))
+{
+    init_symbol_ids();
+}
 
 parsing::Parser::Parser(lexing::Lexer& lexer, const std::vector<ParseRule>& parse_rules,
                         const PrecedenceList& precedence):
     lexer_(lexer), 
-    grammar_(Grammar(keys(lexer.tokens()), parse_rules, precedence)){}
+    grammar_(std::make_shared<const Grammar>(keys(lexer.tokens()), parse_rules, precedence))
+{
+    init_symbol_ids();
+}
+
+parsing::Parser::Parser(lexing::Lexer& lexer, const StaticParseTable& table, 
+                        const std::vector<ParseRule>& parse_rules):
+    lexer_(lexer), table_(table.table), state_items_(table.state_items)
+{
+    if (table.num_rules != parse_rules.size() + 1 || table.rules_hash != hash_rules(parse_rules)){
+        throw std::runtime_error("The parse table was generated from different rules. Generate it again.");
+    }
+
+    init_lookahead_classes(table.symbols, table.table.num_terminals);
+
+    rule_ids_.assign(table.rule_ids, table.rule_ids + table.num_rules);
+    rule_lengths_.assign(table.rule_lengths, table.rule_lengths + table.num_rules);
+    rule_names_.resize(table.num_rules);
+    callbacks_.resize(table.num_rules);
+    for (std::size_t i = 0; i < table.num_rules; ++i){
+        rule_names_[i] = table.symbols[rule_ids_[i]];
+
+        // The prime rule is accepted rather than reduced, so it needs no callback
+        callbacks_[i] = i ? parse_rules[i - 1].callback : nullptr;
+    }
+}
+
+/**
+ * Look up the grammar's symbols and rules once, so parsing never looks up a symbol by name.
+ */
+void parsing::Parser::init_symbol_ids(){
+    if (grammar_->construction() == LAZY_SLR_TABLE){
+        lazy_grammar_ = grammar_.get();
+    }
+    else {
+        table_ = grammar_->compressed_table().view();
+    }
 
+    std::vector<const char*> symbols;
+    for (const std::string& symbol : grammar_->symbols()){
+        symbols.push_back(symbol.c_str());
+    }
+    init_lookahead_classes(symbols.data(), grammar_->num_terminals());
+
+    const std::vector<ParseRule>& parse_rules = grammar_->parse_rules();
+    for (const ParseRule& parse_rule : parse_rules){
+        int rule_id = grammar_->symbol_id(parse_rule.rule);
+        rule_ids_.push_back(rule_id);
+        rule_names_.push_back(grammar_->symbols()[rule_id].c_str());
+        rule_lengths_.push_back(parse_rule.production.size());
+        callbacks_.push_back(parse_rule.callback);
+    }
+}
 
 /**
- * The actual parsing.
+ * Map the lexer's symbols onto terminal classes. Symbols the table has no terminal for 
+ * are -1. A lazy grammar has no classes, so they are mapped to its symbol IDs.
+ */
+void parsing::Parser::init_lookahead_classes(const char* const* symbols, std::size_t num_terminals){
+    for (std::size_t i = 0; i < num_terminals; ++i){
+        terminal_classes_[symbols[i]] = lazy_grammar_ ? i : table_.terminal_class(i);
+    }
+
+    lookahead_classes_.resize(lexer_.num_symbols());
+    for (std::size_t i = 0; i < lookahead_classes_.size(); ++i){
+        auto found = terminal_classes_.find(lexer_.symbol_name(i));
+        lookahead_classes_[i] = found == terminal_classes_.end() ? -1 : found->second;
+    }
+}
+
+// Marks symbols added to the lexer after the parser was made that have not come up yet
+static const int UNKNOWN_CLASS = -2;
+
+/**
+ * The class of a symbol the lexer added after the parser was made, like one a token 
+ * callback renamed a token to. The name comes from the token rather than the lexer, since
+ * a lexer on another thread may be adding symbols at the same time.
+ */
+int parsing::Parser::new_lookahead_class(int symbol, const std::string& name){
+    if (static_cast<std::size_t>(symbol) >= lookahead_classes_.size()){
+        lookahead_classes_.resize(symbol + 1, UNKNOWN_CLASS);
+    }
+    auto found = terminal_classes_.find(name);
+    lookahead_classes_[symbol] = found == terminal_classes_.end() ? -1 : found->second;
+    return lookahead_classes_[symbol];
+}
+
+
+/**
+ * Parse a string. The string is copied once into the source the lexer reads from.
  */
 std::shared_ptr<void> parsing::Parser::parse(const std::string& code){
-    // This language is defined such that all statements must end with a newline 
-    std::string code_cpy = code + "\n";
+    return parse(std::make_shared<lexing::SourceBuffer>(code));
+}
+
+/**
+ * Parse a source while lexing it.
+ */
+std::shared_ptr<void> parsing::Parser::parse(const std::shared_ptr<const lexing::SourceBuffer>& source){
+    // This language is defined such that all statements must end with a newline.
+    // The newline is lexed after the source without copying the source.
+    lexer_.input(source);
+    lexer_.input_tail("\n");
+
+    if (pipeline_size_){
+        PipedTokenReader reader(lexer_, pipeline_size_);
+        return parse_tokens(reader);
+    }
+    LexerTokenReader reader(lexer_);
+    return parse_tokens(reader);
+}
 
-    // Input the string
-    lexer_.input(code_cpy);
+/**
+ * Lex all of a source before parsing any of it.
+ */
+lexing::TokenStream parsing::Parser::tokenize(const std::shared_ptr<const lexing::SourceBuffer>& source){
+    lexer_.input(source);
+    lexer_.input_tail("\n");
+    return lexer_.tokenize();
+}
 
-    std::vector<std::size_t> state_stack;
+std::shared_ptr<void> parsing::Parser::parse(const lexing::TokenStream& stream){
+    StreamTokenReader reader(lexer_, stream);
+    return parse_tokens(reader);
+}
 
-    // Add the initial state number
-    state_stack.push_back(0);
+/**
+ * Start a parse from the initial state. The stack keeps its room from earlier parses, so it 
+ * only allocates while growing past them.
+ */
+void parsing::Parser::start_parse(){
+    stack_.clear();
+    stack_.push_back({0, NOT_A_TOKEN, nullptr});
+    stats_ = ParseStats();
+    pushing_ = false;
+}
 
-    std::vector<lexing::LexToken> symbol_stack;
-    std::vector<std::shared_ptr<void>> node_stack;
+/**
+ * The node left on the stack when the input is accepted, which may still be a token.
+ */
+std::shared_ptr<void> parsing::Parser::take_accepted(const TokenSource& tokens){
+    std::shared_ptr<void> node = std::move(NodeSpan(&stack_.back(), 1, tokens)[0]);
+    stack_.clear();
+    return node;
+}
 
-    lexing::LexToken lookahead = lexer_.token();
-    const std::vector<ParseRule>& parse_rules = grammar_.parse_rules();
+/**
+ * Reduce until the lookahead is shifted or the input is accepted. On an error, the state 
+ * with no instruction for the lookahead is left on top of the stack.
+ */
+template <typename TokenReader>
+parsing::PushResult parsing::Parser::shift_token(const lexing::Token& lookahead, const TokenReader& reader){
+    assert(lookahead.symbol >= 0);
+    int terminal_class = static_cast<std::size_t>(lookahead.symbol) < lookahead_classes_.size() ?
+        lookahead_classes_[lookahead.symbol] : UNKNOWN_CLASS;
+    if (terminal_class == UNKNOWN_CLASS){
+        terminal_class = new_lookahead_class(lookahead.symbol, reader.lex_token(lookahead).symbol);
+    }
 
     while (1){
-        std::size_t state = state_stack.back();
+        std::size_t state = stack_.back().state;
 
 #ifdef DEBUG
         // Dump the stack  
         std::cerr << "stack: ";
-        for (const auto& symbol : symbol_stack){
-            std::cerr << symbol.symbol << ", ";
+        for (const StackEntry& entry : stack_){
+            std::cerr << entry.state << ", ";
         }
         std::cerr << std::endl;
 #endif
 
-        std::shared_ptr<lexing::LexToken> stack_token;
-        const ParseInstr& instr = get_instr(state, lookahead);
+        const PackedInstr packed = get_instr(state, terminal_class);
+        if (packed == NO_INSTR){
+            return PUSH_ERROR;
+        }
+        const ParseInstr instr = unpack_instr(packed);
 
         switch (instr.action){
             case ParseInstr::SHIFT:
 #ifdef DEBUG
-                std::cerr << "Shift " << lookahead.symbol << " and goto state " << instr.value << std::endl;
+                std::cerr << "Shift " << lexer_.symbol_name(lookahead.symbol) << " and goto state " << instr.value << std::endl;
 #endif
-                // Add the next state to its stack and the lookahead to the tokens stack
-                state_stack.push_back(instr.value);
-                symbol_stack.push_back(lookahead);
-
-                // Copy the lookahead data
-                stack_token = std::make_shared<lexing::LexToken>(lookahead);
-                node_stack.push_back(stack_token);
-
-                lookahead = lexer_.token();
-                break;
+                // Add the next state with the lookahead data for the rule callbacks
+                stack_.push_back({static_cast<std::size_t>(instr.value), lookahead, reader.node(lookahead)});
+                ++stats_.num_shifts;
+                return PUSH_NEED_MORE;
             case ParseInstr::REDUCE:
 #ifdef DEBUG
                 std::cerr << "Reduce using rule " << instr.value << std::endl;
 #endif
 
-                // Pop from the states stack and replace the rules in the tokens stack 
-                // with the reduce rule
-                reduce(parse_rules[instr.value], symbol_stack, node_stack, state_stack);
+                // Replace the production on top of the stack with the rule
+                reduce(instr.value, reader.stack_tokens());
+                ++stats_.num_reductions;
                 break;
             case ParseInstr::ACCEPT:
 #ifdef DEBUG
-                std::cerr << "Accept " << instr.value << " (" << symbol_stack.back().symbol << ")" << std::endl;
+                std::cerr << "Accept " << instr.value << std::endl;
 #endif
 
-                // Reached end
-                assert(symbol_stack.size() == 1);
-                assert(node_stack.size() == 1);
-                return node_stack.front();
+                // Reached end with just the start state and the module left
+                assert(stack_.size() == 2);
+                return PUSH_ACCEPTED;
             case ParseInstr::GOTO:
                 // Should not actually end up here since gotos are handled in reduce 
                 // Though you may end up here if you have found a token that was not declared as a terminal 
-                std::string err = "Check if '" + lookahead.value + "' matches the regex for a valid token.";
+                std::string err = "Check if '" + reader.value(lookahead) + "' matches the regex for a valid token.";
                 throw std::runtime_error(err);
         }
     }
 }
 
+/**
+ * The actual parsing.
+ */
+template <typename TokenReader>
+std::shared_ptr<void> parsing::Parser::parse_tokens(TokenReader& reader){
+    start_parse();
+    while (1){
+        const lexing::Token lookahead = reader.next();
+        switch (shift_token(lookahead, reader)){
+            case PUSH_NEED_MORE:
+                break;
+            case PUSH_ACCEPTED: {
+                return take_accepted(reader);
+            }
+            case PUSH_ERROR:
+                throw ParseError(*this, stack_.back().state, reader.lex_token(lookahead));
+        }
+    }
+}
+
+/**
+ * A single LexToken pushed to the parser. The caller keeps the LexToken, so it is shifted as 
+ * a node. Tokens on the stack that were pushed without one come from the lexer.
+ */
+class LexTokenReader {
+    private:
+        const lexing::LexToken& lex_token_;
+        LexerTokenReader lexer_tokens_;
+
+    public:
+        LexTokenReader(const lexing::LexToken& lex_token, lexing::Lexer& lexer): 
+            lex_token_(lex_token), lexer_tokens_(lexer){}
+
+        std::string value(const lexing::Token&) const { return lex_token_.value; }
+        lexing::LexToken lex_token(const lexing::Token&) const { return lex_token_; }
+        std::shared_ptr<void> node(const lexing::Token&) const { return std::make_shared<lexing::LexToken>(lex_token_); }
+        const parsing::TokenSource& stack_tokens() const { return lexer_tokens_; }
+};
+
+/**
+ * Take one pushed token, starting a new parse if there is none going.
+ */
+template <typename TokenReader>
+parsing::PushResult parsing::Parser::push_token(const lexing::Token& token, const TokenReader& reader){
+    if (!pushing_){
+        start_parse();
+        pushing_ = true;
+        push_result_.reset();
+        push_error_.reset();
+    }
+    last_pushed_ = token;
+
+    const PushResult result = token.symbol < 0 ? PUSH_ERROR : shift_token(token, reader);
+    switch (result){
+        case PUSH_NEED_MORE:
+            break;
+        case PUSH_ACCEPTED:
+            push_result_ = take_accepted(reader.stack_tokens());
+            pushing_ = false;
+            break;
+        case PUSH_ERROR:
+            push_error_ = std::make_shared<ParseError>(*this, stack_.back().state, reader.lex_token(token));
+            pushing_ = false;
+            break;
+    }
+    return result;
+}
+
+parsing::PushResult parsing::Parser::feed(const lexing::Token& token){
+    return push_token(token, LexerTokenReader(lexer_));
+}
+
+/**
+ * Symbols the lexer does not know are errors. The token's position is kept for reporting 
+ * errors at END.
+ */
+parsing::PushResult parsing::Parser::feed(const lexing::LexToken& lex_token){
+    const lexing::Token token = {lexer_.symbol_id(lex_token.symbol), static_cast<std::uint32_t>(std::max(lex_token.pos - 1, 0)),
+                                 static_cast<std::uint32_t>(lex_token.value.size()), lex_token.lineno, lex_token.colno};
+    return push_token(token, LexTokenReader(lex_token, lexer_));
+}
+
+/**
+ * Push END, placed just after the last token pushed.
+ */
+parsing::PushResult parsing::Parser::finish(){
+    const lexing::LexToken end = {lexing::tokens::END, "", static_cast<int>(last_pushed_.offset + last_pushed_.length) + 1, 
+                                  last_pushed_.lineno, last_pushed_.colno + static_cast<int>(last_pushed_.length)};
+    return feed(end);
+}
+
+void parsing::Parser::set_pipeline_size(std::size_t pipeline_size){
+    pipeline_size_ = pipeline_size;
+}
+
+/**
+ * A generated table only has the items of each state, so its instructions are left out.
+ */
+void parsing::Parser::dump_state(std::size_t state, std::ostream& stream) const {
+    if (grammar_){
+        grammar_->dump_state(state, stream);
+        return;
+    }
+    stream << "state " << state << std::endl << std::endl;
+    stream << state_items_[state] << std::endl;
+}
 
 /**
  * Getters
  */
-const parsing::Grammar& parsing::Parser::grammar() const { return grammar_; }
+bool parsing::Parser::has_grammar() const { return grammar_ != nullptr; }
+
+const parsing::Grammar& parsing::Parser::grammar() const { 
+    if (!grammar_){
+        throw std::logic_error("A parser using a generated parse table has no grammar.");
+    }
+    return *grammar_; 
+}
+
+const parsing::ParseStats& parsing::Parser::stats() const { return stats_; }
+std::shared_ptr<void> parsing::Parser::push_result() const { return push_result_; }
+std::shared_ptr<const parsing::ParseError> parsing::Parser::push_error() const { return push_error_; }
 
 
 /************ ParseError ************/
 
 parsing::ParseError::ParseError(const Parser& parser, const std::size_t state, 
                                 const lexing::LexToken& lookahead):
-    std::runtime_error("Parser error"), parser_(parser), state_(state),
-    lookahead_(lookahead){}
+    std::runtime_error(message(parser, state, lookahead)){}
 
-const char* parsing::ParseError::what() const throw(){
+/**
+ * The message is created once on construction since the parser may be destroyed before the 
+ * error is caught.
+ */
+std::string parsing::ParseError::message(const Parser& parser, std::size_t state, 
+                                         const lexing::LexToken& lookahead){
     std::ostringstream err;
-    err << ": Unable to handle lookahead '" << lookahead_.symbol << "' in state " << state_ 
-        << ". Line " << lookahead_.lineno << ", col " << lookahead_.colno << "."
+    err << ": Unable to handle lookahead '" << lookahead.symbol << "' in state " << state 
+        << ". Line " << lookahead.lineno << ", col " << lookahead.colno << "."
         << std::endl << std::endl;
-    parser_.grammar().dump_state(state_, err);
-    return err.str().c_str();
+    parser.dump_state(state, err);
+    return err.str();
 }
@@ -8,6 +8,9 @@
 #include <iostream>
 #include <cassert>
 #include <memory>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
 
 #include "utils.h"
 #include "lexer.h"
@@ -18,8 +21,69 @@ namespace parsing {
         const std::string EPSILON = "EMPTY";
     }
 
+    // An entry on the parser's stack, which is the state the parser went to after a symbol
+    // and the symbol's value. A shifted token is kept as its compact token, and a reduced 
+    // rule has the node its callback made, or a LexToken holding the rule's name if it has 
+    // no callback. The first entry is just the start state.
+    struct StackEntry {
+        std::size_t state;
+        lexing::Token token;  // The symbol is -1 if the entry is not a token
+        std::shared_ptr<void> node;
+    };
+
+    // Where the parser reads the tokens on its stack from, which makes their LexTokens
+    class TokenSource {
+        public:
+            virtual lexing::LexToken lex_token(const lexing::Token&) const = 0;
+
+        protected:
+            ~TokenSource(){}
+    };
+
+    /**
+     * The nodes for the symbols in a production, viewed where they are on top of the 
+     * parser's stack so nothing is copied when reducing. They are popped after the callback, 
+     * so callbacks may move them out.
+     */
+    class NodeSpan {
+        private:
+            StackEntry* const entries_;
+            const std::size_t size_;
+            const TokenSource& tokens_;
+
+        public:
+            NodeSpan(StackEntry* entries, std::size_t size, const TokenSource& tokens): 
+                entries_(entries), size_(size), tokens_(tokens){}
+
+            // A token's node is a LexToken made the first time it is asked for
+            std::shared_ptr<void>& operator[](std::size_t i) const {
+                StackEntry& entry = entries_[i];
+                if (!entry.node && entry.token.symbol >= 0){
+                    entry.node = std::make_shared<lexing::LexToken>(tokens_.lex_token(entry.token));
+                }
+                return entry.node;
+            }
+
+            // A shifted token without making a node for it. Empty if the entry is not a token.
+            lexing::LexToken token(std::size_t i) const {
+                const StackEntry& entry = entries_[i];
+                if (entry.token.symbol < 0){
+                    return {};
+                }
+                if (entry.node){
+                    return *std::static_pointer_cast<lexing::LexToken>(entry.node);
+                }
+                return tokens_.lex_token(entry.token);
+            }
+            std::size_t size() const { return size_; }
+    };
+
     // The function called for handling symbols in a production when reducing by a rule
-    typedef std::shared_ptr<void> (*ParseCallback)(std::vector<std::shared_ptr<void>>& nodes);
+    typedef std::shared_ptr<void> (*ParseCallback)(NodeSpan nodes);
+
+    // Callback for a rule with one symbol whose node is the rule's node. These rules can be 
+    // left out of the table with ELIMINATE_UNIT_RULES.
+    std::shared_ptr<void> pass_through(NodeSpan nodes);
 
     // Individual entries created by the user containing the 
     // - Nonterminal rule to be reduced to 
@@ -70,6 +134,64 @@ namespace parsing {
     // retain insertion order for debugging in the grammar dump.
     typedef std::vector<LRItemSet> DFA;
 
+    // The state each state of a DFA goes to on each symbol after it
+    typedef std::vector<std::unordered_map<std::string, std::size_t>> Transitions;
+
+    // An lr item that refers to its rule by index in the parse rules
+    typedef struct LRItemID LRItemID;
+    struct LRItemID {
+        std::uint32_t rule;
+        std::uint32_t pos;
+
+        bool operator==(const LRItemID& other) const { return rule == other.rule && pos == other.pos; }
+        bool operator<(const LRItemID& other) const { 
+            return rule < other.rule || (rule == other.rule && pos < other.pos); 
+        }
+    };
+
+    typedef std::vector<LRItemID> LRItemIDSet;
+
+    struct LRItemIDSetHasher {
+        std::size_t operator()(const LRItemIDSet&) const;
+    };
+
+    /**
+     * The parse rules with their symbols interned as integers and the rules for each 
+     * nonterminal listed, so lr items can just be (rule, pos) pairs. Rules that are the 
+     * same as an earlier rule are left out of the lists, like init_closure leaves out 
+     * items it already has.
+     */
+    class InternedRules {
+        private:
+            std::vector<std::string> symbols_;
+            std::unordered_map<std::string, std::size_t> symbol_ids_;
+            std::vector<std::vector<std::size_t>> productions_;
+            std::vector<std::vector<std::uint32_t>> rules_by_symbol_;
+
+        public:
+            explicit InternedRules(const std::vector<ParseRule>&);
+
+            std::size_t num_symbols() const { return symbols_.size(); }
+            const std::string& symbol(std::size_t id) const { return symbols_[id]; }
+            std::size_t symbol_id(const std::string& symbol) const { return symbol_ids_.at(symbol); }
+            const std::vector<std::size_t>& production(std::size_t rule) const { return productions_[rule]; }
+            const std::vector<std::uint32_t>& rules_for(std::size_t symbol) const { return rules_by_symbol_[symbol]; }
+
+            // The symbol after the position in the item, or num_symbols() if it is at the end
+            std::size_t next_symbol(const LRItemID& item) const {
+                const std::vector<std::size_t>& prod = productions_[item.rule];
+                return item.pos < prod.size() ? prod[item.pos] : symbols_.size();
+            }
+
+            // Expand the items to their closure in the same order as init_closure. The
+            // started flags, one per rule, must be all false and are left all false.
+            void closure(LRItemIDSet&, std::vector<bool>& started) const;
+
+            std::size_t num_rules() const { return productions_.size(); }
+    };
+
+    LRItemSet make_item_set(const LRItemIDSet&, const std::vector<ParseRule>&);
+
     typedef struct ParseInstr ParseInstr;
     struct ParseInstr {
         enum Action {SHIFT, REDUCE, GOTO, ACCEPT} action;
@@ -82,11 +204,46 @@ namespace parsing {
 
     std::string action_str(const ParseInstr::Action&);
 
+    // A parse instruction packed into one integer: the action + 1 in the low 3 bits and the
+    // value above them. 0 is reserved for no instruction.
+    typedef std::uint32_t PackedInstr;
+    const PackedInstr NO_INSTR = 0;
+
+    inline PackedInstr pack_instr(const ParseInstr& instr){
+        return static_cast<PackedInstr>(instr.value) << 3 | (instr.action + 1);
+    }
+
+    inline ParseInstr unpack_instr(PackedInstr packed){
+        return {static_cast<ParseInstr::Action>((packed & 7) - 1), static_cast<int>(packed >> 3)};
+    }
+
     enum Associativity {
         LEFT_ASSOC,
         RIGHT_ASSOC,
     };
 
+    // How the grammar decides which lookaheads to reduce on
+    // - SLR_TABLE: the follows set of the rule
+    // - LALR_TABLE: lookaheads found for each LR(0) state by DeRemer and Pennello's method
+    // - LR1_TABLE: LR(1) states, where states with the same items are merged unless merging 
+    //   them could make a new conflict (Pager's weak compatibility)
+    // - LAZY_SLR_TABLE: SLR(1), but each state is only built once a parser first reaches it
+    enum TableConstruction {
+        SLR_TABLE,
+        LALR_TABLE,
+        LR1_TABLE,
+        LAZY_SLR_TABLE,
+    };
+
+    // Whether states that only reduce by a pass_through unit rule are skipped. Parsing 
+    // goes from the rule's symbol straight to where the reduction would go, so it reduces
+    // less often and makes the same nodes. A parse error may be found one state later.
+    // Lazy grammars keep their unit rules.
+    enum UnitRules {
+        KEEP_UNIT_RULES,
+        ELIMINATE_UNIT_RULES,
+    };
+
     typedef std::vector<std::pair<enum Associativity, std::vector<std::string>>> PrecedenceList;
     typedef std::unordered_map<std::string, std::pair<std::size_t, enum Associativity>> PrecedenceTable;
 
@@ -104,12 +261,171 @@ namespace parsing {
     std::vector<ParseRule> prepend_prime_rule(std::vector<ParseRule>);
     std::vector<ParseRule> trim_overload_tokens(std::vector<ParseRule>);
 
+    // Hash of the rules' nonterminals and productions, as they are given to a Grammar
+    std::uint64_t hash_rules(const std::vector<ParseRule>&);
+
     void init_closure(LRItemSet&, const std::vector<ParseRule>&);
     LRItemSet move_pos(const LRItemSet&, const std::string&, const std::vector<ParseRule>&);
     DFA make_dfa(const std::vector<ParseRule>&);
+    DFA make_dfa(const std::vector<ParseRule>&, Transitions&, std::size_t num_threads=1);
+    std::vector<LRItemIDSet> make_kernels(const InternedRules&, Transitions&, std::size_t num_threads=1);
 
     PrecedenceTable make_precedence_table(const PrecedenceList&);
 
+    // For saving the parse tables to a grammar cache file and loading them back
+    class CacheWriter;
+    class CacheReader;
+
+    // The states of a LAZY_SLR_TABLE grammar built so far
+    class LazyStates;
+
+    /**
+     * One of the arrays of a table. A table that was built owns its arrays, and a table 
+     * loaded from a cache file points into the mapped file instead of copying them. Copies 
+     * of a table share its arrays either way.
+     */
+    template <typename T>
+    class TableArray {
+        private:
+            std::shared_ptr<const void> owner_;  // Keeps the array alive
+            const T* data_ = nullptr;
+            std::size_t size_ = 0;
+
+        public:
+            TableArray(){}
+            TableArray(std::vector<T>&& values){
+                std::shared_ptr<const std::vector<T>> owned = std::make_shared<const std::vector<T>>(std::move(values));
+                owner_ = owned;
+                data_ = owned->data();
+                size_ = owned->size();
+            }
+            TableArray(const std::shared_ptr<const void>& owner, const T* data, std::size_t size):
+                owner_(owner), data_(data), size_(size){}
+
+            const T& operator[](std::size_t i) const { return data_[i]; }
+            const T* data() const { return data_; }
+            const T* begin() const { return data_; }
+            const T* end() const { return data_ + size_; }
+            std::size_t size() const { return size_; }
+            bool empty() const { return size_ == 0; }
+    };
+
+    /**
+     * Finalized parse table with a row of packed instructions for every state and a column
+     * for every symbol ID, so looking up an instruction is one index into one array.
+     */
+    class DenseParseTable {
+        private:
+            std::size_t num_symbols_ = 0;
+            TableArray<PackedInstr> instrs_;
+
+        public:
+            DenseParseTable(){}
+            DenseParseTable(const ParseTable&, const std::unordered_map<std::string, int>& symbol_ids);
+
+            PackedInstr instr(std::size_t state, int symbol) const {
+                return instrs_[state * num_symbols_ + symbol];
+            }
+
+            std::size_t num_states() const { return num_symbols_ ? instrs_.size() / num_symbols_ : 0; }
+            std::size_t num_symbols() const { return num_symbols_; }
+            std::size_t size() const { return instrs_.size() * sizeof(PackedInstr); }
+
+            void write(CacheWriter&) const;
+            void read(CacheReader&);
+    };
+
+    // An entry in the overlapped rows of a compressed table
+    struct CombEntry {
+        std::int32_t check;  // Column of the row this entry belongs to, or -1 if empty
+        std::uint32_t value;
+    };
+
+    /**
+     * The arrays of a compressed table the parser reads, which either belong to a 
+     * CompressedParseTable or are generated by generate_parse_table().
+     */
+    struct CompressedTableView {
+        std::size_t num_terminals;
+        const std::int32_t* terminal_classes;  // Class of each terminal symbol ID
+        const PackedInstr* default_reductions;  // By state
+        const std::int32_t* action_bases;  // By state
+        const CombEntry* actions;
+        const std::uint32_t* default_gotos;  // By nonterminal
+        const std::int32_t* goto_bases;  // By nonterminal
+        const CombEntry* gotos;
+
+        int terminal_class(int symbol) const { return terminal_classes[symbol]; }
+
+        // The action for a lookahead in the given terminal class
+        PackedInstr action(std::size_t state, int terminal_class) const {
+            const CombEntry& entry = actions[action_bases[state] + terminal_class];
+            return entry.check == terminal_class ? entry.value : default_reductions[state];
+        }
+
+        // The state to go to after reducing to a nonterminal symbol
+        std::size_t goto_state(std::size_t state, int symbol) const {
+            const std::size_t nonterminal = symbol - num_terminals;
+            const CombEntry& entry = gotos[goto_bases[nonterminal] + state];
+            return entry.check == static_cast<std::int32_t>(state) ? entry.value : default_gotos[nonterminal];
+        }
+    };
+
+    /**
+     * The dense table compressed the way bison compresses its tables.
+     *
+     * - Each state reduces by its most common rule on any lookahead it has no other 
+     *   instruction for, so those entries are dropped. Errors are then only found once the
+     *   parser reaches a state without a default reduction, before shifting anything.
+     * - Terminals with the same remaining instructions in every state share a class.
+     * - Each nonterminal goes to its most common state unless told otherwise.
+     * - The remaining rows are overlapped in one array each for actions and gotos, where every 
+     *   row starts at its own base and each entry records the column it belongs to.
+     */
+    class CompressedParseTable {
+        private:
+            std::size_t num_terminals_ = 0;
+            TableArray<std::int32_t> terminal_classes_;  // Class of each terminal symbol ID
+
+            TableArray<PackedInstr> default_reductions_;  // By state
+            TableArray<std::int32_t> action_bases_;  // By state
+            TableArray<CombEntry> actions_;
+
+            TableArray<std::uint32_t> default_gotos_;  // By nonterminal
+            TableArray<std::int32_t> goto_bases_;  // By nonterminal
+            TableArray<CombEntry> gotos_;
+
+            static std::vector<std::int32_t> pack_rows(const std::vector<std::vector<std::pair<int, std::uint32_t>>>&,
+                                                       std::size_t num_columns, std::vector<CombEntry>&);
+
+        public:
+            CompressedParseTable(){}
+            CompressedParseTable(const DenseParseTable&, std::size_t num_terminals);
+
+            // Only valid while this table is
+            CompressedTableView view() const {
+                return {num_terminals_, terminal_classes_.data(), default_reductions_.data(), action_bases_.data(), 
+                        actions_.data(), default_gotos_.data(), goto_bases_.data(), gotos_.data()};
+            }
+
+            int terminal_class(int symbol) const { return terminal_classes_[symbol]; }
+            PackedInstr action(std::size_t state, int terminal_class) const { return view().action(state, terminal_class); }
+            std::size_t goto_state(std::size_t state, int symbol) const { return view().goto_state(state, symbol); }
+
+            std::size_t num_terminal_classes() const;
+            const TableArray<std::int32_t>& terminal_classes() const { return terminal_classes_; }
+            const TableArray<PackedInstr>& default_reductions() const { return default_reductions_; }
+            const TableArray<std::int32_t>& action_bases() const { return action_bases_; }
+            const TableArray<CombEntry>& actions() const { return actions_; }
+            const TableArray<std::uint32_t>& default_gotos() const { return default_gotos_; }
+            const TableArray<std::int32_t>& goto_bases() const { return goto_bases_; }
+            const TableArray<CombEntry>& gotos() const { return gotos_; }
+            std::size_t size() const;
+
+            void write(CacheWriter&) const;
+            void read(CacheReader&);
+    };
+
     /**
      * Utility function for getting keys from a map.
      */
@@ -140,49 +456,154 @@ namespace parsing {
 
             // For Creating first/follow sets 
             const std::string start_nonterminal_;
-            std::unordered_set<std::string> firsts_stack_;  // for keeping track of recursive calls 
-            std::unordered_set<std::string> follows_stack_;
-            std::unordered_map<std::string, std::unordered_set<std::string>> firsts_map_;
-            std::unordered_map<std::string, std::unordered_set<std::string>> follows_map_;
 
             const PrecedenceTable precedence_map_;
+            const TableConstruction construction_;
+            const UnitRules unit_rules_;
+
+            // Only the kernel items of each state are kept. The rest follow from the closure.
+            const InternedRules rules_;
+            std::vector<LRItemIDSet> kernels_;
+
+            Transitions transitions_;
+
+            // Lookaheads to reduce on for each rule completed in each state. Only used for
+            // LALR(1) and LR(1) tables since SLR(1) tables reduce on the follows sets.
+            std::vector<std::unordered_map<std::size_t, std::vector<std::string>>> lookaheads_;
+
+            // A grammar loaded from a cache only needs its tables to parse, so the firsts and 
+            // follows sets and the parse table keyed by symbol names are only made from the 
+            // rules and the dense table once something asks for them. Shared by copies of the 
+            // grammar.
+            struct OnDemand {
+                std::mutex mutex;
+                std::atomic<bool> has_firsts_follows{false}, has_parse_table{false};
+                std::unordered_map<std::string, std::unordered_set<std::string>> firsts_map;
+                std::unordered_map<std::string, std::unordered_set<std::string>> follows_map;
+                ParseTable parse_table;  // map of states to map of strings to parse instructions 
+            };
+            std::shared_ptr<OnDemand> on_demand_;
+
+            // Terminals then nonterminals, numbered by their index here
+            std::vector<std::string> symbols_;
+            std::size_t num_terminals_ = 0;
+            std::unordered_map<std::string, int> symbol_ids_;
+            DenseParseTable dense_table_;
+            CompressedParseTable compressed_table_;
 
-            const DFA dfa_;
+            std::vector<ParserConflict> conflicts_;
 
-            ParseTable parse_table_;  // map of states to map of strings to parse instructions 
+            bool cached_ = false;
 
-            std::vector<ParserConflict> conflicts_;
+            // Only for LAZY_SLR_TABLE grammars, and shared by copies of the grammar
+            std::shared_ptr<LazyStates> lazy_states_;
 
             // Methods
             bool is_terminal(const std::string&) const;
             std::string token_for_instr(const ParseInstr&, const std::string&) const;
             void update_with_precedence(const ParseInstr&, const ParseInstr&, const std::string&,
-                                        std::size_t);
+                                        std::size_t, std::unordered_map<std::string, ParseInstr>&,
+                                        std::vector<ParserConflict>&) const;
             std::string conflict_str(const ParseInstr&, const std::string lookahead = "") const;
             std::string rightmost_terminal(const std::vector<std::string>&) const;
 
             // For creating firsts/follows sets
-            std::unordered_set<std::string> nonterminal_firsts(const std::string&);
+            void make_firsts_follows() const;
+            void make_parse_table() const;
+
+            void number_symbols();
+            LRItemIDSet closure(std::size_t state) const;
+
+            // For building the states and lookaheads. These take the number each rule is 
+            // known by in the parse table.
+            void make_lalr_lookaheads(const std::vector<std::size_t>&);
+            void make_lr1_states(const std::vector<std::size_t>&);
+
+            void build_table(std::size_t num_threads);
+            void eliminate_unit_rules();
+            void fill_state(std::size_t, const LRItemIDSet&, const std::unordered_map<std::string, std::size_t>& transitions,
+                            const std::vector<std::size_t>& rule_nums, std::unordered_map<std::string, ParseInstr>&,
+                            std::vector<ParserConflict>&) const;
+            void init_lazy_states();
+            void build_lazy_state(std::size_t) const;
+            bool read_cache(const std::string&);
+            void write_cache(const std::string&) const;
 
         public:
+            // The SLR(1) and LALR(1) states can be found on a number of threads, where 0 uses
+            // as many as the hardware has. LR(1) states are always found on one.
             Grammar(const std::unordered_set<std::string>&, const std::vector<ParseRule>&,
-                    const PrecedenceList& precedence={{}});
+                    const PrecedenceList& precedence={{}}, TableConstruction construction=SLR_TABLE,
+                    std::size_t num_threads=1, UnitRules unit_rules=KEEP_UNIT_RULES);
+
+            // Load the states and tables from a cache file saved by a grammar with the same 
+            // hash, or build them and save them to the file otherwise. The file is mapped into
+            // memory for loading. An empty file name builds the grammar without a cache.
+            Grammar(const std::string& cache_file, const std::unordered_set<std::string>&, 
+                    const std::vector<ParseRule>&, const PrecedenceList& precedence={{}},
+                    TableConstruction construction=SLR_TABLE, std::size_t num_threads=1,
+                    UnitRules unit_rules=KEEP_UNIT_RULES);
+
+            // Hash of the tokens, rules, precedence, construction and unit rule handling, 
+            // which are all that the states and tables depend on
+            std::uint64_t hash() const;
+
+            // hash_rules() of the rules the grammar was made from
+            std::uint64_t rules_hash() const;
 
             void dump(std::ostream& stream=std::cerr) const;
             void dump_state(std::size_t, std::ostream& stream=std::cerr) const;
+            void dump_items(std::size_t, std::ostream& stream=std::cerr) const;
             
             // Firsts/follows methods 
-            std::unordered_set<std::string> firsts(const std::string&);
-            std::unordered_set<std::string> follows(const std::string&);
+            std::unordered_set<std::string> firsts(const std::string&) const;
+            std::unordered_set<std::string> follows(const std::string&) const;
 
             // Getters
             const ParseTable& parse_table() const;
+            TableConstruction construction() const;
+            UnitRules unit_rules() const;
             const std::vector<ParseRule>& parse_rules() const;
-            const std::vector<ParserConflict>& conflicts() const;
+            std::vector<ParserConflict> conflicts() const;  // Copied, since lazy grammars add to them
             const std::unordered_map<std::string, std::unordered_set<std::string>>& firsts() const;
             const std::unordered_map<std::string, std::unordered_set<std::string>>& follows() const;
+            const DenseParseTable& dense_table() const;
+            const CompressedParseTable& compressed_table() const;
+            const std::vector<std::string>& symbols() const;
+            std::size_t num_terminals() const;
+            bool cached() const;  // If the tables were loaded from a cache file
+
+            // The ID of a symbol in the dense table, or -1 if the grammar does not use it
+            int symbol_id(const std::string&) const;
+
+            // The instruction for a symbol ID in a state of a LAZY_SLR_TABLE grammar. The
+            // state is built the first time anything asks about it, and kept for everything 
+            // sharing the grammar. The tables above stay empty for these grammars.
+            PackedInstr lazy_instr(std::size_t state, int symbol) const;
+            std::size_t num_lazy_states() const;  // Built so far
     };
 
+    /**
+     * A grammar's compressed table and what a parser needs to know about its rules, written
+     * as C++ arrays by generate_parse_table(). A parser can use this without building the
+     * grammar at all, and the arrays are only ever read.
+     */
+    struct StaticParseTable {
+        CompressedTableView table;
+        const char* const* symbols;  // Terminals then nonterminals, by symbol ID
+        std::size_t num_symbols;
+        std::size_t num_rules;  // Including the prime rule
+        const std::int32_t* rule_ids;  // Symbol ID of each rule's nonterminal
+        const std::uint32_t* rule_lengths;
+        std::uint64_t rules_hash;  // hash_rules() of the rules the grammar was made from
+        const char* const* state_items;  // Item listing of each state, for parse errors
+    };
+
+    /**
+     * Write the C++ source for a StaticParseTable named ns::name with the grammar's table.
+     */
+    void generate_parse_table(std::ostream&, const Grammar&, const std::string& ns, const std::string& name);
+
 
     /************** Parser ************/ 
 
@@ -263,37 +684,120 @@ namespace parsing {
             }
     };
 
+    // Counts from a parser's last parse
+    struct ParseStats {
+        std::size_t num_shifts = 0;
+        std::size_t num_reductions = 0;
+    };
+
+    // What a parser did with a token pushed to it
+    enum PushResult {
+        PUSH_NEED_MORE,  // Shifted the token and waiting for the next one
+        PUSH_ACCEPTED,   // Parsed the whole input
+        PUSH_ERROR,      // No instruction for the token, which ends the parse
+    };
+
+    class ParseError;
+
     class Parser {
         private:
             lexing::Lexer& lexer_;
-            const Grammar grammar_;
-
-            void reduce(const ParseRule&, std::vector<lexing::LexToken>&, std::vector<std::shared_ptr<void>>&,
-                        std::vector<std::size_t>&);
-            const ParseInstr& get_instr(std::size_t, const lexing::LexToken&);
+            std::shared_ptr<const Grammar> grammar_;  // Not set when parsing with a StaticParseTable
+            const Grammar* lazy_grammar_ = nullptr;  // Set if the grammar builds its states lazily
+            CompressedTableView table_;
+            const char* const* state_items_ = nullptr;  // From a StaticParseTable
+            std::size_t pipeline_size_ = 0;
+            ParseStats stats_;
+
+            // Kept between parses so a parse only grows it past the size of earlier ones
+            std::vector<StackEntry> stack_;
+
+            // For parsing pushed tokens
+            bool pushing_ = false;
+            lexing::Token last_pushed_ = {};
+            std::shared_ptr<void> push_result_;
+            std::shared_ptr<const ParseError> push_error_;
+
+            // Terminal classes of the lexer's symbols, or their symbol IDs for a lazy grammar.
+            // Symbols the lexer adds later are looked up by name the first time they come up.
+            std::vector<int> lookahead_classes_;
+            std::unordered_map<std::string, int> terminal_classes_;
+
+            // The symbol ID and name of each rule's nonterminal, how many symbols it reduces
+            // and its callback. The names belong to the grammar or the static table.
+            std::vector<int> rule_ids_;
+            std::vector<const char*> rule_names_;
+            std::vector<std::uint32_t> rule_lengths_;
+            std::vector<ParseCallback> callbacks_;
+
+            void init_symbol_ids();
+            void init_lookahead_classes(const char* const* symbols, std::size_t num_terminals);
+            void reduce(std::size_t, const TokenSource&);
+            int new_lookahead_class(int symbol, const std::string& name);
+            PackedInstr get_instr(std::size_t, int terminal_class) const;
+            std::size_t goto_state(std::size_t, int) const;
+
+            void start_parse();
+            std::shared_ptr<void> take_accepted(const TokenSource&);
+
+            template <typename TokenReader>
+            PushResult shift_token(const lexing::Token&, const TokenReader&);
+            template <typename TokenReader>
+            PushResult push_token(const lexing::Token&, const TokenReader&);
+            template <typename TokenReader>
+            std::shared_ptr<void> parse_tokens(TokenReader&);
 
         public:
             Parser(lexing::Lexer&, const Grammar& table);
             Parser(lexing::Lexer&, const std::vector<ParseRule>& parse_rules,
                    const PrecedenceList& precedence={{}});
 
+            // Parse with a generated table. The rules must be the ones it was generated from,
+            // which are only used for their callbacks.
+            Parser(lexing::Lexer&, const StaticParseTable&, const std::vector<ParseRule>& parse_rules);
+
             std::shared_ptr<void> parse(const std::string&);
+            std::shared_ptr<void> parse(const std::shared_ptr<const lexing::SourceBuffer>&);
+
+            // Parse tokens already lexed by this parser's lexer
+            std::shared_ptr<void> parse(const lexing::TokenStream&);
+
+            // Lex a source into a stream for parsing later
+            lexing::TokenStream tokenize(const std::shared_ptr<const lexing::SourceBuffer>&);
+
+            // Lex sources on a separate thread while parsing them, buffering up to this many 
+            // tokens between the threads. 0 lexes on the parser's thread, which is the default.
+            void set_pipeline_size(std::size_t);
+
+            // Parse tokens as they are pushed instead of pulling them from the lexer. The 
+            // first token pushed after a parse is accepted or fails starts a new one. Tokens
+            // are either found by this parser's lexer, which their values are read from, or 
+            // LexTokens from anywhere with symbols the lexer knows. finish() ends the input.
+            PushResult feed(const lexing::Token&);
+            PushResult feed(const lexing::LexToken&);
+            PushResult finish();
+
+            // The node of the last accepted push parse, and why the last one failed
+            std::shared_ptr<void> push_result() const;
+            std::shared_ptr<const ParseError> push_error() const;
+
+            // The items of a state and, with a grammar, its instructions
+            void dump_state(std::size_t, std::ostream& stream=std::cerr) const;
 
             // Getters
+            bool has_grammar() const;  // False when parsing with a StaticParseTable
             const Grammar& grammar() const;
+            const ParseStats& stats() const;
     };
 
     // Runtime error on finding a parse instruction that does not exist 
     // for a state and lookahead.
     class ParseError: public std::runtime_error {
         private:
-            const Parser& parser_;
-            const std::size_t state_;
-            const lexing::LexToken lookahead_;
+            static std::string message(const Parser&, std::size_t, const lexing::LexToken&);
 
         public:
             ParseError(const Parser&, const std::size_t, const lexing::LexToken&);
-            virtual const char* what() const throw();
     };
 }
 
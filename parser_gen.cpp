@@ -0,0 +1,93 @@
+#include "parser.h"
+#include <sstream>
+
+/**
+ * Write a static array of integers, 16 to a line. Arrays cannot be empty, so an empty one
+ * gets a single 0 that is never read.
+ */
+template <typename Values>
+static void write_array(std::ostream& out, const std::string& type, const std::string& name,
+                        const Values& values){
+    out << "static const " << type << " " << name << "[] = {";
+    for (std::size_t i = 0; i < values.size(); ++i){
+        out << (i % 16 ? " " : "\n    ") << values[i] << ",";
+    }
+    if (values.empty()){
+        out << "0";
+    }
+    out << std::endl << "};" << std::endl << std::endl;
+}
+
+static void write_entries(std::ostream& out, const std::string& name, const parsing::TableArray<parsing::CombEntry>& entries){
+    out << "static const parsing::CombEntry " << name << "[] = {";
+    for (std::size_t i = 0; i < entries.size(); ++i){
+        out << (i % 8 ? " " : "\n    ") << "{" << entries[i].check << ", " << entries[i].value << "},";
+    }
+    if (entries.empty()){
+        out << "{-1, 0}";
+    }
+    out << std::endl << "};" << std::endl << std::endl;
+}
+
+/**
+ * Write the compressed table as it is in memory, with the symbol names and what the parser
+ * needs from each rule.
+ */
+void parsing::generate_parse_table(std::ostream& out, const Grammar& grammar, const std::string& ns,
+                                   const std::string& name){
+    const CompressedParseTable& table = grammar.compressed_table();
+    const std::vector<std::string>& symbols = grammar.symbols();
+
+    std::vector<std::int32_t> rule_ids;
+    std::vector<std::uint32_t> rule_lengths;
+    for (const ParseRule& parse_rule : grammar.parse_rules()){
+        rule_ids.push_back(grammar.symbol_id(parse_rule.rule));
+        rule_lengths.push_back(parse_rule.production.size());
+    }
+
+    out << "// Generated by generate_parse_table() in parser_gen.cpp. Do not edit." << std::endl << std::endl;
+    out << "#include \"parser.h\"" << std::endl << std::endl;
+
+    out << "static const char* const SYMBOLS[] = {" << std::endl;
+    for (const std::string& symbol : symbols){
+        out << "    " << string_literal(symbol) << "," << std::endl;
+    }
+    out << "};" << std::endl << std::endl;
+
+    write_array(out, "std::int32_t", "TERMINAL_CLASSES", table.terminal_classes());
+    write_array(out, "parsing::PackedInstr", "DEFAULT_REDUCTIONS", table.default_reductions());
+    write_array(out, "std::int32_t", "ACTION_BASES", table.action_bases());
+    write_entries(out, "ACTIONS", table.actions());
+    write_array(out, "std::uint32_t", "DEFAULT_GOTOS", table.default_gotos());
+    write_array(out, "std::int32_t", "GOTO_BASES", table.goto_bases());
+    write_entries(out, "GOTOS", table.gotos());
+    write_array(out, "std::int32_t", "RULE_IDS", rule_ids);
+    write_array(out, "std::uint32_t", "RULE_LENGTHS", rule_lengths);
+
+    // The items of each state, a line to a literal
+    out << "static const char* const STATE_ITEMS[] = {" << std::endl;
+    for (std::size_t state = 0; state < grammar.dense_table().num_states(); ++state){
+        std::ostringstream items;
+        grammar.dump_items(state, items);
+        std::istringstream lines(items.str());
+        std::string line;
+        out << "    // state " << state << std::endl;
+        while (std::getline(lines, line)){
+            out << "    " << string_literal(line + "\n") << std::endl;
+        }
+        out << "    \"\"," << std::endl;
+    }
+    out << "};" << std::endl << std::endl;
+
+    out << "namespace " << ns << " {" << std::endl;
+    out << "    extern const parsing::StaticParseTable " << name << ";" << std::endl;
+    out << "    const parsing::StaticParseTable " << name << " = {" << std::endl;
+    out << "        {" << grammar.num_terminals() << ", TERMINAL_CLASSES, DEFAULT_REDUCTIONS, ACTION_BASES, ACTIONS, "
+        << "DEFAULT_GOTOS, GOTO_BASES, GOTOS}," << std::endl;
+    out << "        SYMBOLS, " << symbols.size() << "," << std::endl;
+    out << "        " << rule_ids.size() << ", RULE_IDS, RULE_LENGTHS," << std::endl;
+    out << "        " << grammar.rules_hash() << "ULL," << std::endl;
+    out << "        STATE_ITEMS," << std::endl;
+    out << "    };" << std::endl;
+    out << "}" << std::endl;
+}
@@ -0,0 +1,83 @@
+#ifndef _RING_BUFFER_H
+#define _RING_BUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/**
+ * Bounded queue for passing values from one thread to one other thread without locks.
+ *
+ * The producer only writes the tail and the consumer only writes the head, so each side
+ * just needs to see the other's index to know how much room or how many values there are.
+ * Each side also keeps the last index it saw from the other, so it only reads the other's
+ * cache line when its copy says the queue is full or empty.
+ */
+template <typename T>
+class RingBuffer {
+    private:
+        std::vector<T> slots_;
+        const std::size_t mask_;
+
+        // Keep the indices on separate cache lines so the two threads do not fight over them
+        char pad0_[64];
+        std::atomic<std::size_t> head_;  // Next slot to read
+        std::size_t cached_tail_ = 0;    // Consumer's copy of the tail
+        char pad1_[64];
+        std::atomic<std::size_t> tail_;  // Next slot to write
+        std::size_t cached_head_ = 0;    // Producer's copy of the head
+        char pad2_[64];
+
+        static std::size_t round_up(std::size_t capacity){
+            std::size_t size = 1;
+            while (size < capacity){
+                size <<= 1;
+            }
+            return size;
+        }
+
+    public:
+        // The capacity is rounded up to a power of 2
+        explicit RingBuffer(std::size_t capacity):
+            slots_(round_up(capacity)), mask_(slots_.size() - 1), head_(0), tail_(0){}
+
+        RingBuffer(const RingBuffer&) = delete;
+        RingBuffer& operator=(const RingBuffer&) = delete;
+
+        /**
+         * Add a value from the producer. Returns false without moving the value if the
+         * buffer is full.
+         */
+        bool try_push(T& value){
+            const std::size_t tail = tail_.load(std::memory_order_relaxed);
+            if (tail - cached_head_ == slots_.size()){
+                cached_head_ = head_.load(std::memory_order_acquire);
+                if (tail - cached_head_ == slots_.size()){
+                    return false;
+                }
+            }
+            slots_[tail & mask_] = std::move(value);
+            tail_.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * Take the oldest value from the consumer. Returns false if the buffer is empty.
+         */
+        bool try_pop(T& value){
+            const std::size_t head = head_.load(std::memory_order_relaxed);
+            if (head == cached_tail_){
+                cached_tail_ = tail_.load(std::memory_order_acquire);
+                if (head == cached_tail_){
+                    return false;
+                }
+            }
+            value = std::move(slots_[head & mask_]);
+            head_.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        std::size_t capacity() const { return slots_.size(); }
+};
+
+#endif
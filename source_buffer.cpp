@@ -0,0 +1,215 @@
+#include "lexer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+/**
+ * Constructors
+ */
+lexing::SourceBuffer::SourceBuffer(): data_(owned_.data()), size_(0){}
+
+lexing::SourceBuffer::SourceBuffer(const std::string& code):
+    owned_(code), data_(owned_.data()), size_(owned_.size()){}
+
+lexing::SourceBuffer::SourceBuffer(std::string&& code):
+    owned_(std::move(code)), data_(owned_.data()), size_(owned_.size()){}
+
+lexing::SourceBuffer::~SourceBuffer(){
+    if (mapping_){
+        munmap(mapping_, mapping_size_);
+    }
+}
+
+/**
+ * Read the whole file into a string in case it cannot be mapped (pipes, special files, ...).
+ */
+static std::string read_fd(int fd, const std::string& filename){
+    std::string contents;
+    char buffer[1 << 16];
+    while (1){
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            close(fd);
+            throw std::runtime_error("Unable to read file '" + filename + "': " + strerror(errno));
+        }
+        if (!n){
+            break;
+        }
+        contents.append(buffer, n);
+    }
+    return contents;
+}
+
+/**
+ * Map the file into memory as read only. The pages are shared with the page cache, so the
+ * file is not copied into the process at all.
+ */
+std::shared_ptr<const lexing::SourceBuffer> lexing::SourceBuffer::from_file(const std::string& filename){
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0){
+        throw std::runtime_error("Unable to open file '" + filename + "': " + strerror(errno));
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0){
+        std::size_t size = static_cast<std::size_t>(st.st_size);
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED){
+            close(fd);
+            madvise(mapping, size, MADV_SEQUENTIAL);
+
+            std::shared_ptr<SourceBuffer> buffer = std::make_shared<SourceBuffer>();
+            buffer->mapping_ = mapping;
+            buffer->mapping_size_ = size;
+            buffer->data_ = static_cast<const char*>(mapping);
+            buffer->size_ = size;
+            return buffer;
+        }
+    }
+
+    // Fallback
+    std::string contents = read_fd(fd, filename);
+    close(fd);
+    return std::make_shared<SourceBuffer>(std::move(contents));
+}
+
+/**
+ * Edits to an edited buffer split its pieces further, so once there are this many the 
+ * pieces are joined into a new buffer instead.
+ */
+static const std::size_t MAX_PIECES = 64;
+
+/**
+ * The new buffer keeps the pieces of the old code before and after the edit and a piece for 
+ * the inserted text. The old pieces still point into the buffers they came from, which are 
+ * kept alive by the pieces.
+ */
+std::shared_ptr<const lexing::SourceBuffer> lexing::SourceBuffer::edited(const std::shared_ptr<const SourceBuffer>& code, 
+                                                                        const std::string& tail, const Edit& edit){
+    std::vector<Piece> old_pieces;
+    if (!code->pieces_.empty()){
+        old_pieces = code->pieces_;
+    }
+    else if (code->size_){
+        old_pieces.push_back({code, code->data_, code->size_, 0});
+    }
+    std::size_t old_size = code->size_;
+    if (!tail.empty()){
+        std::shared_ptr<const std::string> tail_copy = std::make_shared<std::string>(tail);
+        old_pieces.push_back({tail_copy, tail_copy->data(), tail_copy->size(), old_size});
+        old_size += tail.size();
+    }
+    const std::size_t old_end = edit.offset + edit.removed;
+    assert(old_end <= old_size);
+
+    std::vector<Piece> pieces;
+    std::size_t size = 0;
+    auto add = [&pieces, &size](const Piece& piece, std::size_t begin, std::size_t end){
+        if (begin < end){
+            pieces.push_back({piece.owner, piece.data + begin, end - begin, size});
+            size += end - begin;
+        }
+    };
+    for (const Piece& piece : old_pieces){
+        if (piece.offset < edit.offset){
+            add(piece, 0, std::min(piece.size, edit.offset - piece.offset));
+        }
+    }
+    if (!edit.inserted.empty()){
+        std::shared_ptr<const std::string> inserted = std::make_shared<std::string>(edit.inserted);
+        add({inserted, inserted->data(), inserted->size(), 0}, 0, inserted->size());
+    }
+    for (const Piece& piece : old_pieces){
+        if (piece.offset + piece.size > old_end){
+            add(piece, old_end > piece.offset ? old_end - piece.offset : 0, piece.size);
+        }
+    }
+
+    if (pieces.size() > MAX_PIECES){
+        std::string joined;
+        joined.reserve(size);
+        for (const Piece& piece : pieces){
+            joined.append(piece.data, piece.size);
+        }
+        return std::make_shared<SourceBuffer>(std::move(joined));
+    }
+
+    std::shared_ptr<SourceBuffer> buffer = std::make_shared<SourceBuffer>();
+    buffer->pieces_ = std::move(pieces);
+    buffer->size_ = size;
+    return buffer;
+}
+
+/**
+ * The index of the piece of an edited buffer an offset is in.
+ */
+std::size_t lexing::SourceBuffer::piece_at(std::size_t offset) const {
+    return std::upper_bound(pieces_.begin(), pieces_.end(), offset, [](std::size_t offset, const Piece& piece){
+        return offset < piece.offset;
+    }) - pieces_.begin() - 1;
+}
+
+/**
+ * The contents as one range of bytes. The pieces of an edited buffer are joined the first 
+ * time this is called, which may be from more than one thread.
+ */
+const char* lexing::SourceBuffer::data() const {
+    if (pieces_.empty()){
+        return data_;
+    }
+    std::call_once(join_once_, [this](){
+        joined_.reserve(size_);
+        for (const Piece& piece : pieces_){
+            joined_.append(piece.data, piece.size);
+        }
+    });
+    return joined_.data();
+}
+
+/**
+ * The byte at an offset, read from its piece so an edited buffer is not joined.
+ */
+char lexing::SourceBuffer::at(std::size_t offset) const {
+    if (pieces_.empty()){
+        return data_[offset];
+    }
+    const Piece& piece = pieces_[piece_at(offset)];
+    return piece.data[offset - piece.offset];
+}
+
+/**
+ * Copy the bytes in [offset, offset + size) out of the buffer without joining it.
+ */
+void lexing::SourceBuffer::copy(std::size_t offset, std::size_t size, char* out) const {
+    assert(offset + size <= size_);
+    if (pieces_.empty()){
+        std::memcpy(out, data_ + offset, size);
+        return;
+    }
+    for (std::size_t i = piece_at(offset); size; ++i){
+        const Piece& piece = pieces_[i];
+        std::size_t begin = offset - piece.offset;
+        std::size_t count = std::min(size, piece.size - begin);
+        std::memcpy(out, piece.data + begin, count);
+        out += count;
+        offset += count;
+        size -= count;
+    }
+}
+
+/**
+ * Getters
+ */
+std::size_t lexing::SourceBuffer::size() const { return size_; }
+bool lexing::SourceBuffer::empty() const { return size_ == 0; }
+bool lexing::SourceBuffer::mapped() const { return mapping_ != nullptr; }
+std::string lexing::SourceBuffer::str() const { return std::string(data(), size_); }
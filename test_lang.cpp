@@ -1,4 +1,5 @@
 #include "lang.h"
+#include <thread>
 
 /**
  * Test parsing a simple string.
@@ -41,7 +42,7 @@ def func():
 )";
 
     lang::LangLexer lexer(lang::LANG_TOKENS);
-    parsing::Parser parser(lexer, lang::LANG_GRAMMAR);
+    parsing::Parser parser(lexer, lang::lang_grammar());
 
     std::shared_ptr<lang::Module> module_node = std::static_pointer_cast<lang::Module>(parser.parse(code));
     assert(lexer.empty());
@@ -58,7 +59,7 @@ void test_empty(){
     const std::string code = "";
 
     lang::LangLexer lexer(lang::LANG_TOKENS);
-    parsing::Parser parser(lexer, lang::LANG_GRAMMAR);
+    parsing::Parser parser(lexer, lang::lang_grammar());
     std::shared_ptr<lang::Module> module_node = std::static_pointer_cast<lang::Module>(parser.parse(code));
 
     assert(module_node->body().empty());
@@ -72,7 +73,7 @@ def func():
 )";
 
     lang::LangLexer lexer(lang::LANG_TOKENS);
-    parsing::Parser parser(lexer, lang::LANG_GRAMMAR);
+    parsing::Parser parser(lexer, lang::lang_grammar());
 
     std::shared_ptr<lang::Module> module_node = std::static_pointer_cast<lang::Module>(parser.parse(code));
     assert(lexer.empty());
@@ -89,20 +90,443 @@ def main():
 )";
 
     lang::LangLexer lexer(lang::LANG_TOKENS);
-    parsing::Parser parser(lexer, lang::LANG_GRAMMAR);
+    parsing::Parser parser(lexer, lang::lang_grammar());
 
     parser.parse(code);
     assert(lexer.empty());
 }
 
+void test_token_stream(){
+    const std::string code = R"(
+def main():
+    friends = {"john", "pat"}
+    for i, name in enumerate(friends):
+        print("iteration {} is {}".format(i, name))
+    x + -y
+)";
+
+    lang::LangLexer lexer(lang::LANG_TOKENS);
+    parsing::Parser parser(lexer, lang::lang_grammar());
+    lexing::TokenStream stream = parser.tokenize(std::make_shared<lexing::SourceBuffer>(code));
+    assert(lexer.empty());
+
+    // The stream can be parsed more than once
+    std::shared_ptr<lang::Module> module_node = std::static_pointer_cast<lang::Module>(parser.parse(stream));
+    std::shared_ptr<lang::Module> again = std::static_pointer_cast<lang::Module>(parser.parse(stream));
+
+    lang::LangLexer other_lexer(lang::LANG_TOKENS);
+    parsing::Parser other_parser(other_lexer, lang::lang_grammar());
+    std::shared_ptr<lang::Module> expected = std::static_pointer_cast<lang::Module>(other_parser.parse(code));
+
+    assert(module_node->str() == expected->str());
+    assert(again->str() == expected->str());
+}
+
+/**
+ * Parse with the lexer on another thread if the pipeline size is not 0.
+ */
+static std::shared_ptr<void> parse_with_pipeline(const std::string& code, std::size_t pipeline_size){
+    lang::LangLexer lexer(lang::LANG_TOKENS);
+    parsing::Parser parser(lexer, lang::lang_grammar());
+    parser.set_pipeline_size(pipeline_size);
+    std::shared_ptr<void> node = parser.parse(code);
+    assert(lexer.empty());
+    return node;
+}
+
+/**
+ * Check that parsing with the lexer on another thread throws what parsing on one thread does.
+ */
+template <typename Exception>
+static void assert_pipelined_error(const std::string& code){
+    for (std::size_t pipeline_size : {0, 4}){
+        try {
+            parse_with_pipeline(code, pipeline_size);
+            assert(false);
+        }
+        catch (const Exception&){}
+    }
+}
+
+void test_pipelined_parse(){
+    std::string code;
+    for (int i = 0; i < 50; ++i){
+        code += "def func" + std::to_string(i) + "():\n    friends = {\"john\", \"pat\"}\n    x + -y\n\n";
+    }
+    std::shared_ptr<lang::Module> expected = std::static_pointer_cast<lang::Module>(parse_with_pipeline(code, 0));
+
+    // A small buffer makes the threads wait on each other
+    for (std::size_t size : {1, 3, 1024}){
+        std::shared_ptr<lang::Module> module_node = std::static_pointer_cast<lang::Module>(parse_with_pipeline(code, size));
+        assert(module_node->str() == expected->str());
+    }
+
+    assert_pipelined_error<lang::IndentationError>(code + "def f():\n        x\n    y\n" + code);
+    assert_pipelined_error<parsing::ParseError>(code + "def f()\n" + code);
+
+    // The lex error has the position from the lexer thread
+    const std::string bad_code = code + "def g():\n    x = $\n" + code;
+    std::string expected_error;
+    try {
+        parse_with_pipeline(bad_code, 0);
+    }
+    catch (const lexing::LexError& e){
+        expected_error = e.what();
+    }
+    try {
+        parse_with_pipeline(bad_code, 4);
+        assert(false);
+    }
+    catch (const lexing::LexError& e){
+        assert(expected_error == e.what());
+    }
+    assert(expected_error.find("Line 202") != std::string::npos);
+}
+
+static void keyword_name(lexing::LexToken& tok){
+    if (tok.value == "print"){
+        tok.symbol = "PRINT";
+    }
+}
+
+static std::shared_ptr<void> count_stmt(parsing::NodeSpan nodes){
+    auto count = std::static_pointer_cast<int>(nodes[0]);
+    ++*count;
+    return count;
+}
+
+static std::shared_ptr<void> first_stmt(parsing::NodeSpan){
+    return std::make_shared<int>(1);
+}
+
+/**
+ * Symbols a token callback adds to the lexer after the parser is made are still parsed, 
+ * with the lexer on the parser's thread or its own.
+ */
+void test_new_lookahead_symbol(){
+    const lexing::TokensMap tokens = {
+        {"NAME", {R"([a-z]+)", keyword_name}},
+        {lang::tokens::NEWLINE, {R"(\n)", nullptr}},
+    };
+    const std::vector<parsing::ParseRule> rules = {
+        {"stmts", {"stmts", "stmt"}, count_stmt},
+        {"stmts", {"stmt"}, first_stmt},
+        {"stmt", {"PRINT", "NAME", lang::tokens::NEWLINE}, nullptr},
+        {"stmt", {"NAME", lang::tokens::NEWLINE}, nullptr},
+        {"stmt", {lang::tokens::NEWLINE}, nullptr},
+    };
+
+    std::unordered_set<std::string> terminals = parsing::keys(tokens);
+    terminals.insert("PRINT");
+    const parsing::Grammar grammar(terminals, rules);
+
+    for (std::size_t pipeline_size : {0, 4}){
+        lexing::Lexer lexer(tokens);
+        assert(lexer.symbol_id("PRINT") == -1);
+        parsing::Parser parser(lexer, grammar);
+        parser.set_pipeline_size(pipeline_size);
+        std::shared_ptr<int> count = std::static_pointer_cast<int>(parser.parse("a\nprint b\nprint c\nd\n"));
+        assert(*count == 5);
+        assert(lexer.symbol_id("PRINT") >= 0);
+    }
+
+    // Added symbols the grammar does not have are errors
+    lexing::Lexer lexer(tokens);
+    std::vector<parsing::ParseRule> no_print(rules);
+    no_print.erase(no_print.begin() + 2);
+    parsing::Parser parser(lexer, parsing::Grammar(terminals, no_print));
+    try {
+        parser.parse("print\n");
+        assert(false);
+    }
+    catch (const parsing::ParseError&){}
+}
+
+/**
+ * The generated table parses the same as the grammar it was generated from.
+ */
+void test_static_parse_table(){
+    std::string code;
+    for (int i = 0; i < 10; ++i){
+        code += "def func" + std::to_string(i) + "():\n    friends = {\"john\", \"pat\"}\n    x + -y * z\n\n";
+    }
+
+    lang::LangLexer lexer(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    parsing::Parser parser(lexer, lang::LANG_PARSE_TABLE, lang::LANG_RULES);
+    assert(!parser.has_grammar());
+    std::shared_ptr<lang::Module> module_node = std::static_pointer_cast<lang::Module>(parser.parse(code));
+    assert(lexer.empty());
+
+    lang::LangLexer other_lexer(lang::LANG_TOKENS);
+    parsing::Parser other_parser(other_lexer, lang::lang_grammar());
+    assert(other_parser.has_grammar());
+    std::shared_ptr<lang::Module> expected = std::static_pointer_cast<lang::Module>(other_parser.parse(code));
+    assert(module_node->str() == expected->str());
+
+    // The error lists the same items as the grammar's, without the instructions
+    std::string expected_error;
+    lang::LangLexer grammar_error_lexer(lang::LANG_TOKENS);
+    parsing::Parser grammar_error_parser(grammar_error_lexer, lang::lang_grammar());
+    try {
+        grammar_error_parser.parse("def f()\n");
+        assert(false);
+    }
+    catch (const parsing::ParseError& e){
+        expected_error = e.what();
+    }
+    lang::LangLexer error_lexer(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    parsing::Parser error_parser(error_lexer, lang::LANG_PARSE_TABLE, lang::LANG_RULES);
+    try {
+        error_parser.parse("def f()\n");
+        assert(false);
+    }
+    catch (const parsing::ParseError& e){
+        const std::string error = e.what();
+        assert(error.find("Unable to handle lookahead 'NEWLINE'") != std::string::npos);
+        assert(error.find(" : ") != std::string::npos);
+        assert(expected_error.compare(0, error.size(), error) == 0);
+    }
+
+    // Rules that do not match the table
+    std::vector<parsing::ParseRule> rules(lang::LANG_RULES.begin(), lang::LANG_RULES.end() - 1);
+    try {
+        parsing::Parser(lexer, lang::LANG_PARSE_TABLE, rules);
+        assert(false);
+    }
+    catch (const std::runtime_error&){}
+}
+
+void test_lazy_grammar(){
+    const std::string code = "def func():\n    friends = {\"john\", \"pat\"}\n    x + -y * z\n\n";
+    const parsing::Grammar grammar(parsing::keys(lang::LANG_TOKENS), lang::LANG_RULES, lang::LANG_PRECEDENCE, 
+                                   parsing::LAZY_SLR_TABLE);
+    assert(grammar.num_lazy_states() == 0);
+
+    lang::LangLexer lexer(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    parsing::Parser parser(lexer, grammar);
+    std::shared_ptr<lang::Module> module_node = std::static_pointer_cast<lang::Module>(parser.parse(code));
+
+    lang::LangLexer other_lexer(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    parsing::Parser other_parser(other_lexer, lang::lang_grammar());
+    std::shared_ptr<lang::Module> expected = std::static_pointer_cast<lang::Module>(other_parser.parse(code));
+    assert(module_node->str() == expected->str());
+
+    // Only the states reached were built, and parsers from the same grammar share them
+    const std::size_t num_states = grammar.num_lazy_states();
+    assert(num_states > 0);
+    assert(num_states < lang::lang_grammar().parse_table().size());
+
+    lang::LangLexer same_lexer(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    parsing::Parser same_parser(same_lexer, grammar);
+    same_parser.parse(code);
+    assert(grammar.num_lazy_states() == num_states);
+
+    lang::LangLexer more_lexer(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    parsing::Parser more_parser(more_lexer, grammar);
+    more_parser.parse("def g(a: num) -> num:\n    if a >= 10:\n        return a\n    return -a\n");
+    assert(grammar.num_lazy_states() > num_states);
+
+    // Parsers on other threads build and read states of the same grammar
+    const parsing::Grammar shared(parsing::keys(lang::LANG_TOKENS), lang::LANG_RULES, lang::LANG_PRECEDENCE, 
+                                  parsing::LAZY_SLR_TABLE);
+    std::vector<std::string> results(4);
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < results.size(); ++i){
+        threads.emplace_back([&shared, &code, &results, i](){
+            lang::LangLexer thread_lexer(lang::LANG_TOKENS, lang::LANG_SCANNER);
+            parsing::Parser thread_parser(thread_lexer, shared);
+            results[i] = std::static_pointer_cast<lang::Module>(thread_parser.parse(code))->str();
+        });
+    }
+    for (std::thread& thread : threads){
+        thread.join();
+    }
+    for (const std::string& result : results){
+        assert(result == expected->str());
+    }
+    assert(shared.num_lazy_states() == num_states);
+}
+
+void test_unit_rules(){
+    std::string code;
+    for (int i = 0; i < 10; ++i){
+        code += "def func" + std::to_string(i) + "(a: num) -> num:\n    x = {a, 2}\n    if a >= 10:\n        return a\n    print(x)\n\n";
+    }
+
+    const parsing::Grammar grammar(parsing::keys(lang::LANG_TOKENS), lang::LANG_RULES, lang::LANG_PRECEDENCE);
+    assert(grammar.unit_rules() == parsing::KEEP_UNIT_RULES);
+    assert(lang::lang_grammar().unit_rules() == parsing::ELIMINATE_UNIT_RULES);
+    assert(lang::lang_grammar().conflicts().size() == grammar.conflicts().size());
+
+    lang::LangLexer lexer(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    parsing::Parser parser(lexer, grammar);
+    std::shared_ptr<lang::Module> module_node = std::static_pointer_cast<lang::Module>(parser.parse(code));
+
+    lang::LangLexer other_lexer(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    parsing::Parser other_parser(other_lexer, lang::lang_grammar());
+    std::shared_ptr<lang::Module> expected = std::static_pointer_cast<lang::Module>(other_parser.parse(code));
+    assert(module_node->str() == expected->str());
+
+    // Every statement and the tuple skip at least one reduction
+    assert(other_parser.stats().num_shifts == parser.stats().num_shifts);
+    assert(other_parser.stats().num_reductions + 50 <= parser.stats().num_reductions);
+
+    lang::LangLexer error_lexer(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    parsing::Parser error_parser(error_lexer, lang::lang_grammar());
+    try {
+        error_parser.parse("def f():\n    x = {1, 2} 3\n");
+        assert(false);
+    }
+    catch (const parsing::ParseError&){}
+}
+
+static std::shared_ptr<void> first_name(parsing::NodeSpan nodes){
+    assert(nodes.size() == 2);
+    auto name = std::static_pointer_cast<lexing::LexToken>(nodes[0]);
+    return std::make_shared<std::string>(name->value);
+}
+
+static std::shared_ptr<void> add_name(parsing::NodeSpan nodes){
+    assert(nodes.size() == 3);
+    std::shared_ptr<void> node = std::move(nodes[0]);
+    assert(!nodes[0]);
+    auto names = std::static_pointer_cast<std::string>(node);
+    *names += nodes.token(1).value;
+    return names;
+}
+
+/**
+ * Callbacks see the production's nodes in order on the parser's stack and can move them out.
+ * Tokens only become nodes if a callback asks for them.
+ */
+void test_node_spans(){
+    const std::vector<parsing::ParseRule> rules = {
+        {"names", {"names", "NAME", lang::tokens::NEWLINE}, add_name},
+        {"names", {"NAME", lang::tokens::NEWLINE}, first_name},
+    };
+
+    lang::LangLexer lexer(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    parsing::Parser parser(lexer, rules);
+    std::shared_ptr<std::string> names = std::static_pointer_cast<std::string>(parser.parse("a\nb\nc\n"));
+    assert(*names == "abc");
+    assert(names.use_count() == 1);
+    assert(parser.stats().num_shifts == 6);
+    assert(parser.stats().num_reductions == 3);
+
+    // Tokens from a lexer on another thread are made from the source after it has moved on
+    lang::LangLexer piped_lexer(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    parsing::Parser piped_parser(piped_lexer, rules);
+    piped_parser.set_pipeline_size(2);
+    assert(*std::static_pointer_cast<std::string>(piped_parser.parse("a\nbb\nccc\n")) == "abbccc");
+
+    // Tokens pushed before a LexToken are still read from the lexer
+    lang::LangLexer push_lexer(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    parsing::Parser push_parser(push_lexer, rules);
+    push_lexer.input("a\nb\n");
+    assert(push_parser.feed(push_lexer.next_token()) == parsing::PUSH_NEED_MORE);
+    assert(push_parser.feed(push_lexer.next_token()) == parsing::PUSH_NEED_MORE);
+    assert(push_parser.feed(lexing::LexToken{"NAME", "x", 3, 2, 1}) == parsing::PUSH_NEED_MORE);
+    push_lexer.next_token();
+    assert(push_parser.feed(push_lexer.next_token()) == parsing::PUSH_NEED_MORE);
+    assert(push_parser.finish() == parsing::PUSH_ACCEPTED);
+    assert(*std::static_pointer_cast<std::string>(push_parser.push_result()) == "ax");
+
+    // Passing a token through keeps it a token
+    const std::vector<parsing::ParseRule> pass_rules = {
+        {"names", {"name", lang::tokens::NEWLINE}, first_name},
+        {"name", {"NAME"}, parsing::pass_through},
+    };
+    lang::LangLexer pass_lexer(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    parsing::Parser pass_parser(pass_lexer, pass_rules);
+    assert(*std::static_pointer_cast<std::string>(pass_parser.parse("a\n")) == "a");
+
+    // A rule without a callback is wrapped in a LexToken holding its name
+    const std::vector<parsing::ParseRule> empty_rules = {
+        {"names", {"NAME", lang::tokens::NEWLINE}, nullptr},
+    };
+    lang::LangLexer empty_lexer(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    parsing::Parser empty_parser(empty_lexer, empty_rules);
+    auto rule_token = std::static_pointer_cast<lexing::LexToken>(empty_parser.parse("a\n"));
+    assert(rule_token->symbol == "names");
+    assert(rule_token->value.empty());
+}
+
+/**
+ * Parse tokens pushed one at a time, both from the parser's lexer and from elsewhere.
+ */
+void test_push_parse(){
+    const std::string code = "def func(a: num) -> num:\n    x = {a, 2}\n    return a\n\n";
+
+    lang::LangLexer expected_lexer(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    parsing::Parser expected_parser(expected_lexer, lang::lang_grammar());
+    std::shared_ptr<lang::Module> expected = std::static_pointer_cast<lang::Module>(expected_parser.parse(code));
+
+    // Tokens found by the parser's own lexer
+    lang::LangLexer lexer(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    parsing::Parser parser(lexer, lang::lang_grammar());
+    lexer.input(code + "\n");
+    std::vector<lexing::LexToken> lex_tokens;
+    for (lexing::Token token = lexer.next_token(); token.symbol != lexer.end_symbol(); token = lexer.next_token()){
+        lex_tokens.push_back(lexer.lex_token(token));
+        assert(parser.feed(token) == parsing::PUSH_NEED_MORE);
+    }
+    assert(!parser.push_result());
+    assert(parser.finish() == parsing::PUSH_ACCEPTED);
+    assert(std::static_pointer_cast<lang::Module>(parser.push_result())->str() == expected->str());
+    assert(parser.stats().num_shifts == lex_tokens.size());
+
+    // The same tokens from somewhere else start a new parse on the same parser
+    for (const lexing::LexToken& lex_token : lex_tokens){
+        assert(parser.feed(lex_token) == parsing::PUSH_NEED_MORE);
+    }
+    assert(parser.finish() == parsing::PUSH_ACCEPTED);
+    assert(std::static_pointer_cast<lang::Module>(parser.push_result())->str() == expected->str());
+    assert(!parser.push_error());
+
+    // Errors end the parse and are kept until the next one starts
+    assert(parser.feed(lex_tokens[0]) == parsing::PUSH_NEED_MORE);
+    assert(parser.feed(lex_tokens[0]) == parsing::PUSH_ERROR);
+    assert(parser.push_error());
+    assert(std::string(parser.push_error()->what()).find("Unable to handle lookahead 'DEF'") != std::string::npos);
+    assert(parser.feed(lex_tokens[0]) == parsing::PUSH_NEED_MORE);
+    assert(!parser.push_error());
+    assert(parser.feed(lexing::LexToken{"UNKNOWN", "?", 1, 1, 1}) == parsing::PUSH_ERROR);
+
+    // Running out of tokens early is an error at the end
+    for (std::size_t i = 0; i < 4; ++i){
+        assert(parser.feed(lex_tokens[i]) == parsing::PUSH_NEED_MORE);
+    }
+    assert(parser.finish() == parsing::PUSH_ERROR);
+    assert(std::string(parser.push_error()->what()).find("Unable to handle lookahead 'END'") != std::string::npos);
+
+    // Errors outlive the parser they came from and its copies
+    std::shared_ptr<const parsing::ParseError> error;
+    {
+        parsing::Parser failed_parser(lexer, lang::lang_grammar());
+        assert(failed_parser.feed(lex_tokens[0]) == parsing::PUSH_NEED_MORE);
+        assert(failed_parser.feed(lex_tokens[0]) == parsing::PUSH_ERROR);
+        parsing::Parser copied_parser(failed_parser);
+        error = copied_parser.push_error();
+    }
+    assert(std::string(error->what()).find("Unable to handle lookahead 'DEF'") != std::string::npos);
+}
+
 int main(){
-    assert(lang::LANG_GRAMMAR.conflicts().empty());
+    assert(lang::lang_grammar().conflicts().empty());
 
     test_tokens();
     test_regular();
     test_empty();
     test_fictitios_token();
     test_ending_on_func_suite();
+    test_token_stream();
+    test_pipelined_parse();
+    test_new_lookahead_symbol();
+    test_static_parse_table();
+    test_lazy_grammar();
+    test_unit_rules();
+    test_node_spans();
+    test_push_parse();
 
     return 0;
 }
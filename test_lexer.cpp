@@ -1,5 +1,10 @@
 #include "lang.h"
 #include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <typeinfo>
 
 #define quote(x) #x  // Converts x to a quoted string
 #define assert_str_equal(s1, s2) __assert_str_equal(s1, s2, __LINE__, __FILE__)
@@ -275,12 +280,663 @@ void test_indentation_error(){
     assert_raises(bad_indeation_code(), lang::IndentationError);
 }
 
+/**
+ * Test the DFA takes the longest match instead of the first regex that matches.
+ */
+void test_dfa_longest_match(){
+    const lexing::TokensMap tokens = {
+        {"NAME", {R"([a-zA-Z_][a-zA-Z0-9_]*)", nullptr}},
+        {"FOR", {"for", nullptr}},
+        {"INT", {R"(\d+)", nullptr}},
+        {"FLOAT", {R"(\d+\.\d*)", nullptr}},
+    };
+    lexing::Lexer lex(tokens);
+    lex.input("format for 12 3.5");
+
+    auto tok = lex.token();
+    assert_str_equal(tok.symbol, "NAME");
+    assert_str_equal(tok.value, "format");
+
+    // Literals take priority over other regexs of the same length
+    tok = lex.token();
+    assert_str_equal(tok.symbol, "FOR");
+    assert_int_equal(tok.colno, 8);
+
+    tok = lex.token();
+    assert_str_equal(tok.symbol, "INT");
+    assert_str_equal(tok.value, "12");
+
+    tok = lex.token();
+    assert_str_equal(tok.symbol, "FLOAT");
+    assert_str_equal(tok.value, "3.5");
+
+    assert(lex.token().symbol == lexing::tokens::END);
+}
+
+/**
+ * Test lookaheads at the end of a regex.
+ */
+void test_dfa_lookahead(){
+    const lexing::TokensMap tokens = {
+        {"SUB", {R"(-(?!>))", nullptr}},
+        {"GT", {R"(>)", nullptr}},
+        {"ASSIGN", {R"(=(?![=]))", nullptr}},
+        {"ASSIGN_PREFIX", {R"(=(?=[=]))", nullptr}},
+    };
+    lexing::Lexer lex(tokens);
+    lex.input("- > = ==");
+
+    assert_str_equal(lex.token().symbol, "SUB");
+    assert_str_equal(lex.token().symbol, "GT");
+    assert_str_equal(lex.token().symbol, "ASSIGN");
+    assert_str_equal(lex.token().symbol, "ASSIGN_PREFIX");
+    assert_str_equal(lex.token().symbol, "ASSIGN");
+
+    // The only regex starting with '-' cannot be followed by '>'
+    lexing::Lexer lex2(tokens);
+    lex2.input("->");
+    bool raised = false;
+    try {
+        lex2.token();
+    } catch (const lexing::LexError& e){
+        raised = true;
+    }
+    assert(raised);
+}
+
+/**
+ * Test regexs the DFA cannot handle are rejected.
+ */
+void test_dfa_unsupported(){
+    for (const char* regex : {"^a", R"((a)\1)", "a(?!b)c", "(a(?!b))", "a(?!b)|c", "[a"}){
+        bool raised = false;
+        try {
+            lexing::TokensDFA dfa({{"A", {regex, nullptr}}});
+        } catch (const std::runtime_error& e){
+            raised = true;
+        }
+        assert(raised);
+    }
+}
+
+/**
+ * Test both engines find the same tokens for the lang tokens.
+ */
+void test_engines_match(){
+    const std::string code = R"(
+def main(argc: num) -> num:
+    # comment
+    x = {1, "two \" three", a.b}
+    if x == 3:
+        return -x - 2 * (y \ 4)
+    y = x <= 2 != z >= w < v > u
+)";
+
+    lang::LangLexer regex_lexer(lang::LANG_TOKENS, lexing::REGEX_ENGINE);
+    lang::LangLexer dfa_lexer(lang::LANG_TOKENS, lexing::DFA_ENGINE);
+    assert(regex_lexer.engine() == lexing::REGEX_ENGINE);
+    assert(dfa_lexer.engine() == lexing::DFA_ENGINE);
+    regex_lexer.input(code);
+    dfa_lexer.input(code);
+
+    lexing::LexToken tok;
+    do {
+        tok = regex_lexer.token();
+        assert_str_equal(dfa_lexer.token().str(), tok.str());
+    } while (tok.symbol != lexing::tokens::END);
+}
+
+/**
+ * Test the remaining code is tracked by the cursor.
+ */
+void test_cursor(){
+    lexing::Lexer lex(test_tokens);
+    lex.input("x + y");
+    assert_str_equal(lex.token().value, "x");
+    assert_int_equal(lex.cursor(), 1);
+    assert_str_equal(lex.lexcode(), " + y");
+
+    lex.input(" ? z");
+    lex.token();  // +
+    lex.token();  // y
+    assert_str_equal(lex.lexcode(), " ? z");
+
+    std::string what;
+    try {
+        lex.token();
+    } catch (const lexing::LexError& e){
+        what = e.what();
+    }
+    assert_str_equal(what, "Lexer error: Start of string '? z' did not match the start of any tokens. Line 1, col 7.");
+    assert_int_equal(lex.cursor(), 6);
+    assert(!lex.empty());
+}
+
+/**
+ * Test lexing a tail that is not part of the source.
+ */
+void test_input_tail(){
+    for (lexing::LexerEngine engine : {lexing::DFA_ENGINE, lexing::REGEX_ENGINE}){
+        lexing::Lexer lex(test_tokens, engine);
+        lex.input("x\n");
+        lex.input_tail("\n");
+        assert_str_equal(lex.source()->str(), "x\n");
+        assert_str_equal(lex.lexcode(), "x\n\n");
+
+        assert_str_equal(lex.token().value, "x");
+
+        // Newlines in the source and tail are one token
+        auto tok = lex.token();
+        assert_str_equal(tok.symbol, lang::tokens::NEWLINE);
+        assert_str_equal(tok.value, "\n\n");
+        assert(lex.empty());
+
+        // More input goes after the tail
+        lex.input("y");
+        tok = lex.token();
+        assert_str_equal(tok.value, "y");
+        assert_int_equal(tok.lineno, 3);
+    }
+}
+
+/**
+ * Test lexing a file mapped into memory.
+ */
+void test_source_file(){
+    const std::string filename = "test_lexer_source.tmp";
+    std::ofstream out(filename);
+    out << "x + 4";
+    out.close();
+
+    auto source = lexing::SourceBuffer::from_file(filename);
+    assert(source->mapped());
+    assert_str_equal(source->str(), "x + 4");
+
+    lexing::Lexer lex(test_tokens);
+    lex.input(source);
+    assert(lex.source() == source);
+    assert_str_equal(lex.token().symbol, "NAME");
+    assert_str_equal(lex.token().symbol, "ADD");
+    assert_str_equal(lex.token().value, "4");
+    assert(lex.empty());
+
+    // Once it was all lexed, the next source is lexed without copying it
+    for (lexing::LexerEngine engine : {lexing::DFA_ENGINE, lexing::REGEX_ENGINE}){
+        lexing::Lexer reused(test_tokens, engine);
+        reused.input(source);
+        while (reused.token().symbol != lexing::tokens::END);
+        reused.input(source);
+        assert(reused.source() == source);
+        assert(reused.source()->mapped());
+
+        // Positions carry on from the end of the first source
+        auto x = reused.token();
+        assert_str_equal(x.value, "x");
+        assert_int_equal(x.lineno, 1);
+        assert_int_equal(x.colno, 6);
+    }
+
+    // Nothing to map
+    std::ofstream(filename).close();
+    source = lexing::SourceBuffer::from_file(filename);
+    assert(!source->mapped());
+    assert(source->empty());
+
+    std::remove(filename.c_str());
+}
+
+/**
+ * Test edited sources are read from their pieces the same as the joined code.
+ */
+void test_edited_source(){
+    auto source = std::make_shared<lexing::SourceBuffer>("abc def");
+    auto edited = lexing::SourceBuffer::edited(source, " g", {2, 3, "xyz"});
+    auto edited_again = lexing::SourceBuffer::edited(edited, "", {0, 1, ""});
+    assert_int_equal(edited->size(), 9);
+    assert_int_equal(edited->at(4), 'z');
+    assert_int_equal(edited_again->at(1), 'x');
+
+    std::string copied(6, '\0');
+    edited_again->copy(2, 6, &copied[0]);
+    assert_str_equal(copied, "yzef g");
+    assert_str_equal(edited->str(), "abxyzef g");
+    assert_str_equal(edited_again->str(), "bxyzef g");
+    assert_str_equal(source->str(), "abc def");
+
+    // Joining many pieces at once
+    std::shared_ptr<const lexing::SourceBuffer> many = source;
+    std::string expected = source->str();
+    for (std::size_t i = 0; i < 200; ++i){
+        many = lexing::SourceBuffer::edited(many, "", {i % many->size(), 0, "+"});
+        expected.insert(i % expected.size(), "+");
+    }
+    assert_str_equal(many->str(), expected);
+}
+
+static void trim_quotes(lexing::LexToken& tok){
+    tok.value = tok.value.substr(1, tok.value.size()-2);
+}
+
+static void upper_name(lexing::LexToken& tok){
+    if (tok.value == "x"){
+        tok.symbol = "X";
+        tok.value = "X";
+    }
+}
+
+/**
+ * Test compact tokens refer back to the code.
+ */
+void test_compact_tokens(){
+    const lexing::TokensMap tokens = {
+        {"NAME", {R"([a-z]+)", upper_name}},
+        {"STRING", {R"("[^"]*")", trim_quotes}},
+    };
+    lexing::Lexer lex(tokens);
+
+    // IDs are in order of name
+    assert_int_equal(lex.symbol_id("NAME"), 0);
+    assert_int_equal(lex.symbol_id("STRING"), 1);
+    assert_str_equal(lex.symbol_name(lex.end_symbol()), lexing::tokens::END);
+    assert_int_equal(lex.symbol_id("X"), -1);
+
+    lex.input("abc \"de f\" x");
+    lexing::Token tok = lex.next_token();
+    assert_int_equal(tok.symbol, lex.symbol_id("NAME"));
+    assert_int_equal(tok.offset, 0);
+    assert_int_equal(tok.length, 3);
+    assert_str_equal(lex.value(tok), "abc");
+
+    // Value trimmed by the callback, at the position of the whole match
+    tok = lex.next_token();
+    assert_int_equal(tok.symbol, lex.symbol_id("STRING"));
+    assert_int_equal(tok.offset, 4);
+    assert_int_equal(tok.length, 6);
+    assert_str_equal(lex.value(tok), "de f");
+    assert_int_equal(tok.colno, 5);
+    assert_int_equal(lex.lex_token(tok).pos, 5);
+
+    // Value and symbol replaced by the callback
+    tok = lex.next_token();
+    assert_str_equal(lex.symbol_name(tok.symbol), "X");
+    assert_str_equal(lex.value(tok), "X");
+    assert_str_equal(lex.lex_token(tok).str(), "{symbol: X, value: 'X', pos: 12, lineno: 1, colno: 12}");
+
+    assert(lex.next_token().symbol == lex.end_symbol());
+}
+
+void test_position_tracking(){
+    const std::string code = "def f(a):\n    # comment\n    return \"x\\ny\"\n\nb = 2";
+
+    lang::LangLexer lines_lexer(lang::LANG_TOKENS, lexing::DFA_ENGINE, lexing::TRACK_LINES);
+    lang::LangLexer offsets_lexer(lang::LANG_TOKENS);
+    assert(offsets_lexer.tracking() == lexing::TRACK_OFFSETS);
+    lines_lexer.input(code);
+    offsets_lexer.input(code);
+    lines_lexer.input_tail("\n");
+    offsets_lexer.input_tail("\n");
+
+    lexing::LexToken tok;
+    do {
+        tok = lines_lexer.token();
+        assert_str_equal(offsets_lexer.token().str(), tok.str());
+        assert_int_equal(offsets_lexer.lineno(), lines_lexer.lineno());
+        assert_int_equal(offsets_lexer.colno(), lines_lexer.colno());
+    } while (tok.symbol != lexing::tokens::END);
+
+    // Only the offset is kept in the compact token
+    lexing::Lexer lex(test_tokens, lexing::DFA_ENGINE, lexing::TRACK_OFFSETS);
+    lex.input("x\n  y");
+    lex.next_token();
+    lex.next_token();
+    lexing::Token y = lex.next_token();
+    assert_int_equal(y.lineno, 0);
+    assert_int_equal(lex.lineno(y), 2);
+    assert_int_equal(lex.colno(y), 3);
+
+    // A new source given once the old one was all lexed carries on from where it ended
+    assert(lex.next_token().symbol == lex.end_symbol());
+    lex.input("z\nw");
+    lexing::Token z = lex.next_token();
+    assert_int_equal(z.offset, 0);
+    assert_int_equal(lex.lineno(z), 2);
+    assert_int_equal(lex.colno(z), 4);
+    lex.next_token();
+    lexing::Token w = lex.next_token();
+    assert_int_equal(lex.lineno(w), 3);
+    assert_int_equal(lex.colno(w), 1);
+}
+
+void test_scans(){
+    // Runs of every length around the block sizes, ending in each way a scan can stop
+    const lexing::scan::InstructionSet best = lexing::scan::best_instruction_set();
+    const lexing::scan::InstructionSet instruction_sets[] = {lexing::scan::SCALAR, lexing::scan::SSE2, lexing::scan::AVX2};
+    const char quote_bytes[] = {'"', '\\'};
+    for (lexing::scan::InstructionSet instruction_set : instruction_sets){
+        lexing::scan::set_instruction_set(instruction_set);
+        assert(lexing::scan::instruction_set() <= best);
+
+        for (std::size_t len = 0; len < 70; ++len){
+            std::string comment = std::string(len, 'x') + "\nabc";
+            const char* begin = comment.data();
+            const char* end = begin + comment.size();
+            assert(lexing::scan::find_any(begin, end, "\n", 1) == begin + len);
+            assert(lexing::scan::find_any(begin, begin + len, "\n", 1) == begin + len);
+
+            std::string str = std::string(len, 'x') + "\\\"";
+            assert(lexing::scan::find_any(str.data(), str.data() + str.size(), quote_bytes, 2) == str.data() + len);
+
+            std::string spaces = std::string(len, ' ') + "x";
+            assert(lexing::scan::find_not(spaces.data(), spaces.data() + spaces.size(), ' ') == spaces.data() + len);
+
+            std::string whitespace;
+            for (std::size_t i = 0; i < len; ++i){
+                whitespace += " \t\n\v\f\r"[i % 6];
+            }
+            whitespace += "\x08";
+            assert(lexing::scan::skip_space(whitespace.data(), whitespace.data() + whitespace.size()) == whitespace.data() + len);
+        }
+    }
+    lexing::scan::set_instruction_set(best);
+
+    // Skipping through comments and strings in the DFA, including across the tail
+    const std::string filler(100, 'z');
+    lang::LangLexer lex(lang::LANG_TOKENS);
+    lex.input("x = \"" + filler + "\\\"" + filler + "\" # " + filler);
+    lex.input_tail(filler + "\n" + "\t\t  \t" + filler);
+    assert_str_equal(lex.token().value, "x");
+    assert_str_equal(lex.token().symbol, "ASSIGN");
+    assert_str_equal(lex.token().value, filler + "\\\"" + filler);
+    assert_str_equal(lex.token().symbol, lang::tokens::NEWLINE);
+    assert_str_equal(lex.token().symbol, lang::tokens::INDENT);
+    auto tok = lex.token();
+    assert_str_equal(tok.value, filler);
+    assert_int_equal(tok.lineno, 2);
+    assert_int_equal(tok.colno, 6);
+}
+
+void test_generated_scanner(){
+    const std::string code = R"(
+def format(int: num, define) -> num:
+    # comment
+    for x in {1, "two \" three", a.b}:
+        if x == 3:
+            return -x - 2 * (y \ 4)
+    y = x <= 2 != z >= w < v > u
+)";
+
+    lang::LangLexer dfa_lexer(lang::LANG_TOKENS);
+    lang::LangLexer generated_lexer(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    assert(generated_lexer.engine() == lexing::GENERATED_ENGINE);
+    dfa_lexer.input(code);
+    generated_lexer.input(code);
+    dfa_lexer.input_tail("\n");
+    generated_lexer.input_tail("\n");
+
+    lexing::LexToken tok;
+    do {
+        tok = dfa_lexer.token();
+        assert_str_equal(generated_lexer.token().str(), tok.str());
+    } while (tok.symbol != lexing::tokens::END);
+
+    // The scanner only works with the tokens it was made from
+    try {
+        lexing::Lexer lex(test_tokens, lang::LANG_SCANNER);
+        assert(0);
+    }
+    catch (const std::runtime_error&){}
+
+    // Keywords are left to the hash instead of the automaton
+    std::ostringstream generated;
+    lexing::generate_scanner(generated, lang::LANG_TOKENS, "lang", "LANG_SCANNER", "NAME", lang::RESERVED_NAMES);
+    assert(generated.str().find("KEYWORDS[") != std::string::npos);
+    assert(generated.str().find("case 'd':") != std::string::npos);
+    assert(generated.str().find("\"def\"") != std::string::npos);
+}
+
+void test_tokenize(){
+    const std::string code = R"(x
+
+    a
+      b
+
+    d
+
+        e
+f
+    g
+        h)";
+
+    lang::LangLexer lex(test_tokens);
+    lang::LangLexer batch_lex(test_tokens);
+    lex.input(code);
+    batch_lex.input(code);
+
+    // Same tokens as lexing one at a time, including the indentation
+    lexing::TokenStream stream = batch_lex.tokenize();
+    for (std::size_t i = 0; i < stream.size(); ++i){
+        assert_str_equal(stream.value(stream.token(i)), lex.value(stream.token(i)));
+        assert_str_equal(batch_lex.lex_token(stream.token(i)).str(), lex.token().str());
+    }
+    assert(lex.empty());
+    assert_int_equal(stream.symbols.back(), batch_lex.end_symbol());
+    assert_int_equal(stream.symbols[stream.size() - 2], batch_lex.symbol_id(lang::tokens::DEDENT));
+
+    // The stream keeps its code after the lexer moves on
+    const lexing::Token last_name = stream.token(stream.size() - 4);
+    batch_lex.input("other code");
+    assert_str_equal(stream.value(last_name), "h");
+    assert_int_equal(last_name.lineno, 11);
+    assert_int_equal(last_name.colno, 9);
+
+    lang::LangLexer bad_lex(test_tokens);
+    bad_lex.input("x\n  y\n z\n");
+    assert_raises(bad_lex.tokenize(), lang::IndentationError);
+}
+
+static void assert_streams_equal(const lexing::TokenStream& stream1, const lexing::TokenStream& stream2){
+    assert(stream1.symbols == stream2.symbols);
+    assert(stream1.offsets == stream2.offsets);
+    assert(stream1.lengths == stream2.lengths);
+    assert(stream1.lines == stream2.lines);
+    assert(stream1.columns == stream2.columns);
+    assert(stream1.callback_values == stream2.callback_values);
+    assert(stream1.depths == stream2.depths);
+}
+
+static void print_keyword(lexing::LexToken& tok){
+    if (tok.value == "print"){
+        tok.symbol = "PRINT";
+    }
+}
+
+static void no_boom(lexing::LexToken& tok){
+    if (tok.value == "boom"){
+        throw std::logic_error("boom");
+    }
+}
+
+/**
+ * Check that lexing in parallel gives the same stream as lexing sequentially.
+ */
+static void assert_same_stream(const std::string& code, std::size_t num_threads){
+    lang::LangLexer lex(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    lang::LangLexer parallel_lex(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    lex.input(code);
+    parallel_lex.input(code);
+
+    assert_streams_equal(lex.tokenize(), parallel_lex.tokenize_parallel(num_threads, 1));
+    assert(parallel_lex.empty());
+}
+
+void test_tokenize_parallel(){
+    // Strings and comments with lines that look like the start of a chunk
+    const std::string code = R"(x = 1
+def func(a, b):
+    s = "first line
+second line
+    third line"
+    if a:
+        # comment with "quotes
+return
+    return b
+y = "
+z = 'not a string' # "
+t = 2
+)";
+    for (std::size_t num_threads : {2, 3, 8}){
+        assert_same_stream(code, num_threads);
+    }
+
+    std::string module;
+    for (std::size_t i = 0; i < 50; ++i){
+        module += "def f" + std::to_string(i) + "():\n    return \"a\n\nb\"\n# c\n\n";
+    }
+    assert_same_stream(module, 4);
+    assert_same_stream("", 4);
+
+    // Starting after the cursor
+    lang::LangLexer lex(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    lang::LangLexer parallel_lex(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    lex.input(module);
+    parallel_lex.input(module);
+    lex.next_token();
+    parallel_lex.next_token();
+    assert(lex.tokenize().columns == parallel_lex.tokenize_parallel(4, 1).columns);
+
+    // Errors are the same as lexing sequentially
+    lang::LangLexer bad_lex(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    bad_lex.input(module + "x\n  y\n z\n" + module);
+    assert_raises(bad_lex.tokenize_parallel(4, 1), lang::IndentationError);
+    lang::LangLexer bad_chars_lex(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    bad_chars_lex.input(module + "x = $\n" + module);
+    assert_raises(bad_chars_lex.tokenize_parallel(4, 1), lexing::LexError);
+
+    // The first error in the code is thrown when there are different kinds
+    lang::LangLexer indent_first_lex(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    indent_first_lex.input(module + "x\n  y\n z\n" + module + "x = $\n" + module);
+    assert_raises(indent_first_lex.tokenize_parallel(4, 1), lang::IndentationError);
+    lang::LangLexer lex_first_lex(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    lex_first_lex.input(module + "x = $\n" + module + "x\n  y\n z\n" + module);
+    assert_raises(lex_first_lex.tokenize_parallel(4, 1), lexing::LexError);
+
+    // Symbols that callbacks add get the same IDs
+    lexing::TokensMap print_tokens = lang::LANG_TOKENS;
+    print_tokens["NAME"].second = print_keyword;
+    lang::LangLexer print_lex(print_tokens), parallel_print_lex(print_tokens);
+    const std::string print_code = module + "print a\n" + module + "print b\n";
+    print_lex.input(print_code);
+    parallel_print_lex.input(print_code);
+    assert_streams_equal(print_lex.tokenize(), parallel_print_lex.tokenize_parallel(4, 1));
+    assert(parallel_print_lex.symbol_id("PRINT") == print_lex.symbol_id("PRINT"));
+
+    // Anything a callback throws other than a LexError is thrown from the chunk
+    lexing::TokensMap boom_tokens = lang::LANG_TOKENS;
+    boom_tokens["NAME"].second = no_boom;
+    lang::LangLexer boom_lex(boom_tokens);
+    boom_lex.input(module + "boom\n" + module);
+    assert_raises(boom_lex.tokenize_parallel(4, 1), std::logic_error);
+}
+
+/**
+ * Make edits to the code and check that relexing each one gives the same stream as lexing 
+ * the edited code from scratch, or fails the same way.
+ */
+template <typename LexerT>
+static void check_relex(LexerT lex, const LexerT& fresh_lex, std::string code, 
+                        const std::vector<std::string>& insertions, std::size_t num_edits){
+    lex.input(code);
+    lexing::TokenStream stream = lex.tokenize();
+
+    std::minstd_rand random(7);
+    for (std::size_t i = 0; i < num_edits; ++i){
+        lexing::Edit edit;
+        edit.offset = random() % (code.size() + 1);
+        edit.removed = std::min<std::size_t>(random() % 8, code.size() - edit.offset);
+        edit.inserted = insertions[random() % insertions.size()];
+        std::string edited = code.substr(0, edit.offset) + edit.inserted + code.substr(edit.offset + edit.removed);
+
+        LexerT expected_lex(fresh_lex);
+        expected_lex.input(edited);
+        lexing::TokenStream expected;
+        try {
+            expected = expected_lex.tokenize();
+        }
+        catch (const std::exception& e){
+            // The stream stays as it was if the edit does not lex
+            std::size_t size = stream.size();
+            try {
+                lex.relex(stream, edit);
+                assert(false);
+            }
+            catch (const std::exception& relex_error){
+                assert_str_equal(typeid(relex_error).name(), typeid(e).name());
+            }
+            assert_int_equal(stream.size(), size);
+            continue;
+        }
+
+        lex.relex(stream, edit);
+        code = edited;
+        assert_streams_equal(stream, expected);
+        assert_str_equal(stream.source->str(), code);
+        assert(lex.empty());
+    }
+}
+
+void test_relex(){
+    check_relex(lexing::Lexer(test_tokens), lexing::Lexer(test_tokens), 
+                "a + 1\nb\n\n c * 22 - d\nee\n", {"", "x", "1", " ", "\n", "+ 3", "\n\nz"}, 300);
+
+    std::string module;
+    for (std::size_t i = 0; i < 20; ++i){
+        module += "def f" + std::to_string(i) + "(a):\n    # c\n    if a:\n        return \"a\n\nb\"\n    return a\n\n";
+    }
+    const lang::LangLexer lang_lex(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    check_relex(lang_lex, lang_lex, module, {
+        "", "x", " ", "    ", "\n", "\n    ", "\"", "# \"", "1", "def g():\n    return 1\n", "\"a\nb\"", ":\n        y\n"
+    }, 500);
+
+    // Edits at the ends of the code
+    lang::LangLexer lex(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    lex.input(module);
+    lexing::TokenStream stream = lex.tokenize();
+    lex.relex(stream, {module.size(), 0, "x = 1\n"});
+    lex.relex(stream, {0, 0, "y = 2\n"});
+    lang::LangLexer expected_lex(lang::LANG_TOKENS, lang::LANG_SCANNER);
+    expected_lex.input("y = 2\n" + module + "x = 1\n");
+    assert_streams_equal(stream, expected_lex.tokenize());
+    assert_raises(lex.relex(stream, {stream.source->size(), 1, ""}), std::runtime_error);
+
+    // Code far from the edits is only lexed when the tokens do not line up near them
+    std::string large_module;
+    for (std::size_t i = 0; i < 10; ++i){
+        large_module += module;
+    }
+    check_relex(lang_lex, lang_lex, large_module, {"", "x", "\n    ", "\"", "# \"", "\"a\nb\"", ":\n        y\n"}, 100);
+}
+
 int main(){
     test_lexer_creation();
     test_lexer_input();
     test_name();
     test_indentation();
     test_indentation_error();
+    test_dfa_longest_match();
+    test_dfa_lookahead();
+    test_dfa_unsupported();
+    test_engines_match();
+    test_cursor();
+    test_input_tail();
+    test_source_file();
+    test_edited_source();
+    test_compact_tokens();
+    test_position_tracking();
+    test_scans();
+    test_generated_scanner();
+    test_tokenize();
+    test_tokenize_parallel();
+    test_relex();
 
     return 0;
 }
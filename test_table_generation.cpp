@@ -1,6 +1,9 @@
 #include "lang.h"
 #include "utils.h"
 #include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
 
 static const lexing::TokensMap test_tokens = {
     // Values
@@ -212,6 +215,54 @@ void test_rules5(){
     assert(grammar.follows("X") == expected);
 }
 
+/**
+ * Mutually recursive nonterminals that can be empty, and empty symbols in the middle of a 
+ * production, so the follows have to look past the next symbol.
+ */
+void test_mutually_recursive_firsts(){
+    const lexing::TokensMap tokens = {
+        {"a", {"a", nullptr}},
+        {"b", {"b", nullptr}},
+        {"d", {"d", nullptr}},
+        {"y", {"y", nullptr}},
+    };
+
+    const std::vector<parsing::ParseRule> rules = {
+        {"S", {"A", "Y", "d"}, nullptr},
+        {"A", {"B", "a"}, nullptr},
+        {"A", {parsing::nonterminals::EPSILON}, nullptr},
+        {"B", {"A", "b"}, nullptr},
+        {"Y", {"y"}, nullptr},
+        {"Y", {parsing::nonterminals::EPSILON}, nullptr},
+    };
+
+    lang::LangLexer lexer(tokens);
+    parsing::Grammar grammar(parsing::keys(lexer.tokens()), rules);
+
+    // firsts 
+    std::unordered_set<std::string> expected = {"b", "y", "d"};
+    assert(grammar.firsts("S") == expected);
+    expected = {"b", parsing::nonterminals::EPSILON};
+    assert(grammar.firsts("A") == expected);
+    expected = {"b"};
+    assert(grammar.firsts("B") == expected);
+    expected = {"y", parsing::nonterminals::EPSILON};
+    assert(grammar.firsts("Y") == expected);
+    expected = {"d"};
+    assert(grammar.firsts("d") == expected);
+
+    // follows 
+    expected = {lexing::tokens::END};
+    assert(grammar.follows("S") == expected);
+    expected = {"y", "d", "b"};
+    assert(grammar.follows("A") == expected);
+    expected = {"a"};
+    assert(grammar.follows("B") == expected);
+    expected = {"d"};
+    assert(grammar.follows("Y") == expected);
+    assert(grammar.conflicts().empty());
+}
+
 static std::unordered_map<std::string, std::string> RESERVED_NAMES = {
     {"def", "DEF"},
     {"TOKEN", "TOKEN"},
@@ -308,6 +359,78 @@ void test_move_pos(){
     assert(int_item_set == int_expected);
 }
 
+/**
+ * Build the DFA with init_closure and move_pos on whole lr items.
+ */
+static parsing::DFA make_item_dfa(const std::vector<parsing::ParseRule>& parse_rules){
+    parsing::LRItemSet top_item_set = {{parse_rules.front(), 0}};
+    parsing::init_closure(top_item_set, parse_rules);
+    parsing::DFA dfa = {top_item_set};
+    for (std::size_t i = 0; i < dfa.size(); ++i){
+        const parsing::LRItemSet item_set = dfa[i];
+        for (const parsing::LRItem& lr_item : item_set){
+            const std::vector<std::string>& prod = lr_item.parse_rule.production;
+            if (lr_item.pos < prod.size()){
+                parsing::LRItemSet moved = parsing::move_pos(item_set, prod[lr_item.pos], parse_rules);
+                if (std::find(dfa.begin(), dfa.end(), moved) == dfa.end()){
+                    dfa.push_back(moved);
+                }
+            }
+        }
+    }
+    return dfa;
+}
+
+/**
+ * Check each transition goes to the item set move_pos gives, and that there is one for 
+ * every symbol after an item.
+ */
+static void assert_transitions_match(const parsing::DFA& dfa, const parsing::Transitions& transitions,
+                                     const std::vector<parsing::ParseRule>& parse_rules){
+    assert(transitions.size() == dfa.size());
+    for (std::size_t i = 0; i < dfa.size(); ++i){
+        for (const auto& transition : transitions[i]){
+            assert(parsing::move_pos(dfa[i], transition.first, parse_rules) == dfa[transition.second]);
+        }
+        for (const parsing::LRItem& lr_item : dfa[i]){
+            const std::vector<std::string>& prod = lr_item.parse_rule.production;
+            assert(lr_item.pos == prod.size() || transitions[i].count(prod[lr_item.pos]));
+        }
+    }
+}
+
+void test_make_dfa(){
+    parsing::Transitions transitions;
+    const std::vector<parsing::ParseRule> rules = parsing::prepend_prime_rule(test_rules);
+    parsing::DFA dfa = parsing::make_dfa(rules, transitions);
+    assert(dfa == make_item_dfa(rules));
+    assert_transitions_match(dfa, transitions, rules);
+
+    const std::vector<parsing::ParseRule> lang_rules = parsing::trim_overload_tokens(
+        parsing::prepend_prime_rule(lang::LANG_RULES));
+    dfa = parsing::make_dfa(lang_rules, transitions);
+    assert(dfa == make_item_dfa(lang_rules));
+    assert_transitions_match(dfa, transitions, lang_rules);
+
+    // The item sets are the closures of the kernels
+    const parsing::InternedRules interned(lang_rules);
+    std::vector<parsing::LRItemIDSet> kernels = parsing::make_kernels(interned, transitions);
+    assert(kernels.size() == dfa.size());
+
+    // Finding them on more threads does not change them or their order
+    for (std::size_t num_threads : {3, 4}){
+        parsing::Transitions threaded_transitions;
+        assert(parsing::make_kernels(interned, threaded_transitions, num_threads) == kernels);
+        assert(threaded_transitions == transitions);
+    }
+    std::vector<bool> started(lang_rules.size(), false);
+    for (std::size_t i = 0; i < kernels.size(); ++i){
+        assert(kernels[i].size() <= dfa[i].size());
+        interned.closure(kernels[i], started);
+        assert(parsing::make_item_set(kernels[i], lang_rules) == dfa[i]);
+    }
+}
+
 void test_parse_precedence(){
     lang::LangLexer lexer(test_tokens);
 
@@ -320,6 +443,306 @@ void test_parse_precedence(){
     assert(grammar2.conflicts().empty());
 }
 
+/**
+ * Check the dense table has exactly the instructions in the string keyed table.
+ */
+static void assert_dense_table_matches(const parsing::Grammar& grammar){
+    const parsing::ParseTable& parse_table = grammar.parse_table();
+    const parsing::DenseParseTable& dense_table = grammar.dense_table();
+    assert(dense_table.num_states() == parse_table.size());
+    assert(dense_table.num_symbols() == grammar.symbols().size());
+
+    for (std::size_t state = 0; state < parse_table.size(); ++state){
+        const auto& action_table = parse_table.at(state);
+        for (std::size_t symbol = 0; symbol < dense_table.num_symbols(); ++symbol){
+            const std::string& name = grammar.symbols()[symbol];
+            assert(grammar.symbol_id(name) == static_cast<int>(symbol));
+
+            parsing::PackedInstr packed = dense_table.instr(state, symbol);
+            auto found = action_table.find(name);
+            if (found == action_table.end()){
+                assert(packed == parsing::NO_INSTR);
+            }
+            else {
+                assert(packed != parsing::NO_INSTR);
+                assert(parsing::unpack_instr(packed) == found->second);
+            }
+        }
+    }
+}
+
+/**
+ * Check the compressed table gives the same instructions as the dense one, other than 
+ * reducing by default where the dense table has no instruction.
+ */
+static void assert_compressed_table_matches(const parsing::Grammar& grammar){
+    const parsing::DenseParseTable& dense_table = grammar.dense_table();
+    const parsing::CompressedParseTable& compressed_table = grammar.compressed_table();
+    assert(compressed_table.size() < dense_table.size());
+
+    for (std::size_t state = 0; state < dense_table.num_states(); ++state){
+        for (std::size_t symbol = 0; symbol < dense_table.num_symbols(); ++symbol){
+            parsing::PackedInstr packed = dense_table.instr(state, symbol);
+            if (symbol >= grammar.num_terminals()){
+                if (packed != parsing::NO_INSTR){
+                    parsing::ParseInstr instr = parsing::unpack_instr(packed);
+                    assert(instr.action == parsing::ParseInstr::GOTO);
+                    assert(compressed_table.goto_state(state, symbol) == static_cast<std::size_t>(instr.value));
+                }
+                continue;
+            }
+
+            parsing::PackedInstr compressed = compressed_table.action(state, compressed_table.terminal_class(symbol));
+            if (packed != parsing::NO_INSTR){
+                assert(compressed == packed);
+            }
+            else if (compressed != parsing::NO_INSTR){
+                assert(parsing::unpack_instr(compressed).action == parsing::ParseInstr::REDUCE);
+            }
+        }
+    }
+}
+
+void test_dense_table(){
+    parsing::ParseInstr instr = {parsing::ParseInstr::SHIFT, 0};
+    assert(parsing::pack_instr(instr) != parsing::NO_INSTR);
+    assert(parsing::unpack_instr(parsing::pack_instr(instr)) == instr);
+    instr = {parsing::ParseInstr::ACCEPT, 12345};
+    assert(parsing::unpack_instr(parsing::pack_instr(instr)) == instr);
+
+    lang::LangLexer lexer(test_tokens);
+    parsing::Grammar grammar(parsing::keys(lexer.tokens()), test_rules, test_precedence);
+    assert_dense_table_matches(grammar);
+    assert_compressed_table_matches(grammar);
+    assert(grammar.symbol_id("expr") >= 0);
+    assert(grammar.symbol_id(lexing::tokens::END) >= 0);
+    assert(grammar.symbol_id("not a symbol") == -1);
+
+    assert_dense_table_matches(lang::lang_grammar());
+    assert_compressed_table_matches(lang::lang_grammar());
+}
+
+/**
+ * S -> L = R | R, L -> * R | id, R -> L is LALR(1) but not SLR(1), since = follows R
+ * through S -> L = R and R -> L.
+ */
+void test_lalr_tables(){
+    const std::unordered_set<std::string> tokens = {"EQ", "STAR", "ID"};
+    const std::vector<parsing::ParseRule> rules = {
+        {"s", {"l", "EQ", "r"}, nullptr},
+        {"s", {"r"}, nullptr},
+        {"l", {"STAR", "r"}, nullptr},
+        {"l", {"ID"}, nullptr},
+        {"r", {"l"}, nullptr},
+    };
+
+    parsing::Grammar slr(tokens, rules);
+    assert(slr.construction() == parsing::SLR_TABLE);
+    assert(slr.conflicts().size() == 1);
+
+    // A lazy grammar finds the conflict once it builds the state with it
+    parsing::Grammar lazy(tokens, rules, {{}}, parsing::LAZY_SLR_TABLE);
+    assert(lazy.conflicts().empty());
+    std::ostringstream states;
+    for (std::size_t state = 0; state < slr.parse_table().size(); ++state){
+        lazy.dump_state(state, states);
+    }
+    assert(lazy.conflicts().size() == 1);
+    assert(lazy.conflicts()[0].lookahead == slr.conflicts()[0].lookahead);
+
+    parsing::Grammar lalr(tokens, rules, {{}}, parsing::LALR_TABLE);
+    assert(lalr.conflicts().empty());
+    assert(lalr.parse_table().size() == slr.parse_table().size());
+    assert_dense_table_matches(lalr);
+    assert_compressed_table_matches(lalr);
+
+    parsing::Grammar lr1(tokens, rules, {{}}, parsing::LR1_TABLE);
+    assert(lr1.conflicts().empty());
+    assert_dense_table_matches(lr1);
+    assert_compressed_table_matches(lr1);
+}
+
+/**
+ * S -> a E c | a F d | b E d | b F c, E -> e, F -> e is LR(1) but not LALR(1). Merging the
+ * states after a e and b e would make a reduce/reduce conflict, so they must stay apart.
+ */
+void test_lr1_tables(){
+    const std::unordered_set<std::string> tokens = {"A", "B", "C", "D", "E"};
+    const std::vector<parsing::ParseRule> rules = {
+        {"s", {"A", "e", "C"}, nullptr},
+        {"s", {"A", "f", "D"}, nullptr},
+        {"s", {"B", "e", "D"}, nullptr},
+        {"s", {"B", "f", "C"}, nullptr},
+        {"e", {"E"}, nullptr},
+        {"f", {"E"}, nullptr},
+    };
+
+    parsing::Grammar lalr(tokens, rules, {{}}, parsing::LALR_TABLE);
+    assert(lalr.conflicts().size() == 2);
+
+    parsing::Grammar lr1(tokens, rules, {{}}, parsing::LR1_TABLE);
+    assert(lr1.conflicts().empty());
+    assert(lr1.parse_table().size() == lalr.parse_table().size() + 1);
+    assert_dense_table_matches(lr1);
+    assert_compressed_table_matches(lr1);
+
+    // States that can be merged are, so the lang grammar has as many states as with LALR(1)
+    parsing::Grammar lang_lalr(parsing::keys(lang::LANG_TOKENS), lang::LANG_RULES, lang::LANG_PRECEDENCE,
+                               parsing::LALR_TABLE);
+    parsing::Grammar lang_lr1(parsing::keys(lang::LANG_TOKENS), lang::LANG_RULES, lang::LANG_PRECEDENCE,
+                              parsing::LR1_TABLE);
+    assert(lang_lalr.conflicts().empty());
+    assert(lang_lr1.conflicts().empty());
+    assert(lang_lr1.parse_table().size() == lang_lalr.parse_table().size());
+    assert(lang_lalr.parse_table().size() == lang::lang_grammar().parse_table().size());
+}
+
+static std::vector<std::string> sorted_lines(const std::string& text){
+    std::istringstream stream(text);
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(stream, line)){
+        lines.push_back(line);
+    }
+    std::sort(lines.begin(), lines.end());
+    return lines;
+}
+
+/**
+ * A grammar loaded from a cache should have the same tables as one that was built.
+ */
+static void assert_same_tables(const parsing::Grammar& grammar, const parsing::Grammar& expected){
+    assert(grammar.parse_table() == expected.parse_table());
+    assert(grammar.firsts() == expected.firsts());
+    assert(grammar.follows() == expected.follows());
+    assert(grammar.symbols() == expected.symbols());
+    assert(grammar.num_terminals() == expected.num_terminals());
+
+    const parsing::DenseParseTable& dense = grammar.dense_table();
+    const parsing::CompressedParseTable& compressed = grammar.compressed_table();
+    const parsing::CompressedParseTable& expected_compressed = expected.compressed_table();
+    assert(compressed.size() == expected_compressed.size());
+    for (std::size_t state = 0; state < dense.num_states(); ++state){
+        for (std::size_t symbol = 0; symbol < dense.num_symbols(); ++symbol){
+            assert(dense.instr(state, symbol) == expected.dense_table().instr(state, symbol));
+            if (symbol < grammar.num_terminals()){
+                int cls = compressed.terminal_class(symbol);
+                assert(cls == expected_compressed.terminal_class(symbol));
+                assert(compressed.action(state, cls) == expected_compressed.action(state, cls));
+            }
+            else {
+                assert(compressed.goto_state(state, symbol) == expected_compressed.goto_state(state, symbol));
+            }
+        }
+    }
+
+    // The instructions in each state are dumped in hash order, which depends on the order 
+    // they were added to the table in
+    std::ostringstream dump, expected_dump;
+    grammar.dump(dump);
+    expected.dump(expected_dump);
+    assert(sorted_lines(dump.str()) == sorted_lines(expected_dump.str()));
+}
+
+void test_grammar_cache(){
+    const std::string cache_file = "test_grammar_cache.bin";
+    std::remove(cache_file.c_str());
+
+    // Has a conflict to save
+    const std::unordered_set<std::string> tokens = {"EQ", "STAR", "ID"};
+    const std::vector<parsing::ParseRule> rules = {
+        {"s", {"l", "EQ", "r"}, nullptr},
+        {"s", {"r"}, nullptr},
+        {"l", {"STAR", "r"}, nullptr},
+        {"l", {"ID"}, nullptr},
+        {"r", {"l"}, nullptr},
+    };
+    parsing::Grammar expected(tokens, rules);
+    assert(!expected.cached());
+
+    parsing::Grammar built(cache_file, tokens, rules);
+    assert(!built.cached());
+    parsing::Grammar loaded(cache_file, tokens, rules);
+    assert(loaded.cached());
+    assert(loaded.hash() == expected.hash());
+
+    // The sets and parse table a loaded grammar makes when asked are shared with its copies
+    const parsing::Grammar copy(loaded);
+    assert_same_tables(loaded, expected);
+    assert(&copy.parse_table() == &loaded.parse_table());
+    assert(&copy.firsts() == &loaded.firsts());
+    assert(loaded.conflicts().size() == 1);
+    assert(loaded.conflicts()[0].state == expected.conflicts()[0].state);
+    assert(loaded.conflicts()[0].instr1 == expected.conflicts()[0].instr1);
+    assert(loaded.conflicts()[0].instr2 == expected.conflicts()[0].instr2);
+    assert(loaded.conflicts()[0].lookahead == expected.conflicts()[0].lookahead);
+
+    // Anything the tables depend on changes the hash
+    parsing::Grammar lalr(cache_file, tokens, rules, {{}}, parsing::LALR_TABLE);
+    assert(!lalr.cached());
+    assert(lalr.hash() != expected.hash());
+    assert(lalr.conflicts().empty());
+    parsing::Grammar lalr_loaded(cache_file, tokens, rules, {{}}, parsing::LALR_TABLE);
+    assert(lalr_loaded.cached());
+    assert_same_tables(lalr_loaded, lalr);
+
+    assert(parsing::Grammar(parsing::keys(test_tokens), test_rules).hash() != 
+           parsing::Grammar(parsing::keys(test_tokens), test_rules, test_precedence).hash());
+    std::vector<parsing::ParseRule> other_rules(rules);
+    other_rules.back().production = {"ID"};
+    assert(parsing::Grammar(tokens, other_rules).hash() != expected.hash());
+
+    // Which unit rules pass through decides which are left out of the table
+    parsing::Grammar kept(cache_file, tokens, rules, {{}}, parsing::SLR_TABLE, 1, parsing::ELIMINATE_UNIT_RULES);
+    assert(!kept.cached());
+    std::vector<parsing::ParseRule> pass_rules(rules);
+    pass_rules.back().callback = parsing::pass_through;
+    parsing::Grammar eliminated(cache_file, tokens, pass_rules, {{}}, parsing::SLR_TABLE, 1, 
+                                parsing::ELIMINATE_UNIT_RULES);
+    assert(!eliminated.cached());
+    assert(eliminated.hash() != kept.hash());
+    assert(eliminated.rules_hash() != kept.rules_hash());
+    assert(eliminated.parse_table() != kept.parse_table());
+    assert_same_tables(eliminated, parsing::Grammar(tokens, pass_rules, {{}}, parsing::SLR_TABLE, 1, 
+                                                    parsing::ELIMINATE_UNIT_RULES));
+    parsing::Grammar eliminated_loaded(cache_file, tokens, pass_rules, {{}}, parsing::SLR_TABLE, 1, 
+                                       parsing::ELIMINATE_UNIT_RULES);
+    assert(eliminated_loaded.cached());
+    assert_same_tables(eliminated_loaded, eliminated);
+
+    // Lang
+    parsing::Grammar lang_built(cache_file, parsing::keys(lang::LANG_TOKENS), lang::LANG_RULES, lang::LANG_PRECEDENCE);
+    assert(!lang_built.cached());
+    parsing::Grammar lang_loaded(cache_file, parsing::keys(lang::LANG_TOKENS), lang::LANG_RULES, lang::LANG_PRECEDENCE);
+    assert(lang_loaded.cached());
+    assert_same_tables(lang_loaded, lang_built);
+
+    // A damaged cache is built again
+    std::string contents;
+    {
+        std::ifstream in(cache_file, std::ios::binary);
+        contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    {
+        std::ofstream out(cache_file, std::ios::binary);
+        out << contents.substr(0, contents.size() / 2);
+    }
+    parsing::Grammar truncated(cache_file, parsing::keys(lang::LANG_TOKENS), lang::LANG_RULES, lang::LANG_PRECEDENCE);
+    assert(!truncated.cached());
+    assert_same_tables(truncated, lang_built);
+
+    contents[contents.size() / 2] ^= 1;
+    {
+        std::ofstream out(cache_file, std::ios::binary);
+        out << contents;
+    }
+    parsing::Grammar corrupted(cache_file, parsing::keys(lang::LANG_TOKENS), lang::LANG_RULES, lang::LANG_PRECEDENCE);
+    assert(!corrupted.cached());
+    assert_same_tables(corrupted, lang_built);
+
+    std::remove(cache_file.c_str());
+}
+
 int main(){
     test_rules1();
     test_rules2();
@@ -327,10 +750,16 @@ int main(){
     test_rules4();
     test_rules5();
     test_rules6();
+    test_mutually_recursive_firsts();
 
     test_closure();
     test_move_pos();
+    test_make_dfa();
     test_parse_precedence();
+    test_dense_table();
+    test_lalr_tables();
+    test_lr1_tables();
+    test_grammar_cache();
 
     return 0;
 }
@@ -1,6 +1,8 @@
 #include "utils.h"
 #include <cstdlib>
 #include <cctype>
+#include <algorithm>
+#include <sstream>
 
 std::string join(const std::vector<std::string>& v, const std::string& delim) {
     std::string s;
@@ -65,3 +67,133 @@ char circ_shift_num_char(char c){
     std::size_t i = c - '0';
     return NUM_CHARS[(i+1) % NUM_CHARS.size()];
 }
+
+/**
+ * Anything other than letters, digits and underscores is written as an octal escape. Octal 
+ * escapes are at most 3 digits, so they cannot run into the next character.
+ */
+std::string string_literal(const std::string& str){
+    std::ostringstream literal;
+    literal << '"';
+    for (unsigned char c : str){
+        if (std::isalnum(c) || c == '_'){
+            literal << c;
+        }
+        else {
+            literal << '\\' << static_cast<char>('0' + (c >> 6))
+                    << static_cast<char>('0' + ((c >> 3) & 7)) << static_cast<char>('0' + (c & 7));
+        }
+    }
+    literal << '"';
+    return literal.str();
+}
+
+/**
+ * Run the tasks numbered [0, num_tasks) on up to num_threads threads, which each take the 
+ * next task that has not been started yet. The calling thread is used as one of the threads, 
+ * and each task is also given the number of the thread running it. If a task throws, no more 
+ * tasks are started and the first thing thrown is thrown again here once the threads finish.
+ */
+void run_parallel(std::size_t num_tasks, std::size_t num_threads, const ParallelTask& task){
+    WorkerThreads(std::min(num_threads, num_tasks)).run(num_tasks, task);
+}
+
+/**
+ * If a thread cannot be started, the ones already started are stopped and joined.
+ */
+WorkerThreads::WorkerThreads(std::size_t num_threads): next_task_(0){
+    try {
+        for (std::size_t i = 1; i < num_threads; ++i){
+            threads_.emplace_back(&WorkerThreads::wait_for_batches, this, i);
+        }
+    }
+    catch (...){
+        stop();
+        throw;
+    }
+}
+
+WorkerThreads::~WorkerThreads(){
+    stop();
+}
+
+void WorkerThreads::stop(){
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    start_.notify_all();
+    for (std::thread& thread : threads_){
+        thread.join();
+    }
+    threads_.clear();
+}
+
+/**
+ * Take tasks from the current batch until there are none left.
+ */
+void WorkerThreads::work(std::size_t thread){
+    try {
+        for (std::size_t i = next_task_++; i < num_tasks_; i = next_task_++){
+            (*task_)(i, thread);
+        }
+    }
+    catch (...){
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!error_){
+            error_ = std::current_exception();
+        }
+        next_task_ = num_tasks_;
+    }
+}
+
+void WorkerThreads::wait_for_batches(std::size_t thread){
+    std::size_t batch = 0;
+    while (1){
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            start_.wait(lock, [&](){ return stopping_ || batch_ != batch; });
+            if (stopping_){
+                return;
+            }
+            batch = batch_;
+        }
+
+        work(thread);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!--running_){
+            done_.notify_one();
+        }
+    }
+}
+
+/**
+ * Run the tasks numbered [0, num_tasks) on the threads the same way as run_parallel, and 
+ * return once they have all finished. Every thread joins each batch, so a batch is not 
+ * started until the last one is done.
+ */
+void WorkerThreads::run(std::size_t num_tasks, const ParallelTask& task){
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_ = &task;
+        num_tasks_ = num_tasks;
+        next_task_ = 0;
+        error_ = nullptr;
+        running_ = threads_.size();
+        ++batch_;
+    }
+    start_.notify_all();
+
+    work(0);
+
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [&](){ return !running_; });
+        std::swap(error, error_);
+    }
+    if (error){
+        std::rethrow_exception(error);
+    }
+}
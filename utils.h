@@ -1,7 +1,13 @@
 #ifndef _UTILS_H
 #define _UTILS_H
 
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 #include <unordered_set>
 
@@ -24,4 +30,49 @@ std::string rand_alphanum_str(std::size_t len);
 char circ_shift_alpha_char(char c);
 char circ_shift_num_char(char c);
 
+// The string as a C++ string literal, for generated code
+std::string string_literal(const std::string& str);
+
+/**
+ * Threads
+ */
+typedef std::function<void(std::size_t task, std::size_t thread)> ParallelTask;
+
+void run_parallel(std::size_t num_tasks, std::size_t num_threads, const ParallelTask& task);
+
+/**
+ * Threads kept waiting between batches of tasks, for work that is handed out in many small 
+ * batches. The thread that calls run() is used as thread 0, so num_threads - 1 are started.
+ */
+class WorkerThreads {
+    private:
+        std::vector<std::thread> threads_;
+        std::mutex mutex_;
+        std::condition_variable start_;
+        std::condition_variable done_;
+        bool stopping_ = false;
+
+        // The current batch
+        const ParallelTask* task_ = nullptr;
+        std::size_t num_tasks_ = 0;
+        std::size_t batch_ = 0;
+        std::size_t running_ = 0;
+        std::atomic<std::size_t> next_task_;
+        std::exception_ptr error_;
+
+        void work(std::size_t thread);
+        void wait_for_batches(std::size_t thread);
+        void stop();
+
+    public:
+        explicit WorkerThreads(std::size_t num_threads);
+        ~WorkerThreads();
+
+        WorkerThreads(const WorkerThreads&) = delete;
+        WorkerThreads& operator=(const WorkerThreads&) = delete;
+
+        void run(std::size_t num_tasks, const ParallelTask& task);
+        std::size_t num_threads() const { return threads_.size() + 1; }
+};
+
 #endif